@@ -19,6 +19,13 @@
 #include <assert.h>
 #include <string.h>
 
+// the value is data: neither NaN nor, with hasInvalid, the invalid value
+template <typename T>
+inline bool isValidValue(T value, bool hasInvalid = false, float invalid = 0.0f) {
+    // NaN is the only value not equal to itself
+    return value == value && !(hasInvalid && value == invalid);
+}
+
 template <typename T>
 struct GeoArray {
 
@@ -38,7 +45,7 @@ struct GeoArray {
         ARRAY_STATUS_READ_VARIABLE_ERROR
     } Status;
     
-    GeoArray() : array_p_(nullptr), status_(ARRAY_STATUS_UNKNOW) {}
+    GeoArray() : array_p_(nullptr), has_invalid_value_(false), invalid_value_(0), status_(ARRAY_STATUS_UNKNOW) {}
 
     GeoArray(const GeoArray& geoArray)
         : array_p_(nullptr) {
@@ -46,7 +53,8 @@ struct GeoArray {
     }
 
     // move custructor
-    GeoArray(GeoArray&& ga) {
+    GeoArray(GeoArray&& ga)
+        : array_p_(nullptr) {
         operator=(std::move(ga));
     }
 
@@ -69,6 +77,8 @@ struct GeoArray {
         longitude_num_ = ga.longitude_num_;
         maxVal_ = ga.maxVal_;
         minVal_ = ga.minVal_;
+        has_invalid_value_ = ga.has_invalid_value_;
+        invalid_value_ = ga.invalid_value_;
         status_ = ga.status_;
         file_full_path_ = ga.file_full_path_;
         type_ = ga.type_;
@@ -95,11 +105,14 @@ struct GeoArray {
         longitude_num_ = ga.longitude_num_;
         maxVal_ = ga.maxVal_;
         minVal_ = ga.minVal_;
+        has_invalid_value_ = ga.has_invalid_value_;
+        invalid_value_ = ga.invalid_value_;
         status_ = ga.status_;
         file_full_path_ = ga.file_full_path_;
         type_ = ga.type_;
 
         // for non-const other, scramble other's array pointer to this
+        delete []array_p_;
         array_p_ = ga.array_p_;
         ga.array_p_ = nullptr;
         return *this;
@@ -123,6 +136,11 @@ struct GeoArray {
         return array_p_[m * longitude_num_ + n];
     }
 
+    // the value is data: neither NaN nor the invalid value of this array
+    bool isValidValue(T value) const {
+        return ::isValidValue(value, has_invalid_value_, invalid_value_);
+    }
+
     Status getStatus() const {
         return status_;
     }
@@ -149,6 +167,7 @@ struct GeoArray {
 
     T minVal_;
 
+    // cells equal to invalid_value_ have no data, e.g. land, as NaN cells have none either
     bool has_invalid_value_;
 
     float invalid_value_;
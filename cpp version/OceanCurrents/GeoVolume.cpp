@@ -2,17 +2,33 @@
 #include "utils.h"
 #include "GeoArray.h"
 #include <algorithm>
-#include <tuple>
+#include <cmath>
+#include <limits>
+
+// min and max of the cells with data, the cells without are NaN. both NaN if no cell has data
+static void validRange(std::vector<float>::const_iterator itBeg, std::vector<float>::const_iterator itEnd,
+	float& minVal, float& maxVal)
+{
+	minVal = std::numeric_limits<float>::quiet_NaN();
+	maxVal = std::numeric_limits<float>::quiet_NaN();
+	for (auto it = itBeg; it != itEnd; ++it)
+	{
+		if (std::isnan(*it))
+			continue;
+		if (!(*it >= minVal))
+			minVal = *it;
+		if (!(*it <= maxVal))
+			maxVal = *it;
+	}
+}
 
 std::vector<float> GetNormalizedVolumeData( const GeoVolume<float>& gv )
 {
 	typedef float T;
 	std::vector<T> ret(gv.volData_);
-	std::vector<T>::const_iterator minIt, maxIt;
-	std::tie(minIt, maxIt) = std::minmax_element(ret.begin(), ret.end());
-
-	const T minVal = *minIt;
-	const T maxVal = *maxIt;
+	T minVal, maxVal;
+	validRange(ret.begin(), ret.end(), minVal, maxVal);
+	// the cells without data stay NaN
 	std::for_each(ret.begin(), ret.end(), 
 		[=](T& val){
 			val = static_cast<T>(getRatio(val, minVal, maxVal));
@@ -24,16 +40,13 @@ std::vector<float> GetNormalizedPerLevelVolumeData( const GeoVolume<float>& gv )
 {
 	typedef float T;
 	std::vector<T> ret(gv.volData_);
-	std::vector<T>::const_iterator minIt, maxIt;
 	auto itBeg = ret.begin();
 	auto itEnd = itBeg + gv.longitudeNum_*gv.latitudeNum_;
 
 	while(itBeg < ret.end())
 	{
-		std::tie(minIt, maxIt) = std::minmax_element(itBeg, itEnd);
-
-		const T minVal = *minIt;
-		const T maxVal = *maxIt;
+		T minVal, maxVal;
+		validRange(itBeg, itEnd, minVal, maxVal);
 		std::for_each(itBeg, itEnd, 
 			[=](T& val){
 				val = static_cast<T>(getRatio(val, minVal, maxVal));
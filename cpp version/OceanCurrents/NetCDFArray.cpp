@@ -1,7 +1,11 @@
 #include <iostream>
 #include <algorithm>
+#include <limits>
 #include "NetCDFArray.h"
 
+// written into the cells without data, no real value can be mistaken for it
+static const float NO_DATA = std::numeric_limits<float>::quiet_NaN();
+
 NetCDFArray::NetCDFArray(std::string path) 
 	: NetCDFArray::GeoArray<float>(), height_num_(0)
 {
@@ -454,9 +458,9 @@ bool NetCDFArray::getGeoArrayData(GeoArray<float>& geoArray, std::string variabl
 		for(int i = 0, count = 0; i < latitude_num_; i += 3)
 			for(int j = 0; j < longitude_num_; j += 3)
 #ifdef SOUTH_SEA
-				geoArray.array_p_[count++] = _isnan(array_p_[i * longitude_num_ + j]) ? this->minVal_ : array_p_[i * longitude_num_ + j];
+				geoArray.array_p_[count++] = _isnan(array_p_[i * longitude_num_ + j]) ? NO_DATA : array_p_[i * longitude_num_ + j];
 #else
-				geoArray.array_p_[count++] = array_p_[i * longitude_num_ + j] > 1e+34 ? 0 : array_p_[i * longitude_num_ + j];
+				geoArray.array_p_[count++] = array_p_[i * longitude_num_ + j] > 1e+34 ? NO_DATA : array_p_[i * longitude_num_ + j];
 #endif
 	}
 	else
@@ -464,14 +468,17 @@ bool NetCDFArray::getGeoArrayData(GeoArray<float>& geoArray, std::string variabl
 		geoArray.array_p_ = new float[size];
 		for(int i = 0; i < size; ++i)
 #ifdef SOUTH_SEA
-			geoArray.array_p_[i] = _isnan(array_p_[i]) || (variable_name == "SSH" && array_p_[i] == 0) ? this->minVal_ : array_p_[i];
+			geoArray.array_p_[i] = _isnan(array_p_[i]) || (variable_name == "SSH" && array_p_[i] == 0) ? NO_DATA : array_p_[i];
 #else
-			geoArray.array_p_[i] = array_p_[i] > 1e+34 ? 0 : array_p_[i];
+			geoArray.array_p_[i] = array_p_[i] > 1e+34 ? NO_DATA : array_p_[i];
 #endif
 	}
 	
 	geoArray.maxVal_ = maxVal_;
 	geoArray.minVal_ = minVal_;
+	// the cells without data are NaN, no other value marks them
+	geoArray.has_invalid_value_ = false;
+	geoArray.invalid_value_ = 0;
 	geoArray.status_ = ARRAY_STATUS_SUCCEED;
 
 	return true;
@@ -797,18 +804,18 @@ bool NetCDFArray::getGeoVolumeData(GeoVolume<float>& gv, std::string type_str, s
 					for(int j = 0; j < latitude_num_; j += 3)
 						for(int k = 0; k < longitude_num_; k += 3)
 #ifdef SOUTH_SEA
-							gv.volData_[count++] = _isnan(array_p_[i * latitude_num_ * longitude_num_ + j * longitude_num_ + k]) ? 0 : array_p_[i * latitude_num_ * longitude_num_ + j * longitude_num_ + k];
+							gv.volData_[count++] = _isnan(array_p_[i * latitude_num_ * longitude_num_ + j * longitude_num_ + k]) ? NO_DATA : array_p_[i * latitude_num_ * longitude_num_ + j * longitude_num_ + k];
 #else
-							gv.volData_[count++] = array_p_[i * latitude_num_ * longitude_num_ + j * longitude_num_ + k] > 1e+34 ? 0 : array_p_[i * latitude_num_ * longitude_num_ + j * longitude_num_ + k];
+							gv.volData_[count++] = array_p_[i * latitude_num_ * longitude_num_ + j * longitude_num_ + k] > 1e+34 ? NO_DATA : array_p_[i * latitude_num_ * longitude_num_ + j * longitude_num_ + k];
 #endif
 			}
 			else
 			{
 				for(int i = 0; i < size; ++i)
 #ifdef SOUTH_SEA
-					gv.volData_[i] = _isnan(array_p_[i]) ? 0 : array_p_[i];
+					gv.volData_[i] = _isnan(array_p_[i]) ? NO_DATA : array_p_[i];
 #else
-					gv.volData_[i] = array_p_[i] > 1e+34 ? 0 : array_p_[i];
+					gv.volData_[i] = array_p_[i] > 1e+34 ? NO_DATA : array_p_[i];
 #endif
 			}
 	
@@ -12,8 +12,39 @@ out vec3 color;
 
 // Values that stay constant for the whole mesh.
 uniform sampler2D myTextureSampler;
-uniform mat4 MV;
-uniform vec3 LightPosition_worldspace;
+// per-frame constants, shared by all the programs through one uniform buffer
+layout(std140) uniform FrameUniforms {
+	mat4 MVP;
+	mat4 V;
+	mat4 M;
+	vec3 LightPosition_worldspace;
+};
+// OLIC texture: velocity magnitude color in rgb, streak intensity in a
+uniform sampler2D olicTextureSampler;
+uniform float olicBlend;
+
+// virtual texture, replaces myTextureSampler when enabled: a page table with one texel per page and level that
+// points to the slot of the page, or of its nearest resident parent, in the atlas of resident pages
+uniform bool virtualTextureEnabled;
+uniform sampler2D pageTableSampler;
+uniform sampler2D pageAtlasSampler;
+// image size in texels, and the part of the page table it covers
+uniform vec2 vtImageSize;
+uniform vec2 vtTableScale;
+// page size, page border, slot size and atlas size, in texels
+uniform vec4 vtPage;
+uniform float vtMaxLevel;
+
+vec3 sampleVirtualTexture( vec2 uv ){
+	vec2 texel = min( uv * vtImageSize, vtImageSize - 0.5 );
+	// the level the hardware would pick for a mipmapped texture of the whole image
+	vec2 dx = dFdx( texel );
+	vec2 dy = dFdy( texel );
+	float level = clamp( floor( 0.5 * log2( max( dot(dx,dx), dot(dy,dy) ) ) ), 0.0, vtMaxLevel );
+	vec4 entry = floor( textureLod( pageTableSampler, uv * vtTableScale, level ) * 255.0 + 0.5 );
+	vec2 inPage = fract( texel / ( vtPage.x * exp2(entry.b) ) ) * vtPage.x + vtPage.y;
+	return textureLod( pageAtlasSampler, ( entry.rg * vtPage.z + inPage ) / vtPage.w, 0.0 ).rgb;
+}
 
 void main(){
 
@@ -23,7 +54,9 @@ void main(){
 	float LightPower = 50.0f;
 	
 	// Material properties
-	vec3 MaterialDiffuseColor = texture( myTextureSampler, UV ).rgb;
+	vec3 MaterialDiffuseColor = virtualTextureEnabled ? sampleVirtualTexture( UV ) : texture( myTextureSampler, UV ).rgb;
+	vec4 olic = texture( olicTextureSampler, UV );
+	MaterialDiffuseColor = mix( MaterialDiffuseColor, olic.rgb, olic.a * olicBlend );
 	vec3 MaterialAmbientColor = vec3(0.5, 0.5, 0.5) * MaterialDiffuseColor;
 	vec3 MaterialSpecularColor = vec3(0.4, 0.4, 0.4);
 
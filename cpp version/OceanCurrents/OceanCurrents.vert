@@ -12,11 +12,13 @@ out vec3 Normal_cameraspace;
 out vec3 EyeDirection_cameraspace;
 out vec3 LightDirection_cameraspace;
 
-// Values that stay constant for the whole mesh.
-uniform mat4 MVP;
-uniform mat4 V;
-uniform mat4 M;
-uniform vec3 LightPosition_worldspace;
+// per-frame constants, shared by all the programs through one uniform buffer
+layout(std140) uniform FrameUniforms {
+	mat4 MVP;
+	mat4 V;
+	mat4 M;
+	vec3 LightPosition_worldspace;
+};
 
 void main(){
 
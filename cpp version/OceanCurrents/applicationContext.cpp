@@ -9,6 +9,20 @@
 
 #include "applicationContext.hpp"
 #include <utils/shaderProgram.hpp>
+#include <stdexcept>
+
+#ifdef OC_HEADLESS_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+
+// the EGL display and context of the headless mode, there is only one context so they live here
+static EGLDisplay eglDisplay = EGL_NO_DISPLAY;
+static EGLContext eglContext = EGL_NO_CONTEXT;
+#endif
 
 ApplicationContext* ApplicationContext::_instance = nullptr;
 
@@ -24,25 +38,19 @@ ApplicationContext& ApplicationContext::init(ApplicationConfig* config) {
         // no configuration provided, use default config.
         config = new ApplicationConfig();
     }
-    // init GLFW window
-    glfwInit();
-    glfwWindowHint(GLFW_SAMPLES, config->windowSample);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, config->glfwMajor);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, config->glfwMinor);
-    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
-    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
-    context->_window = glfwCreateWindow(config->windowWidth, config->windowHeight, config->windowTitle.c_str(), nullptr, nullptr);
-    glfwMakeContextCurrent(context->_window);
-
-    // init GLEW
-    glewExperimental = true;
-    glewInit();
+    context->_window = nullptr;
+    context->_framebuffer = 0;
+    context->_colorRenderbuffer = 0;
+    context->_depthRenderbuffer = 0;
+    context->_frameCount = 0;
+    context->_startTime = std::chrono::steady_clock::now();
+    context->_appConfig = config;
 
-    // init GLFW input mode
-    glfwSetInputMode(context->_window, GLFW_STICKY_KEYS, GL_TRUE);
-    glfwSetInputMode(context->_window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
-    glfwPollEvents();
-    glfwSetCursorPos(context->_window, config->windowWidth / 2, config->windowHeight / 2);
+    if (config->headless) {
+        context->initHeadless(config);
+    } else {
+        context->initWindow(config);
+    }
 
     // clear color and enable z-buffer
     glClearColor(config->color->red, config->color->green, config->color->blue, config->color->alpha);
@@ -57,33 +65,186 @@ ApplicationContext& ApplicationContext::init(ApplicationConfig* config) {
 
     context->_buffers = std::vector<GLuint>();
     context->_buffers.clear();
+    context->_textureStreams.clear();
 
     context->_vertexArrayId = vertexArrayId;
 
-    // init shader program
-    context->_program = &ShaderProgram::init(config->vertexShader, config->fragmentShader);
+    // start building the default program, the driver compiles it while the application loads its data
+    context->_program = ShaderRegistry::init().load("default", config->vertexShader, config->fragmentShader);
 
-    // hold config and context
-    context->_appConfig = config;
+    // hold context
     ApplicationContext::_instance = context;
     
     return *context;
 }
 
+void ApplicationContext::initWindow(ApplicationConfig* config) {
+    // init GLFW window
+    glfwInit();
+    glfwWindowHint(GLFW_SAMPLES, config->windowSample);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, config->glfwMajor);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, config->glfwMinor);
+    glfwWindowHint(GLFW_OPENGL_FORWARD_COMPAT, GL_TRUE);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+    _window = glfwCreateWindow(config->windowWidth, config->windowHeight, config->windowTitle.c_str(), nullptr, nullptr);
+    glfwMakeContextCurrent(_window);
+
+    // init GLEW
+    glewExperimental = true;
+    glewInit();
+
+    // init GLFW input mode
+    glfwSetInputMode(_window, GLFW_STICKY_KEYS, GL_TRUE);
+    glfwSetInputMode(_window, GLFW_CURSOR, GLFW_CURSOR_NORMAL);
+    glfwPollEvents();
+    glfwSetCursorPos(_window, config->windowWidth / 2, config->windowHeight / 2);
+}
+
+/**
+ * @brief create a surfaceless EGL context and an offscreen framebuffer to render into.
+ *
+ * no window system is involved, so this runs on machines without display or GPU, e.g. with Mesa llvmpipe.
+ * there is no swap chain either: frames are not throttled by vsync, which gives the raw throughput.
+ */
+void ApplicationContext::initHeadless(ApplicationConfig* config) {
+#ifdef OC_HEADLESS_EGL
+    auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+    if (getPlatformDisplay != nullptr) {
+        eglDisplay = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY) {
+        eglDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    }
+    if (eglDisplay == EGL_NO_DISPLAY || !eglInitialize(eglDisplay, nullptr, nullptr)) {
+        throw std::runtime_error("ApplicationContext - initHeadless, cannot initialize EGL display");
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT,
+        EGL_NONE
+    };
+    EGLConfig eglConfig;
+    EGLint configNum = 0;
+    eglChooseConfig(eglDisplay, configAttribs, &eglConfig, 1, &configNum);
+    eglBindAPI(EGL_OPENGL_API);
+
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, EGLint(config->glfwMajor),
+        EGL_CONTEXT_MINOR_VERSION, EGLint(config->glfwMinor),
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE
+    };
+    // surfaceless displays may expose no config at all, EGL_KHR_no_config_context covers that
+    eglContext = eglCreateContext(eglDisplay, configNum > 0 ? eglConfig : (EGLConfig)0, EGL_NO_CONTEXT, contextAttribs);
+    if (eglContext == EGL_NO_CONTEXT ||
+        !eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglContext)) {
+        throw std::runtime_error("ApplicationContext - initHeadless, cannot create EGL context");
+    }
+
+    // init GLEW. without a X display the GLX part reports an error, but the GL entry points are loaded before it
+    glewExperimental = true;
+    glewInit();
+    glGetError();
+
+    // the offscreen framebuffer replaces the window's default framebuffer
+    glGenRenderbuffers(1, &_colorRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, _colorRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, config->windowWidth, config->windowHeight);
+    glGenRenderbuffers(1, &_depthRenderbuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, _depthRenderbuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, config->windowWidth, config->windowHeight);
+
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, _colorRenderbuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, _depthRenderbuffer);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("ApplicationContext - initHeadless, offscreen framebuffer is incomplete");
+    }
+    glViewport(0, 0, config->windowWidth, config->windowHeight);
+#else
+    (void)config;
+    throw std::runtime_error("ApplicationContext - initHeadless, built without OCEANCURRENTS_HEADLESS");
+#endif
+}
+
+void ApplicationContext::swapBuffers() {
+    _frameCount++;
+    if (_window != nullptr) {
+        glfwSwapBuffers(_window);
+    } else {
+        glFlush();
+    }
+}
+
+void ApplicationContext::pollEvents() {
+    if (_window != nullptr) {
+        glfwPollEvents();
+    }
+}
+
+void ApplicationContext::waitEvents() {
+    if (_window != nullptr) {
+        glfwWaitEvents();
+    }
+}
+
+void ApplicationContext::wakeEvents() {
+    if (_window != nullptr) {
+        glfwPostEmptyEvent();
+    }
+}
+
+bool ApplicationContext::shouldClose() const {
+    if (_appConfig->frameLimit > 0 && _frameCount >= _appConfig->frameLimit) {
+        return true;
+    }
+    if (_window == nullptr) {
+        return false;
+    }
+    return glfwGetKey(_window, GLFW_KEY_ESCAPE) == GLFW_PRESS || glfwWindowShouldClose(_window) != 0;
+}
+
+double ApplicationContext::getTime() const {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now() - _startTime).count();
+}
+
+void ApplicationContext::readPixels(std::vector<unsigned char>& pixels) const {
+    pixels.resize(size_t(_appConfig->windowWidth) * _appConfig->windowHeight * 4);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, _appConfig->windowWidth, _appConfig->windowHeight, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+}
+
 // finalize method to release resources
 void ApplicationContext::finalize() {
     // delete all the buffers
     for (GLuint buffer : this->_buffers) {
         glDeleteBuffers(1, &buffer);
     }
-    // release program
-    this->_program->finalize();
+    for (TextureStream* stream : this->_textureStreams) {
+        delete stream;
+    }
+    // release all the programs
+    ShaderRegistry::init().finalize();
 
     // delete vertexArray
     glDeleteVertexArrays(1, &this->_vertexArrayId);
 
-    // close GLFW window
-    glfwTerminate();
+    if (_window != nullptr) {
+        // close GLFW window
+        glfwTerminate();
+    } else {
+        glDeleteFramebuffers(1, &_framebuffer);
+        glDeleteRenderbuffers(1, &_colorRenderbuffer);
+        glDeleteRenderbuffers(1, &_depthRenderbuffer);
+#ifdef OC_HEADLESS_EGL
+        eglMakeCurrent(eglDisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(eglDisplay, eglContext);
+        eglTerminate(eglDisplay);
+#endif
+    }
 
+    _instance = nullptr;
     delete this;
 }
@@ -12,12 +12,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <vector>
+#include <chrono>
 
 #include <GL/glew.h>
 #include <glfw3.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 #include <utils/shaderProgram.hpp>
+#include "textureStream.hpp"
 
 // color structure, default to black
 struct MyColor {
@@ -36,6 +38,11 @@ struct ApplicationConfig {
     unsigned int glfwMinor = 3;
     std::string windowTitle = "default";
 
+    // render into an offscreen framebuffer of windowWidth x windowHeight without any window or display
+    bool headless = false;
+    // stop after this many frames, 0 for never. headless runs have no window to close
+    unsigned int frameLimit = 0;
+
     // --------- GL related ----------
     MyColor* color = new MyColor();
     std::string fragmentShader = "default.fragment";
@@ -76,6 +83,14 @@ public:
         _config->windowTitle = title;
         return *this;
     }
+    ConfigBuilder& headless(bool headless) {
+        _config->headless = headless;
+        return *this;
+    }
+    ConfigBuilder& frameLimit(unsigned int frames) {
+        _config->frameLimit = frames;
+        return *this;
+    }
     ConfigBuilder& color(MyColor* color) {
         // fuck memory management
         MyColor* toDelete = _config->color;
@@ -127,8 +142,38 @@ public:
         return buffer;
     }
 
+    // a texture refreshed from the CPU every frame, owned and released by the context
+    TextureStream* createTextureStream(int width, int height, int bytesPerPixel) {
+        auto stream = new TextureStream(width, height, bytesPerPixel);
+        _textureStreams.push_back(stream);
+        return stream;
+    }
+
+    // nullptr in headless mode
     GLFWwindow* getWindow() {return _window;}
 
+    bool isHeadless() const { return _appConfig->headless; }
+
+    // present the frame: swap the window buffers, or just flush the offscreen framebuffer when headless
+    void swapBuffers();
+
+    void pollEvents();
+
+    // block until an event comes or wakeEvents is called, returns right away when headless
+    void waitEvents();
+
+    // make waitEvents return, from any thread
+    void wakeEvents();
+
+    // the window is closed, escape is pressed, or the frame limit is reached
+    bool shouldClose() const;
+
+    // seconds since the context was initialized
+    double getTime() const;
+
+    // read back the RGBA pixels of the current framebuffer, bottom row first
+    void readPixels(std::vector<unsigned char>& pixels) const;
+
     ShaderProgram* getShaderProgram() const { return _program; }
 
     GLuint getVertexArrayId() const { return _vertexArrayId; }
@@ -142,13 +187,31 @@ private:
 
     GLFWwindow* _window;
 
-    // shaders program instance
+    // the default program, owned by the ShaderRegistry
     ShaderProgram* _program;
 
     GLuint _vertexArrayId;
 
     std::vector<GLuint> _buffers;
 
+    std::vector<TextureStream*> _textureStreams;
+
+    // offscreen framebuffer and its attachments in headless mode
+    GLuint _framebuffer;
+
+    GLuint _colorRenderbuffer;
+
+    GLuint _depthRenderbuffer;
+
+    unsigned int _frameCount;
+
+    std::chrono::steady_clock::time_point _startTime;
+
+    // create the GL context and the default framebuffer to render into
+    void initWindow(ApplicationConfig* config);
+
+    void initHeadless(ApplicationConfig* config);
+
     // singleton, forbid instantiating from client.
     ApplicationContext() {}
 };
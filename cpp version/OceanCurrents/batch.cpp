@@ -0,0 +1,504 @@
+/* batch offline renderer: OLIC, color, derived field, FTLE or upwelling frames for a range of ticks and levels of a
+ * set of NetCDF files.
+ *
+ * usage: OceanCurrentsBatch [options] file.nc...
+ *
+ * every frame is a chain of four jobs of the JobSystem: ingest, field construction, OLIC and image encoding. the
+ * frames overlap, so the whole product takes about as long as the slowest stage rather than the sum of all of them,
+ * and the OLIC of a frame splits its blocks over the workers left idle by the other stages.
+ *
+ * the derived mode writes speed, vorticity, divergence and Okubo-Weiss maps of the grid itself, one pixel per cell,
+ * all four from a single pass over the currents.
+ *
+ * the ftle mode takes the ticks as consecutive snapshots, the files included, and writes a FTLE map per tick once a
+ * whole window is read: the window ends at the tick going backward, and starts --window ticks before it going
+ * forward. the field jobs of this mode run in order, each integrates a single snapshot interval.
+ *
+ * the upwelling mode reads u, v and w down to the last of --levels and traces a 3D pathline from every cell of the
+ * first one, through the currents of the tick. it writes a frame per tick: how far each pathline went up, in the
+ * units of the levels.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "NetCDFArray.h"
+#include "olic.hpp"
+#include "colorMap.hpp"
+#include "derivedFields.hpp"
+#include "ftle.hpp"
+#include "jobSystem.hpp"
+#include "volumeField.hpp"
+#include "utils/imageWriter.hpp"
+
+struct BatchOptions {
+    std::vector<std::string> files;
+    int tickBegin = 0;
+    int tickEnd = 23;
+    int levelBegin = 0;
+    int levelEnd = 0;
+    std::string uName = "uu";
+    std::string vName = "vv";
+    std::string wName = "ww";
+    std::string outDir = ".";
+    // "olic", "color", "derived", "ftle" or "upwelling"
+    std::string mode = "olic";
+    // the equirectangular globe canvas, see OlicParam::wrapLongitude
+    bool globe = false;
+    // workers of the JobSystem, 0 for one per hardware thread but the main one
+    int threads = 0;
+    OlicParam olicParam;
+    FtleParam ftleParam;
+    PathlineParam pathlineParam;
+};
+
+// one file, opened by the first ingest job and closed by the last
+struct FileJob {
+    std::string path;
+    std::unique_ptr<NetCDFArray> nca;
+};
+
+// an RGBA image of a frame, written to the name of the frame plus suffix
+struct FrameImage {
+    std::string suffix;
+    int width;
+    int height;
+    bool bottomUp;
+    std::vector<unsigned char> pixels;
+};
+
+// one frame travelling through the pipeline
+struct FrameJob {
+    std::string name;
+    // the currents could be read, the later stages skip the frame otherwise
+    bool read = false;
+    GeoArray<float> u;
+    GeoArray<float> v;
+    std::unique_ptr<VectorField> field;
+    // the derived mode has no vector field
+    bool derivedReady = false;
+    DerivedFields derived;
+    // the ftle mode has a map once a whole window is read
+    bool ftleReady = false;
+    GeoArray<float> ftle;
+    // the upwelling mode reads volumes instead
+    GeoVolume<float> uVolume;
+    GeoVolume<float> vVolume;
+    GeoVolume<float> wVolume;
+    bool upwellingReady = false;
+    GeoArray<float> upwelling;
+    std::vector<FrameImage> images;
+};
+
+// busy time of a stage, summed over its threads
+struct StageStat {
+    const char* name;
+    std::atomic<long long> busyMicros;
+    std::atomic<int> frames;
+    explicit StageStat(const char* stageName) : name(stageName), busyMicros(0), frames(0) {}
+};
+
+class StageTimer {
+public:
+    explicit StageTimer(StageStat& stat) : _stat(stat), _start(std::chrono::steady_clock::now()) {}
+    ~StageTimer() {
+        auto elapsed = std::chrono::steady_clock::now() - _start;
+        _stat.busyMicros += std::chrono::duration_cast<std::chrono::microseconds>(elapsed).count();
+        _stat.frames++;
+    }
+private:
+    StageStat& _stat;
+    std::chrono::steady_clock::time_point _start;
+};
+
+/**
+ * @brief one pixel per cell, top row north. signed fields are scaled symmetrically by range, the others from 0 to
+ *        range. the cells without data are transparent.
+ */
+static FrameImage colorizeField(const GeoArray<float>& field, const char* suffix, float range, bool isSigned,
+                                const std::vector<glm::u8vec4>& lut) {
+    FrameImage image;
+    image.suffix = suffix;
+    image.width = field.longitude_num_;
+    image.height = field.latitude_num_;
+    // the rows of the grid go north when the interval is positive, the first one is the bottom of the image
+    image.bottomUp = field.latitude_interval_ > 0;
+    size_t count = size_t(image.width) * image.height;
+    image.pixels.assign(count * 4, 0);
+    float scale = range > 0.0f ? 1.0f / range : 0.0f;
+    for (size_t i = 0; i < count; i++) {
+        float value = field.array_p_[i];
+        if (!field.isValidValue(value)) {
+            continue;
+        }
+        float position = isSigned ? value * scale * 0.5f + 0.5f : value * scale;
+        position = std::min(std::max(position, 0.0f), 1.0f);
+        memcpy(&image.pixels[i * 4], &lut[int(position * (COLOR_LUT_SIZE - 1) + 0.5f)], 4);
+    }
+    return image;
+}
+
+/**
+ * @brief trace a pathline from every cell of the seed level and keep how far up it went, DERIVED_FILL_VALUE where it
+ *        could not start.
+ */
+static bool traceUpwelling(const GeoVolume<float>& u, const GeoVolume<float>& v, const GeoVolume<float>& w,
+                           int seedLevel, PathlineParam param, GeoArray<float>& upwelling) {
+    VolumeField field(u, v, w);
+    if (!field.isValid() || seedLevel >= int(u.heightOfLevels_.size())) {
+        return false;
+    }
+    int lonNum = u.longitudeNum_;
+    int latNum = u.latitudeNum_;
+    float depth = float(u.heightOfLevels_[seedLevel]);
+    std::vector<glm::vec3> seeds(size_t(lonNum) * latNum);
+    for (auto m = 0; m < latNum; m++) {
+        for (auto n = 0; n < lonNum; n++) {
+            seeds[size_t(m) * lonNum + n] = glm::vec3(float(u.longitudeStart_ + n * u.longitudeStep_),
+                                                      float(u.latitudeStart_ + m * u.latitudeStep_), depth);
+        }
+    }
+    // only the ends of the pathlines
+    param.recordInterval = std::max(param.steps, 1);
+    Pathlines pathlines;
+    field.trace(seeds, param, pathlines);
+
+    upwelling = GeoArray<float>();
+    upwelling.longitude_start_ = u.longitudeStart_;
+    upwelling.longitude_interval_ = u.longitudeStep_;
+    upwelling.longitude_num_ = lonNum;
+    upwelling.longitude_end_ = u.longitudeStart_ + u.longitudeStep_ * (lonNum - 1);
+    upwelling.latitude_start_ = u.latitudeStart_;
+    upwelling.latitude_interval_ = u.latitudeStep_;
+    upwelling.latitude_num_ = latNum;
+    upwelling.latitude_end_ = u.latitudeStart_ + u.latitudeStep_ * (latNum - 1);
+    upwelling.has_invalid_value_ = true;
+    upwelling.invalid_value_ = DERIVED_FILL_VALUE;
+    upwelling.status_ = GeoArray<float>::ARRAY_STATUS_SUCCEED;
+    upwelling.array_p_ = new float[seeds.size()];
+    for (size_t i = 0; i < seeds.size(); i++) {
+        // the levels are depths, going up makes them smaller
+        const glm::vec3& end = pathlines.points[(i + 1) * pathlines.pointNum - 1];
+        upwelling.array_p_[i] = pathlines.steps[i] > 0 ? depth - end.z : DERIVED_FILL_VALUE;
+    }
+    return true;
+}
+
+static std::string baseName(const std::string& path) {
+    size_t slash = path.find_last_of("/\\");
+    std::string name = slash == std::string::npos ? path : path.substr(slash + 1);
+    size_t dot = name.find_last_of('.');
+    return dot == std::string::npos ? name : name.substr(0, dot);
+}
+
+// parse "a:b" or "a" into an inclusive range
+static void parseRange(const char* text, int& begin, int& end) {
+    const char* colon = strchr(text, ':');
+    begin = atoi(text);
+    end = colon != nullptr ? atoi(colon + 1) : begin;
+}
+
+static void printUsage() {
+    printf("usage: OceanCurrentsBatch [options] file.nc...\n"
+           "  --ticks a:b      tick range, inclusive (default 0:23)\n"
+           "  --levels a:b     level index range, inclusive (default 0:0)\n"
+           "  --u name         eastward current variable (default uu)\n"
+           "  --v name         northward current variable (default vv)\n"
+           "  --w name         upward current variable (default ww)\n"
+           "  --mode olic|color|derived|ftle|upwelling\n"
+           "  --out dir        output directory (default .)\n"
+           "  --width n --height n\n"
+           "  --side n --dim n --rate f --step f --seed n\n"
+           "  --globe          render the equirectangular globe texture\n"
+           "  --window n       FTLE window in ticks (default 24)\n"
+           "  --interval f     seconds between two ticks (default 3600)\n"
+           "  --refine n       FTLE points per grid cell along each axis (default 2)\n"
+           "  --backward       backward FTLE, attracting instead of repelling structures\n"
+           "  --steps n        RK4 steps per pathline (default 96)\n"
+           "  --pathstep f     seconds per pathline step (default 900)\n"
+           "  --threads n      worker threads\n");
+}
+
+static bool parseOptions(int argc, char** argv, BatchOptions& options) {
+    for (auto i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool hasValue = i + 1 < argc;
+        if (arg == "--globe") {
+            options.globe = true;
+        } else if (arg == "--backward") {
+            options.ftleParam.forward = false;
+        } else if (arg.compare(0, 2, "--") == 0 && !hasValue) {
+            return false;
+        } else if (arg == "--ticks") {
+            parseRange(argv[++i], options.tickBegin, options.tickEnd);
+        } else if (arg == "--levels") {
+            parseRange(argv[++i], options.levelBegin, options.levelEnd);
+        } else if (arg == "--u") {
+            options.uName = argv[++i];
+        } else if (arg == "--v") {
+            options.vName = argv[++i];
+        } else if (arg == "--w") {
+            options.wName = argv[++i];
+        } else if (arg == "--mode") {
+            options.mode = argv[++i];
+        } else if (arg == "--out") {
+            options.outDir = argv[++i];
+        } else if (arg == "--width") {
+            options.olicParam.width = atoi(argv[++i]);
+        } else if (arg == "--height") {
+            options.olicParam.height = atoi(argv[++i]);
+        } else if (arg == "--side") {
+            options.olicParam.sideLength = atoi(argv[++i]);
+        } else if (arg == "--dim") {
+            options.olicParam.dimPixel = atoi(argv[++i]);
+        } else if (arg == "--rate") {
+            options.olicParam.dropletRate = float(atof(argv[++i]));
+        } else if (arg == "--step") {
+            options.olicParam.integralStep = float(atof(argv[++i]));
+        } else if (arg == "--seed") {
+            options.olicParam.seed = (unsigned int)strtoul(argv[++i], nullptr, 10);
+        } else if (arg == "--window") {
+            options.ftleParam.windowIntervals = atoi(argv[++i]);
+        } else if (arg == "--interval") {
+            options.ftleParam.snapshotInterval = atof(argv[++i]);
+        } else if (arg == "--refine") {
+            options.ftleParam.refinement = atoi(argv[++i]);
+        } else if (arg == "--steps") {
+            options.pathlineParam.steps = atoi(argv[++i]);
+        } else if (arg == "--pathstep") {
+            options.pathlineParam.stepSeconds = float(atof(argv[++i]));
+        } else if (arg == "--threads") {
+            options.threads = atoi(argv[++i]);
+        } else if (arg.compare(0, 2, "--") == 0) {
+            return false;
+        } else {
+            options.files.push_back(arg);
+        }
+    }
+    return !options.files.empty() && (options.mode == "olic" || options.mode == "color" || options.mode == "derived" ||
+                                      options.mode == "ftle" || options.mode == "upwelling");
+}
+
+int main(int argc, char** argv) {
+    BatchOptions options;
+    if (!parseOptions(argc, argv, options)) {
+        printUsage();
+        return 1;
+    }
+    OlicParam& param = options.olicParam;
+    param.pixelFormat = OLIC_PIXEL_RGBA8;
+    param.wrapLongitude = options.globe;
+    // every frame has its own context, its droplets are generated by the workers
+    param.threadNum = 0;
+
+    auto& jobs = JobSystem::init(options.threads);
+    // the frames in flight, enough to keep every worker busy while bounding the memory
+    size_t maxFrames = size_t(2 * (jobs.getWorkerNum() + 1));
+    bool derivedMode = options.mode == "derived";
+    bool ftleMode = options.mode == "ftle";
+    bool upwellingMode = options.mode == "upwelling";
+    // an upwelling frame covers all the levels, it seeds at the first one
+    int levelLast = upwellingMode ? options.levelBegin : options.levelEnd;
+    // the window of every level slides on its own
+    std::vector<std::unique_ptr<FtleEngine>> ftleEngines;
+    for (auto level = options.levelBegin; ftleMode && level <= options.levelEnd; level++) {
+        ftleEngines.push_back(std::unique_ptr<FtleEngine>(new FtleEngine(options.ftleParam)));
+    }
+    const std::vector<glm::u8vec4> colorLut = defaultColorLut();
+    const std::vector<glm::u8vec4> divergingLut = divergingColorLut();
+
+    StageStat ingestStat("ingest"), fieldStat("field"), renderStat(options.mode.c_str()), encodeStat("encode");
+    auto start = std::chrono::steady_clock::now();
+
+    std::deque<JobSystem::JobHandle> encodes;
+    auto finishOldest = [&jobs, &encodes]() {
+        try {
+            jobs.wait(encodes.front());
+        } catch (std::exception& e) {
+            printf("[BATCH] %s\n", e.what());
+        }
+        encodes.pop_front();
+    };
+
+    // the netCDF library is not thread safe, so the ingest jobs of all the files form a single chain
+    JobSystem::JobHandle lastIngest;
+    // the FTLE of a tick needs the flow maps of the ticks before
+    JobSystem::JobHandle lastField;
+    for (const std::string& path : options.files) {
+        auto file = std::make_shared<FileJob>();
+        file->path = path;
+        lastIngest = jobs.submit([file]() {
+            file->nca.reset(new NetCDFArray(file->path));
+            if (file->nca->getStatus() != GeoArray<float>::ARRAY_STATUS_SUCCEED) {
+                printf("[BATCH] skip %s: cannot open\n", file->path.c_str());
+                file->nca.reset();
+            }
+        }, {lastIngest});
+        for (auto tick = options.tickBegin; tick <= options.tickEnd; tick++) {
+            for (auto level = options.levelBegin; level <= levelLast; level++) {
+                if (encodes.size() >= maxFrames) {
+                    finishOldest();
+                }
+                auto frame = std::make_shared<FrameJob>();
+                char name[64];
+                sprintf(name, "_t%02d_l%02d", tick, level);
+                frame->name = baseName(path) + name;
+
+                lastIngest = jobs.submit([&, file, frame, tick, level]() {
+                    if (!file->nca) {
+                        return;
+                    }
+                    StageTimer timer(ingestStat);
+                    if (upwellingMode) {
+                        // the volumes start at the first level of the file
+                        size_t levelNum = size_t(options.levelEnd + 1);
+                        frame->read = file->nca->getGeoVolumeData(frame->uVolume, options.uName, tick, levelNum) &&
+                                      file->nca->getGeoVolumeData(frame->vVolume, options.vName, tick, levelNum) &&
+                                      file->nca->getGeoVolumeData(frame->wVolume, options.wName, tick, levelNum);
+                    } else {
+                        frame->read = file->nca->getGeoArrayData(frame->u, options.uName, tick, level) &&
+                                      file->nca->getGeoArrayData(frame->v, options.vName, tick, level);
+                    }
+                    if (!frame->read) {
+                        printf("[BATCH] skip %s tick %d level %d: cannot read currents\n", file->path.c_str(), tick,
+                               level);
+                    }
+                }, {lastIngest});
+
+                JobSystem::JobHandle field = jobs.submit([&, frame, level]() {
+                    if (!frame->read) {
+                        return;
+                    }
+                    StageTimer timer(fieldStat);
+                    if (ftleMode) {
+                        FtleEngine& engine = *ftleEngines[level - options.levelBegin];
+                        // the window is left as it was, its FTLE belongs to the frame before
+                        if (!engine.pushSnapshot(frame->u, frame->v)) {
+                            printf("[BATCH] skip %s: not on the grid of the first snapshot\n", frame->name.c_str());
+                            frame->ftleReady = false;
+                        } else {
+                            frame->ftleReady = engine.compute(frame->ftle);
+                        }
+                    } else if (derivedMode) {
+                        frame->derivedReady = computeDerivedFields(frame->u, frame->v, DERIVED_ALL, frame->derived);
+                    } else if (upwellingMode) {
+                        frame->upwellingReady = traceUpwelling(frame->uVolume, frame->vVolume, frame->wVolume, level,
+                                                               options.pathlineParam, frame->upwelling);
+                        if (!frame->upwellingReady) {
+                            printf("[BATCH] skip %s: the currents are not a volume\n", frame->name.c_str());
+                        }
+                        frame->uVolume = GeoVolume<float>();
+                        frame->vVolume = GeoVolume<float>();
+                        frame->wVolume = GeoVolume<float>();
+                    } else {
+                        frame->field.reset(new VectorField(frame->u, frame->v, param.width, param.height,
+                                                           options.globe));
+                    }
+                    frame->u = GeoArray<float>();
+                    frame->v = GeoArray<float>();
+                }, {lastIngest, ftleMode ? lastField : JobSystem::JobHandle()});
+                lastField = field;
+
+                JobSystem::JobHandle render = jobs.submit([&, frame]() {
+                    if (!frame->field && !frame->derivedReady && !frame->ftleReady && !frame->upwellingReady) {
+                        return;
+                    }
+                    StageTimer timer(renderStat);
+                    if (upwellingMode) {
+                        frame->images.push_back(colorizeField(frame->upwelling, "_upwelling",
+                                                              getDerivedRange(frame->upwelling), true, divergingLut));
+                        frame->upwelling = GeoArray<float>();
+                        return;
+                    }
+                    if (ftleMode) {
+                        frame->images.push_back(colorizeField(frame->ftle, "_ftle", getDerivedRange(frame->ftle), false,
+                                                              colorLut));
+                        frame->ftle = GeoArray<float>();
+                        return;
+                    }
+                    if (derivedMode) {
+                        DerivedFields& derived = frame->derived;
+                        frame->images.push_back(colorizeField(derived.speed, "_speed", derived.speed.maxVal_, false,
+                                                              colorLut));
+                        frame->images.push_back(colorizeField(derived.vorticity, "_vorticity",
+                                                              getDerivedRange(derived.vorticity), true, divergingLut));
+                        frame->images.push_back(colorizeField(derived.divergence, "_divergence",
+                                                              getDerivedRange(derived.divergence), true, divergingLut));
+                        frame->images.push_back(colorizeField(derived.okuboWeiss, "_okuboweiss",
+                                                              getDerivedRange(derived.okuboWeiss), true, divergingLut));
+                        frame->derived = DerivedFields();
+                        return;
+                    }
+                    FrameImage image;
+                    image.width = param.width;
+                    image.height = param.height;
+                    image.bottomUp = true;
+                    image.pixels.resize(size_t(param.width) * param.height * 4);
+                    std::vector<unsigned char>& pixels = image.pixels;
+                    if (options.mode == "olic") {
+                        std::unique_ptr<OlicContext> olic(OlicContext::create(param, *frame->field));
+                        olic->refreshOLIC(pixels.data());
+                    } else {
+                        jobs.parallelFor(0, param.height, 16, [&](int first, int last) {
+                            for (auto y = first; y < last; y++) {
+                                for (auto x = 0; x < param.width; x++) {
+                                    float magnitude = frame->field->getNormalizedMagnitude(glm::vec2(x, y));
+                                    const glm::u8vec4& color = colorLut[int(magnitude * (COLOR_LUT_SIZE - 1) + 0.5f)];
+                                    memcpy(&pixels[(size_t(y) * param.width + x) * 4], &color, 4);
+                                }
+                            }
+                        });
+                    }
+                    frame->images.push_back(std::move(image));
+                    frame->field.reset();
+                }, {field});
+
+                encodes.push_back(jobs.submit([&, frame]() {
+                    if (frame->images.empty()) {
+                        return;
+                    }
+                    StageTimer timer(encodeStat);
+                    for (const FrameImage& image : frame->images) {
+                        std::string path = options.outDir + "/" + frame->name + image.suffix + ".png";
+                        try {
+                            ImageWriter::writePng(path, image.pixels.data(), image.width, image.height, 4,
+                                                  image.bottomUp);
+                        } catch (std::runtime_error& e) {
+                            printf("[BATCH] %s\n", e.what());
+                        }
+                    }
+                }, {render}));
+            }
+        }
+        // close the file once its last frame is read
+        lastIngest = jobs.submit([file]() { file->nca.reset(); }, {lastIngest});
+    }
+    while (!encodes.empty()) {
+        finishOldest();
+    }
+    if (lastIngest) {
+        jobs.wait(lastIngest);
+    }
+
+    double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    printf("%d frames in %.2f s\n", encodeStat.frames.load(), wall);
+    for (StageStat* stat : {&ingestStat, &fieldStat, &renderStat, &encodeStat}) {
+        printf("  %-7s %3d frames, busy %8.2f s\n", stat->name, stat->frames.load(), stat->busyMicros / 1e6);
+    }
+    for (auto i = 0; i < jobs.getWorkerNum(); i++) {
+        JobSystem::WorkerStats stats = jobs.getStats(i);
+        printf("  worker %2d %6llu jobs, %6llu steals, idle %8.2f s\n", i, (unsigned long long)stats.jobs,
+               (unsigned long long)stats.steals, stats.idleSeconds);
+    }
+    jobs.finalize();
+    return 0;
+}
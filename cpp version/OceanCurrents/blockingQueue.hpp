@@ -0,0 +1,73 @@
+/* bounded blocking queue connecting the stages of a pipeline
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef BLOCKING_QUEUE_HPP
+#define BLOCKING_QUEUE_HPP
+
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+
+/**
+ * @brief multi producer, multi consumer FIFO with a capacity.
+ *
+ * push blocks while the queue is full, so a fast stage can not run arbitrarily far ahead of a slow one.
+ * once closed, pop drains the remaining items and then returns false.
+ */
+template <typename T>
+class BlockingQueue {
+public:
+    explicit BlockingQueue(size_t capacity) : _capacity(capacity), _closed(false) {}
+
+    void push(T item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notFull.wait(lock, [this]() { return _items.size() < _capacity || _closed; });
+        _items.push_back(std::move(item));
+        _notEmpty.notify_one();
+    }
+
+    // wait for an item, false if the queue is closed and empty
+    bool pop(T& item) {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _notEmpty.wait(lock, [this]() { return !_items.empty() || _closed; });
+        if (_items.empty()) {
+            return false;
+        }
+        item = std::move(_items.front());
+        _items.pop_front();
+        _notFull.notify_one();
+        return true;
+    }
+
+    // take an item if there is one, never waits
+    bool tryPop(T& item) {
+        std::lock_guard<std::mutex> lock(_mutex);
+        if (_items.empty()) {
+            return false;
+        }
+        item = std::move(_items.front());
+        _items.pop_front();
+        _notFull.notify_one();
+        return true;
+    }
+
+    // no more items will be pushed, wake up all the consumers
+    void close() {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _closed = true;
+        _notEmpty.notify_all();
+        _notFull.notify_all();
+    }
+
+private:
+    size_t _capacity;
+    bool _closed;
+    std::deque<T> _items;
+    std::mutex _mutex;
+    std::condition_variable _notEmpty;
+    std::condition_variable _notFull;
+};
+
+#endif
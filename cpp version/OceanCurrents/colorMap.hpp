@@ -0,0 +1,53 @@
+/* velocity magnitude color look up table
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef COLOR_MAP_HPP
+#define COLOR_MAP_HPP
+
+#include <algorithm>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
+
+// entries of a color look up table, a normalized magnitude m is mapped to entry m * (COLOR_LUT_SIZE - 1)
+const int COLOR_LUT_SIZE = 256;
+
+/**
+ * @brief build a look up table by linear interpolating the given color stops, which are evenly spaced over [0, 1]
+ */
+inline std::vector<glm::u8vec4> buildColorLut(const std::vector<glm::vec3>& stops) {
+    std::vector<glm::u8vec4> lut(COLOR_LUT_SIZE);
+    for (auto i = 0; i < COLOR_LUT_SIZE; i++) {
+        float pos = float(i) / (COLOR_LUT_SIZE - 1) * (stops.size() - 1);
+        int lower = std::min(int(pos), int(stops.size()) - 1);
+        int upper = std::min(lower + 1, int(stops.size()) - 1);
+        glm::vec3 color = glm::mix(stops[lower], stops[upper], pos - lower);
+        lut[i] = glm::u8vec4(glm::u8vec3(color * 255.0f + 0.5f), 255);
+    }
+    return lut;
+}
+
+// slow currents are dark blue, fast ones fade to cyan and white
+inline std::vector<glm::u8vec4> defaultColorLut() {
+    std::vector<glm::vec3> stops;
+    stops.push_back(glm::vec3(0.02f, 0.10f, 0.35f));
+    stops.push_back(glm::vec3(0.00f, 0.45f, 0.80f));
+    stops.push_back(glm::vec3(0.20f, 0.85f, 0.90f));
+    stops.push_back(glm::vec3(1.00f, 1.00f, 1.00f));
+    return buildColorLut(stops);
+}
+
+// signed fields such as vorticity: negative is blue, 0 is white at entry COLOR_LUT_SIZE / 2, positive is red
+inline std::vector<glm::u8vec4> divergingColorLut() {
+    std::vector<glm::vec3> stops;
+    stops.push_back(glm::vec3(0.02f, 0.19f, 0.38f));
+    stops.push_back(glm::vec3(0.40f, 0.66f, 0.81f));
+    stops.push_back(glm::vec3(0.97f, 0.97f, 0.97f));
+    stops.push_back(glm::vec3(0.94f, 0.54f, 0.38f));
+    stops.push_back(glm::vec3(0.40f, 0.00f, 0.12f));
+    return buildColorLut(stops);
+}
+
+#endif
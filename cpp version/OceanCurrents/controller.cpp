@@ -3,6 +3,8 @@
  * uthor: alei  mailto:rayingecho@hotmail.com
  */
 #include <glfw3.h>
+#include <math.h>
+#include <algorithm>
 
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
@@ -12,6 +14,9 @@ using namespace glm;
 
 Controller* Controller::_instance = nullptr;
 
+// vertical field of view of the projection
+static const float FIELD_OF_VIEW = 30.0f;
+
 Controller::Controller() {
     // initial camera postion
     _position = glm::vec3(0.0f, 0.0f, 3.0f);
@@ -19,7 +24,7 @@ Controller::Controller() {
     _verticalAngle = 0.0f;
     _horizontalAngle = 3.14f;
     //_projectionMatrix = glm::ortho(-1.0f, 1.0f, -1.0f, 1.0f, 0.01f, 100.0f);
-    _projectionMatrix = glm::perspective(glm::radians(30.0f), 3.0f / 3.0f, 0.1f, 100.0f);
+    _projectionMatrix = glm::perspective(glm::radians(FIELD_OF_VIEW), 3.0f / 3.0f, 0.1f, 100.0f);
     _direction = glm::vec3(
         cos(_verticalAngle) * sin(_horizontalAngle),
         sin(_verticalAngle),
@@ -36,6 +41,8 @@ Controller::Controller() {
     _pressFlag = false;
     _lastCusorPos = glm::vec2(1200.0f / 2.0f, 1200.0f / 2.0f);
     _rightPressFlag = false;
+    _changed = true;
+    updateLod();
 }
 
 Controller * Controller::init() {
@@ -53,6 +60,27 @@ void Controller::OnScroll(GLFWwindow *window, double xoffset, double yoffset) {
     double mDistance = _instance->_position.z - yoffset / 10;
     _instance->_position = glm::vec3(_instance->_position.x, _instance->_position.y, mDistance);
     _instance->_viewMatrix = glm::lookAt(_instance->_position, _instance->_position + _instance->_direction, _instance->_up);
+    _instance->_changed = true;
+    _instance->updateLod();
+}
+
+/**
+ * every halving of the distance to the unit globe surface doubles the screen size of a triangle edge, so one more
+ * subdivision keeps it constant. the initial distance of 2 uses subdivision 4.
+ */
+void Controller::updateLod() {
+    float surfaceDistance = std::max(glm::length(_position) - 1.0f, 0.01f);
+    int lod = int(floor(4.0f + log2f(2.0f / surfaceDistance) + 0.5f));
+    _lod = std::min(std::max(lod, MIN_LOD), MAX_LOD);
+}
+
+/**
+ * the globe is seen under the angle asin(1 / distance) from its center, larger than the viewport when the camera gets
+ * close to it.
+ */
+float Controller::getGlobeScreenSize(int viewportHeight) const {
+    float distance = std::max(glm::length(_position), 1.01f);
+    return tanf(asinf(1.0f / distance)) / tanf(glm::radians(FIELD_OF_VIEW) / 2.0f) * viewportHeight;
 }
 
 /**
@@ -85,6 +113,7 @@ void Controller::refreshMatrices(GLFWwindow *window) {
         glm::vec3 axis(0.0f, 1.0f, 0.0f);
         if (abs(xDelta) > 1.0) {
             _modelMatrix = glm::rotate(_modelMatrix, xDelta / 100, axis);
+            _changed = true;
         }
     }
     if(_rightPressFlag) {
@@ -92,6 +121,7 @@ void Controller::refreshMatrices(GLFWwindow *window) {
         glm::vec3 axis(1.0f, 0.0f, 0.0f);
         if (abs(yDelta) > 1.0) {
             _modelMatrix = glm::rotate(_modelMatrix, yDelta / 100, axis);
+            _changed = true;
         }
     }
     _lastCusorPos = glm::vec2(xPos, yPos);
@@ -109,3 +139,14 @@ glm::mat4 Controller::getProjectionMatrix() const {
     return _projectionMatrix;
 }
 
+void Controller::setAspectRatio(float aspectRatio) {
+    _projectionMatrix = glm::perspective(glm::radians(FIELD_OF_VIEW), aspectRatio, 0.1f, 100.0f);
+    _changed = true;
+}
+
+bool Controller::consumeChanges() {
+    bool changed = _changed;
+    _changed = false;
+    return changed;
+}
+
@@ -7,6 +7,10 @@
 
 class Controller {
 public:
+    // range of the globe level of detail, as icosphere subdivisions
+    static const int MIN_LOD = 2;
+    static const int MAX_LOD = 7;
+
     static Controller* init();
 
     /**
@@ -33,6 +37,18 @@ public:
 
     glm::mat4 getProjectionMatrix() const;
 
+    // width / height of the viewport, 1 by default
+    void setAspectRatio(float aspectRatio);
+
+    // globe level of detail for the current camera distance, in [MIN_LOD, MAX_LOD]
+    int getLod() const { return _lod; }
+
+    // diameter of the unit globe on a viewport of the given height in pixels, as if the globe were in the middle
+    float getGlobeScreenSize(int viewportHeight) const;
+
+    // true if any matrix changed since the last call, so per-frame constants are only rebuilt when needed
+    bool consumeChanges();
+
 private:
     /**
      * this constructor init all contorll related matrix and variables, include:
@@ -67,6 +83,14 @@ private:
 
     bool _rightPressFlag;
 
+    // a matrix changed since the last consumeChanges
+    bool _changed;
+
+    int _lod;
+
+    // pick the level of detail from the distance between the camera and the globe surface
+    void updateLod();
+
     float _horizontalAngle;
 
     float _verticalAngle;
@@ -0,0 +1,399 @@
+/* fields derived from the currents by finite differences on the sphere: speed, vorticity, divergence and
+ * Okubo-Weiss
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "derivedFields.hpp"
+#include <math.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+#include "jobSystem.hpp"
+#include "validMask.hpp"
+
+// the grid as the stencils see it
+struct StencilGrid {
+    int latNum;
+    int lonNum;
+    // degrees
+    double latStart;
+    double latInterval;
+    double lonInterval;
+    // the grid covers all longitudes, so its columns wrap around
+    bool wrap;
+};
+
+// the outputs of a pass, null for the fields not asked for
+struct StencilOutput {
+    float* speed;
+    float* vorticity;
+    float* divergence;
+    float* okuboWeiss;
+};
+
+// what the cells of a row share
+struct RowGeometry {
+    // 1 / (R cos(latitude) dlongitude), turns a difference per column into one per meter eastward
+    float xScale;
+    // 1 / (R dlatitude), the same northward, negative if the rows go south
+    float yScale;
+    // tan(latitude) / R, the metric terms of the sphere
+    float metric;
+    // cos(latitude) is 0, the cells have no derivatives
+    bool pole;
+};
+
+static RowGeometry rowGeometry(const StencilGrid& grid, int m) {
+    double latitude = (grid.latStart + m * grid.latInterval) * M_PI / 180.0;
+    double cosLatitude = cos(latitude);
+    RowGeometry geometry;
+    geometry.pole = cosLatitude < MIN_COS_LATITUDE;
+    geometry.xScale = geometry.pole ? 0.0f : float(1.0 / (EARTH_RADIUS * cosLatitude *
+                                                          (grid.lonInterval * M_PI / 180.0)));
+    geometry.yScale = float(1.0 / (EARTH_RADIUS * (grid.latInterval * M_PI / 180.0)));
+    geometry.metric = geometry.pole ? 0.0f : float(tan(latitude) / EARTH_RADIUS);
+    return geometry;
+}
+
+/**
+ * @brief the derivatives of a cell from its differences per meter.
+ *
+ * on the sphere, with x eastward and y northward:
+ * vorticity = dv/dx - du/dy + u tan(latitude) / R
+ * divergence = du/dx + dv/dy - v tan(latitude) / R
+ * normal strain = du/dx - dv/dy - v tan(latitude) / R
+ * shear strain = dv/dx + du/dy + u tan(latitude) / R
+ * Okubo-Weiss = normal strain^2 + shear strain^2 - vorticity^2
+ */
+template <int FIELDS>
+static inline void writeDerivatives(const StencilOutput& out, size_t i, float u, float v, float ux, float uy, float vx,
+                                    float vy, float metric) {
+    float vorticity = vx - uy + u * metric;
+    if (FIELDS & DERIVED_VORTICITY) {
+        out.vorticity[i] = vorticity;
+    }
+    if (FIELDS & DERIVED_DIVERGENCE) {
+        out.divergence[i] = ux + vy - v * metric;
+    }
+    if (FIELDS & DERIVED_OKUBO_WEISS) {
+        float normal = ux - vy - v * metric;
+        float shear = vx + uy + u * metric;
+        out.okuboWeiss[i] = normal * normal + shear * shear - vorticity * vorticity;
+    }
+}
+
+template <int FIELDS>
+static inline void writeFill(const StencilOutput& out, size_t i) {
+    if (FIELDS & DERIVED_VORTICITY) {
+        out.vorticity[i] = DERIVED_FILL_VALUE;
+    }
+    if (FIELDS & DERIVED_DIVERGENCE) {
+        out.divergence[i] = DERIVED_FILL_VALUE;
+    }
+    if (FIELDS & DERIVED_OKUBO_WEISS) {
+        out.okuboWeiss[i] = DERIVED_FILL_VALUE;
+    }
+}
+
+/**
+ * @brief difference of u and v between the neighbours a and b of cell c, per step from a to b.
+ *
+ * central if both are in the grid with data, one-sided if only one is, false if none.
+ */
+static inline bool difference(const float* u, const float* v, size_t c, size_t a, bool hasA, size_t b, bool hasB,
+                              float& du, float& dv) {
+    if (hasA && hasB) {
+        du = (u[b] - u[a]) * 0.5f;
+        dv = (v[b] - v[a]) * 0.5f;
+    } else if (hasB) {
+        du = u[b] - u[c];
+        dv = v[b] - v[c];
+    } else if (hasA) {
+        du = u[c] - u[a];
+        dv = v[c] - v[a];
+    } else {
+        return false;
+    }
+    return true;
+}
+
+// any cell of row m, masked neighbours, grid edges and wrapping included. row m of the level is maskRow + m of mask
+template <int FIELDS>
+static void maskedCell(const StencilGrid& grid, const ValidMask& mask, int maskRow, const float* u, const float* v,
+                       int m, int n, const RowGeometry& geometry, const StencilOutput& out) {
+    size_t c = size_t(m) * grid.lonNum + n;
+    float uc = u[c];
+    float vc = v[c];
+    int cell = maskRow + m;
+    bool valid = mask.isValid(cell, n);
+    if (FIELDS & DERIVED_SPEED) {
+        out.speed[c] = valid ? sqrtf(uc * uc + vc * vc) : DERIVED_FILL_VALUE;
+    }
+    if (!(FIELDS & ~DERIVED_SPEED)) {
+        return;
+    }
+    int left = n - 1;
+    int right = n + 1;
+    if (grid.wrap) {
+        left = (left + grid.lonNum) % grid.lonNum;
+        right %= grid.lonNum;
+    }
+    size_t row = size_t(m) * grid.lonNum;
+    bool hasLeft = left >= 0 && left != n && mask.isValid(cell, left);
+    bool hasRight = right < grid.lonNum && right != n && mask.isValid(cell, right);
+    bool hasSouth = m > 0 && mask.isValid(cell - 1, n);
+    bool hasNorth = m + 1 < grid.latNum && mask.isValid(cell + 1, n);
+    float ux, vx, uy, vy;
+    if (!valid || geometry.pole || !difference(u, v, c, row + left, hasLeft, row + right, hasRight, ux, vx) ||
+        !difference(u, v, c, c - grid.lonNum, hasSouth, c + grid.lonNum, hasNorth, uy, vy)) {
+        writeFill<FIELDS>(out, c);
+        return;
+    }
+    writeDerivatives<FIELDS>(out, c, uc, vc, ux * geometry.xScale, uy * geometry.yScale, vx * geometry.xScale,
+                             vy * geometry.yScale, geometry.metric);
+}
+
+/**
+ * @brief row m of a level whose first row is maskRow of mask.
+ *
+ * when the row and the rows it reads have no masked cell, the inner columns take a loop without branches the
+ * compiler can vectorize, the edge columns and the other rows go cell by cell.
+ */
+template <int FIELDS>
+static void stencilRow(const StencilGrid& grid, const ValidMask& mask, int maskRow, const float* u, const float* v,
+                       int m, const StencilOutput& out) {
+    RowGeometry geometry = rowGeometry(grid, m);
+    int south = std::max(m - 1, 0);
+    int north = std::min(m + 1, grid.latNum - 1);
+    bool clean = !geometry.pole && north != south && grid.lonNum > 2 && mask.isRowFull(maskRow + m) &&
+                 mask.isRowFull(maskRow + south) && mask.isRowFull(maskRow + north);
+    if (!clean) {
+        for (auto n = 0; n < grid.lonNum; n++) {
+            maskedCell<FIELDS>(grid, mask, maskRow, u, v, m, n, geometry, out);
+        }
+        return;
+    }
+    size_t row = size_t(m) * grid.lonNum;
+    const float* uRow = u + row;
+    const float* vRow = v + row;
+    const float* uSouth = u + size_t(south) * grid.lonNum;
+    const float* vSouth = v + size_t(south) * grid.lonNum;
+    const float* uNorth = u + size_t(north) * grid.lonNum;
+    const float* vNorth = v + size_t(north) * grid.lonNum;
+    float xScale = geometry.xScale * 0.5f;
+    // one-sided on the first and the last row
+    float yScale = geometry.yScale / (north - south);
+    float metric = geometry.metric;
+    if (FIELDS & DERIVED_SPEED) {
+        // apart, sqrtf may set errno and keeps the other loop from being vectorized unless math errno is off
+        for (auto n = 1; n < grid.lonNum - 1; n++) {
+            out.speed[row + n] = sqrtf(uRow[n] * uRow[n] + vRow[n] * vRow[n]);
+        }
+    }
+    if (FIELDS & ~DERIVED_SPEED) {
+        for (auto n = 1; n < grid.lonNum - 1; n++) {
+            writeDerivatives<FIELDS>(out, row + n, uRow[n], vRow[n], (uRow[n + 1] - uRow[n - 1]) * xScale,
+                                     (uNorth[n] - uSouth[n]) * yScale, (vRow[n + 1] - vRow[n - 1]) * xScale,
+                                     (vNorth[n] - vSouth[n]) * yScale, metric);
+        }
+    }
+    maskedCell<FIELDS>(grid, mask, maskRow, u, v, m, 0, geometry, out);
+    maskedCell<FIELDS>(grid, mask, maskRow, u, v, m, grid.lonNum - 1, geometry, out);
+}
+
+typedef void (*StencilRowFn)(const StencilGrid&, const ValidMask&, int, const float*, const float*, int,
+                             const StencilOutput&);
+
+// one instance per combination of fields, the fields not asked for cost nothing
+static const StencilRowFn STENCIL_ROWS[DERIVED_ALL + 1] = {
+    stencilRow<0>, stencilRow<1>, stencilRow<2>, stencilRow<3>, stencilRow<4>, stencilRow<5>, stencilRow<6>,
+    stencilRow<7>, stencilRow<8>, stencilRow<9>, stencilRow<10>, stencilRow<11>, stencilRow<12>, stencilRow<13>,
+    stencilRow<14>, stencilRow<15>
+};
+
+/**
+ * @brief run the stencils over levelNum levels of latNum x lonNum cells, one after the other in u, v, their mask and
+ *        the outputs.
+ *
+ * the rows of all the levels are split over the workers. ranges, when not null, gets the min and max of the valid
+ * cells of every output in the order of StencilOutput.
+ */
+static void runStencils(const StencilGrid& grid, int levelNum, const float* u, const float* v, const ValidMask& mask,
+                        int fields, const StencilOutput& out, float* ranges) {
+    size_t levelCells = size_t(grid.latNum) * grid.lonNum;
+    int rowNum = levelNum * grid.latNum;
+    StencilRowFn stencil = STENCIL_ROWS[fields & DERIVED_ALL];
+    float* outputs[4] = {out.speed, out.vorticity, out.divergence, out.okuboWeiss};
+    if (ranges != nullptr) {
+        for (auto i = 0; i < 4; i++) {
+            ranges[2 * i] = DERIVED_FILL_VALUE;
+            ranges[2 * i + 1] = -DERIVED_FILL_VALUE;
+        }
+    }
+    std::mutex rangeMutex;
+
+    JobSystem::init().parallelFor(0, rowNum, JobSystem::rowGrain(grid.lonNum), [&](int first, int last) {
+        for (auto r = first; r < last; r++) {
+            int level = r / grid.latNum;
+            size_t offset = level * levelCells;
+            StencilOutput levelOut = out;
+            for (float** output : {&levelOut.speed, &levelOut.vorticity, &levelOut.divergence, &levelOut.okuboWeiss}) {
+                if (*output != nullptr) {
+                    *output += offset;
+                }
+            }
+            stencil(grid, mask, level * grid.latNum, u + offset, v + offset, r % grid.latNum, levelOut);
+        }
+        if (ranges == nullptr) {
+            return;
+        }
+        // the rows are still in cache
+        float pieceRanges[8];
+        size_t begin = size_t(first) * grid.lonNum;
+        size_t end = size_t(last) * grid.lonNum;
+        for (auto i = 0; i < 4; i++) {
+            float minVal = DERIVED_FILL_VALUE;
+            float maxVal = -DERIVED_FILL_VALUE;
+            if (outputs[i] != nullptr) {
+                for (size_t c = begin; c < end; c++) {
+                    float value = outputs[i][c];
+                    if (value != DERIVED_FILL_VALUE) {
+                        minVal = std::min(minVal, value);
+                        maxVal = std::max(maxVal, value);
+                    }
+                }
+            }
+            pieceRanges[2 * i] = minVal;
+            pieceRanges[2 * i + 1] = maxVal;
+        }
+        std::lock_guard<std::mutex> lock(rangeMutex);
+        for (auto i = 0; i < 4; i++) {
+            ranges[2 * i] = std::min(ranges[2 * i], pieceRanges[2 * i]);
+            ranges[2 * i + 1] = std::max(ranges[2 * i + 1], pieceRanges[2 * i + 1]);
+        }
+    });
+}
+
+static bool wrapsAround(double lonInterval, int lonNum) {
+    return fabs(lonInterval) * lonNum >= 360.0 - 1e-6;
+}
+
+// an empty field on the grid of like, or no data if it was not asked for
+static float* prepareOutput(const GeoArray<float>& like, bool wanted, GeoArray<float>& output) {
+    output = GeoArray<float>();
+    if (!wanted) {
+        return nullptr;
+    }
+    output.longitude_start_ = like.longitude_start_;
+    output.longitude_end_ = like.longitude_end_;
+    output.latitude_start_ = like.latitude_start_;
+    output.latitude_end_ = like.latitude_end_;
+    output.longitude_interval_ = like.longitude_interval_;
+    output.latitude_interval_ = like.latitude_interval_;
+    output.latitude_num_ = like.latitude_num_;
+    output.longitude_num_ = like.longitude_num_;
+    output.has_invalid_value_ = true;
+    output.invalid_value_ = DERIVED_FILL_VALUE;
+    output.status_ = GeoArray<float>::ARRAY_STATUS_SUCCEED;
+    output.array_p_ = new float[size_t(like.latitude_num_) * like.longitude_num_];
+    return output.array_p_;
+}
+
+static float* prepareOutput(const GeoVolume<float>& like, bool wanted, GeoVolume<float>& output) {
+    output = GeoVolume<float>();
+    if (!wanted) {
+        return nullptr;
+    }
+    output.longitudeStart_ = like.longitudeStart_;
+    output.longitudeStep_ = like.longitudeStep_;
+    output.longitudeNum_ = like.longitudeNum_;
+    output.latitudeStart_ = like.latitudeStart_;
+    output.latitudeStep_ = like.latitudeStep_;
+    output.latitudeNum_ = like.latitudeNum_;
+    output.heightOfLevels_ = like.heightOfLevels_;
+    output.timeStr_ = like.timeStr_;
+    output.volData_.resize(like.volData_.size());
+    return output.volData_.data();
+}
+
+bool computeDerivedFields(const GeoArray<float>& u, const GeoArray<float>& v, int fields, DerivedFields& result) {
+    if (!isSameGeoInfo(u, v) || u.getStatus() != GeoArray<float>::ARRAY_STATUS_SUCCEED ||
+        v.getStatus() != GeoArray<float>::ARRAY_STATUS_SUCCEED || u.latitude_num_ <= 0 || u.longitude_num_ <= 0) {
+        return false;
+    }
+    StencilGrid grid;
+    grid.latNum = u.latitude_num_;
+    grid.lonNum = u.longitude_num_;
+    grid.latStart = u.latitude_start_;
+    grid.latInterval = u.latitude_interval_;
+    grid.lonInterval = u.longitude_interval_;
+    grid.wrap = wrapsAround(u.longitude_interval_, u.longitude_num_);
+
+    StencilOutput out;
+    out.speed = prepareOutput(u, (fields & DERIVED_SPEED) != 0, result.speed);
+    out.vorticity = prepareOutput(u, (fields & DERIVED_VORTICITY) != 0, result.vorticity);
+    out.divergence = prepareOutput(u, (fields & DERIVED_DIVERGENCE) != 0, result.divergence);
+    out.okuboWeiss = prepareOutput(u, (fields & DERIVED_OKUBO_WEISS) != 0, result.okuboWeiss);
+    float ranges[8];
+    runStencils(grid, 1, u.array_p_, v.array_p_, ValidMask(u, v), fields, out, ranges);
+
+    GeoArray<float>* outputs[4] = {&result.speed, &result.vorticity, &result.divergence, &result.okuboWeiss};
+    for (auto i = 0; i < 4; i++) {
+        // all masked gives min > max, report 0 as for an empty field
+        bool empty = ranges[2 * i] > ranges[2 * i + 1];
+        outputs[i]->minVal_ = empty ? 0.0f : ranges[2 * i];
+        outputs[i]->maxVal_ = empty ? 0.0f : ranges[2 * i + 1];
+    }
+    return true;
+}
+
+bool computeDerivedFields(const GeoVolume<float>& u, const GeoVolume<float>& v, int fields, DerivedVolumes& result) {
+    size_t levelCells = size_t(u.latitudeNum_) * u.longitudeNum_;
+    if (!isSameGeoInfo(u, v) || levelCells == 0 || u.volData_.size() != v.volData_.size() ||
+        u.volData_.size() % levelCells != 0) {
+        return false;
+    }
+    StencilGrid grid;
+    grid.latNum = u.latitudeNum_;
+    grid.lonNum = u.longitudeNum_;
+    grid.latStart = u.latitudeStart_;
+    grid.latInterval = u.latitudeStep_;
+    grid.lonInterval = u.longitudeStep_;
+    grid.wrap = wrapsAround(u.longitudeStep_, u.longitudeNum_);
+
+    StencilOutput out;
+    out.speed = prepareOutput(u, (fields & DERIVED_SPEED) != 0, result.speed);
+    out.vorticity = prepareOutput(u, (fields & DERIVED_VORTICITY) != 0, result.vorticity);
+    out.divergence = prepareOutput(u, (fields & DERIVED_DIVERGENCE) != 0, result.divergence);
+    out.okuboWeiss = prepareOutput(u, (fields & DERIVED_OKUBO_WEISS) != 0, result.okuboWeiss);
+    // the levels one after another, the volumes mark the cells without data with NaN only
+    int levelNum = int(u.volData_.size() / levelCells);
+    ValidMask mask(levelNum * grid.latNum, grid.lonNum, u.volData_.data(), v.volData_.data());
+    runStencils(grid, levelNum, u.volData_.data(), v.volData_.data(), mask, fields, out, nullptr);
+    return true;
+}
+
+float getDerivedRange(const GeoArray<float>& field, float share) {
+    size_t count = size_t(field.latitude_num_) * field.longitude_num_;
+    if (field.array_p_ == nullptr || count == 0) {
+        return 0.0f;
+    }
+    // a regular sample is plenty for a color scale
+    size_t stride = std::max<size_t>(1, count / 65536);
+    std::vector<float> magnitudes;
+    magnitudes.reserve(count / stride + 1);
+    for (size_t i = 0; i < count; i += stride) {
+        float value = field.array_p_[i];
+        if (field.isValidValue(value)) {
+            magnitudes.push_back(fabsf(value));
+        }
+    }
+    if (magnitudes.empty()) {
+        return 0.0f;
+    }
+    size_t nth = std::min(magnitudes.size() - 1, size_t(share * (magnitudes.size() - 1) + 0.5f));
+    std::nth_element(magnitudes.begin(), magnitudes.begin() + nth, magnitudes.end());
+    return magnitudes[nth];
+}
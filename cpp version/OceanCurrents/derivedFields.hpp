@@ -0,0 +1,75 @@
+/* fields derived from the currents by finite differences on the sphere: speed, vorticity, divergence and
+ * Okubo-Weiss
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef DERIVED_FIELDS_HPP
+#define DERIVED_FIELDS_HPP
+
+#include "GeoArray.h"
+#include "GeoVolume.h"
+
+// the fields to derive, any combination of them comes out of the same pass
+enum DerivedFieldFlags {
+    DERIVED_SPEED = 1 << 0,
+    DERIVED_VORTICITY = 1 << 1,
+    DERIVED_DIVERGENCE = 1 << 2,
+    DERIVED_OKUBO_WEISS = 1 << 3,
+    DERIVED_ALL = DERIVED_SPEED | DERIVED_VORTICITY | DERIVED_DIVERGENCE | DERIVED_OKUBO_WEISS
+};
+
+// value of the cells without a result, the default fill value of netCDF floats
+const float DERIVED_FILL_VALUE = 9.96921e36f;
+
+// mean radius of the earth in meters, the derivatives are per meter, e.g. vorticity in 1/s for currents in m/s
+const double EARTH_RADIUS = 6371000.0;
+
+// cos(latitude) below it is a pole, the columns have no width there
+const double MIN_COS_LATITUDE = 1e-6;
+
+// the results of a pass, the fields not asked for keep no data
+struct DerivedFields {
+    GeoArray<float> speed;
+    GeoArray<float> vorticity;
+    GeoArray<float> divergence;
+    GeoArray<float> okuboWeiss;
+};
+
+struct DerivedVolumes {
+    GeoVolume<float> speed;
+    GeoVolume<float> vorticity;
+    GeoVolume<float> divergence;
+    GeoVolume<float> okuboWeiss;
+};
+
+/**
+ * @brief derive the given fields from the eastward and northward currents, in parallel on the workers of the
+ *        JobSystem.
+ *
+ * the derivatives are central differences in longitude and latitude with the metric terms of the sphere, so the
+ * results are right up to high latitudes and do not depend on the direction of the grid rows. a cell is masked if u
+ * or v is NaN or the invalid value of its array; a difference falls back to one side next to a masked cell or the
+ * edge of the grid, and the cell gets DERIVED_FILL_VALUE when neither side is left. the longitude wraps around when
+ * the grid covers the whole globe. the cells on a pole have only speed.
+ *
+ * vorticity and divergence are the curl and the divergence of the flow, Okubo-Weiss is the squared strain minus the
+ * squared vorticity: negative in eddies, positive where the flow is stretched.
+ *
+ * @param fields DerivedFieldFlags
+ * @return false if u and v do not share the grid or were not read
+ */
+bool computeDerivedFields(const GeoArray<float>& u, const GeoArray<float>& v, int fields, DerivedFields& result);
+
+/**
+ * @brief the same on every level of a volume, a cell is masked if u or v is NaN.
+ */
+bool computeDerivedFields(const GeoVolume<float>& u, const GeoVolume<float>& v, int fields, DerivedVolumes& result);
+
+/**
+ * @brief the magnitude that covers the given share of the valid cells, e.g. to scale a diverging color map without
+ *        letting a few extreme cells next to the coast wash out the rest.
+ */
+float getDerivedRange(const GeoArray<float>& field, float share = 0.99f);
+
+#endif
@@ -0,0 +1,103 @@
+/* multiresolution pyramid of the currents, for the level of detail of the integration and the rendering
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "fieldPyramid.hpp"
+#include <math.h>
+#include <algorithm>
+#include <limits>
+
+#include "jobSystem.hpp"
+
+FieldPyramid::FieldPyramid(const GeoArray<float>& u, const GeoArray<float>& v) {
+    assert(isSameGeoInfo(u, v));
+    int levelNum = 1;
+    for (auto cells = std::min(u.latitude_num_, u.longitude_num_); (cells + 1) / 2 >= MIN_LEVEL_CELLS;
+         cells = (cells + 1) / 2) {
+        levelNum++;
+    }
+    // no reallocation, a level is only read while the next one is built
+    _u.reserve(levelNum);
+    _v.reserve(levelNum);
+    _masks.reserve(levelNum);
+    _u.push_back(u);
+    _v.push_back(v);
+    _masks.push_back(ValidMask(u, v));
+    while (getLevelNum() < levelNum) {
+        buildLevel();
+    }
+}
+
+int FieldPyramid::selectLevel(float cellsPerSample) const {
+    if (!(cellsPerSample > 1.0f)) {
+        return 0;
+    }
+    return std::min(int(floor(log2f(cellsPerSample))), getLevelNum() - 1);
+}
+
+static void prepareLevel(const GeoArray<float>& fine, GeoArray<float>& coarse) {
+    // the center of a coarse cell is between the centers of the two first cells under it
+    coarse.latitude_interval_ = fine.latitude_interval_ * 2;
+    coarse.longitude_interval_ = fine.longitude_interval_ * 2;
+    coarse.latitude_num_ = (fine.latitude_num_ + 1) / 2;
+    coarse.longitude_num_ = (fine.longitude_num_ + 1) / 2;
+    coarse.latitude_start_ = fine.latitude_start_ + fine.latitude_interval_ / 2;
+    coarse.longitude_start_ = fine.longitude_start_ + fine.longitude_interval_ / 2;
+    coarse.latitude_end_ = coarse.latitude_start_ + coarse.latitude_interval_ * (coarse.latitude_num_ - 1);
+    coarse.longitude_end_ = coarse.longitude_start_ + coarse.longitude_interval_ * (coarse.longitude_num_ - 1);
+    // the means stay within the range of the level below
+    coarse.maxVal_ = fine.maxVal_;
+    coarse.minVal_ = fine.minVal_;
+    coarse.has_invalid_value_ = fine.has_invalid_value_;
+    coarse.invalid_value_ = fine.invalid_value_;
+    coarse.status_ = fine.status_;
+    coarse.file_full_path_ = fine.file_full_path_;
+    coarse.array_p_ = new float[size_t(coarse.latitude_num_) * coarse.longitude_num_];
+}
+
+void FieldPyramid::buildLevel() {
+    const GeoArray<float>& fineU = _u.back();
+    const GeoArray<float>& fineV = _v.back();
+    const ValidMask& fineMask = _masks.back();
+    GeoArray<float> coarseU, coarseV;
+    prepareLevel(fineU, coarseU);
+    prepareLevel(fineV, coarseV);
+
+    int fineRows = fineU.latitude_num_;
+    int fineColumns = fineU.longitude_num_;
+    int columns = coarseU.longitude_num_;
+    float emptyU = fineU.has_invalid_value_ ? fineU.invalid_value_ : std::numeric_limits<float>::quiet_NaN();
+    float emptyV = fineV.has_invalid_value_ ? fineV.invalid_value_ : std::numeric_limits<float>::quiet_NaN();
+    const float* fu = fineU.array_p_;
+    const float* fv = fineV.array_p_;
+    float* cu = coarseU.array_p_;
+    float* cv = coarseV.array_p_;
+
+    JobSystem::init().parallelFor(0, coarseU.latitude_num_, JobSystem::rowGrain(columns), [&](int first, int last) {
+        for (auto m = first; m < last; m++) {
+            int rowEnd = std::min(2 * m + 2, fineRows);
+            for (auto n = 0; n < columns; n++) {
+                int columnEnd = std::min(2 * n + 2, fineColumns);
+                float sumU = 0.0f;
+                float sumV = 0.0f;
+                int count = 0;
+                for (auto i = 2 * m; i < rowEnd; i++) {
+                    for (auto j = 2 * n; j < columnEnd; j++) {
+                        if (fineMask.isValid(i, j)) {
+                            sumU += fu[size_t(i) * fineColumns + j];
+                            sumV += fv[size_t(i) * fineColumns + j];
+                            count++;
+                        }
+                    }
+                }
+                size_t index = size_t(m) * columns + n;
+                cu[index] = count > 0 ? sumU / count : emptyU;
+                cv[index] = count > 0 ? sumV / count : emptyV;
+            }
+        }
+    });
+    _masks.push_back(ValidMask(coarseU, coarseV));
+    _u.push_back(std::move(coarseU));
+    _v.push_back(std::move(coarseV));
+}
@@ -0,0 +1,60 @@
+/* multiresolution pyramid of the currents, for the level of detail of the integration and the rendering
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef FIELD_PYRAMID_HPP
+#define FIELD_PYRAMID_HPP
+
+#include <vector>
+
+#include "GeoArray.h"
+#include "validMask.hpp"
+
+/**
+ * @brief the currents at every power of two resolution, level 0 is the grid read from the file.
+ *
+ * a cell of a level is the mean of the 2x2 cells of the level below it that have data, land and cells without data
+ * are left out instead of pulling the currents next to the coast towards 0. a cell with no valid cell under it gets
+ * the invalid value of the grid, or NaN if the grid has none. the last row or column of an odd grid has a single
+ * cell under it. every level keeps the mask of its cells with data, a level is averaged through the mask of the
+ * level below and the fields sampling a level share its mask.
+ *
+ * the levels are built one after the other, the rows of a level in parallel on the workers of the JobSystem.
+ */
+class FieldPyramid {
+public:
+    // cells along the shorter side of the grid under which no coarser level is built
+    static const int MIN_LEVEL_CELLS = 8;
+
+    /**
+     * @param u eastward component of the currents
+     * @param v northward component, must share the geo info with u
+     */
+    FieldPyramid(const GeoArray<float>& u, const GeoArray<float>& v);
+
+    int getLevelNum() const { return int(_u.size()); }
+
+    const GeoArray<float>& getU(int level) const { return _u[level]; }
+
+    const GeoArray<float>& getV(int level) const { return _v[level]; }
+
+    const ValidMask& getMask(int level) const { return _masks[level]; }
+
+    /**
+     * @brief the coarsest level whose cells are not larger than a sample.
+     *
+     * @param cellsPerSample cells of level 0 along an axis between two samples, e.g. two pixels of a canvas
+     */
+    int selectLevel(float cellsPerSample) const;
+
+private:
+    std::vector<GeoArray<float>> _u;
+    std::vector<GeoArray<float>> _v;
+    std::vector<ValidMask> _masks;
+
+    // build the next level from the last one
+    void buildLevel();
+};
+
+#endif
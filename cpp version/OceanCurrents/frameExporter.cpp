@@ -0,0 +1,302 @@
+/**
+ * exports the rendered frames as a PNG sequence or a Y4M video, while the application keeps running.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "frameExporter.hpp"
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <stdexcept>
+
+#include "utils/imageWriter.hpp"
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+static bool endsWith(const std::string& text, const char* suffix) {
+    size_t length = strlen(suffix);
+    return text.size() >= length && text.compare(text.size() - length, length, suffix) == 0;
+}
+
+/**
+ * @brief split a PNG pattern around its frame number, the only conversion it may have is %d, %Nd or %0Nd.
+ *
+ * the pattern comes from the command line, so it is never handed to printf as a format.
+ */
+static void splitPattern(const std::string& pattern, std::string& prefix, std::string& suffix, int& digits,
+                         bool& zeroPad) {
+    std::string* part = &prefix;
+    bool found = false;
+    for (size_t i = 0; i < pattern.size(); i++) {
+        if (pattern[i] != '%') {
+            *part += pattern[i];
+            continue;
+        }
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%') {
+            *part += '%';
+            i++;
+            continue;
+        }
+        size_t end = i + 1;
+        zeroPad = end < pattern.size() && pattern[end] == '0';
+        digits = 0;
+        while (end < pattern.size() && pattern[end] >= '0' && pattern[end] <= '9') {
+            digits = std::min(digits * 10 + (pattern[end] - '0'), 100);
+            end++;
+        }
+        // a 64 bit frame number has at most 20 digits
+        if (found || digits > 20 || end >= pattern.size() || pattern[end] != 'd') {
+            throw std::runtime_error("FrameExporter - FrameExporter, the PNG pattern needs exactly one %d, %Nd or "
+                                     "%0Nd with N up to 20 and %% for a %: " + pattern);
+        }
+        found = true;
+        part = &suffix;
+        i = end;
+    }
+    if (!found) {
+        throw std::runtime_error("FrameExporter - FrameExporter, the PNG pattern has no %d for the frame number: " +
+                                 pattern);
+    }
+}
+
+/**
+ * @brief RGBA pixels, bottom row first, to the Y, U and V planes of a Y4M frame, top row first.
+ *
+ * full range BT.601 as JPEG, the chroma of every 2x2 block is the one of its average color.
+ */
+static void toYuv420(const unsigned char* pixels, int width, int height, unsigned char* planes) {
+    int chromaWidth = (width + 1) / 2;
+    int chromaHeight = (height + 1) / 2;
+    unsigned char* yPlane = planes;
+    unsigned char* uPlane = yPlane + size_t(width) * height;
+    unsigned char* vPlane = uPlane + size_t(chromaWidth) * chromaHeight;
+    size_t rowSize = size_t(width) * 4;
+    for (auto y = 0; y < height; y++) {
+        const unsigned char* row = pixels + rowSize * (height - 1 - y);
+        unsigned char* luma = yPlane + size_t(y) * width;
+        for (auto x = 0; x < width; x++, row += 4) {
+            luma[x] = (unsigned char)((19595 * row[0] + 38470 * row[1] + 7471 * row[2] + 32768) >> 16);
+        }
+    }
+    for (auto y = 0; y < chromaHeight; y++) {
+        // odd sizes repeat the last row and column
+        const unsigned char* top = pixels + rowSize * (height - 1 - 2 * y);
+        const unsigned char* bottom = 2 * y + 1 < height ? top - rowSize : top;
+        for (auto x = 0; x < chromaWidth; x++) {
+            size_t left = size_t(x) * 8;
+            size_t right = 2 * x + 1 < width ? left + 4 : left;
+            int r = top[left] + top[right] + bottom[left] + bottom[right];
+            int g = top[left + 1] + top[right + 1] + bottom[left + 1] + bottom[right + 1];
+            int b = top[left + 2] + top[right + 2] + bottom[left + 2] + bottom[right + 2];
+            // the sums are 4 times the average, hence the shift by 18 instead of 16. pure blue and red round up
+            // to 256
+            size_t i = size_t(y) * chromaWidth + x;
+            uPlane[i] = (unsigned char)std::min((-11059 * r - 21709 * g + 32768 * b + (128 << 18) + (1 << 17)) >> 18,
+                                                255);
+            vPlane[i] = (unsigned char)std::min((32768 * r - 27439 * g - 5329 * b + (128 << 18) + (1 << 17)) >> 18,
+                                                255);
+        }
+    }
+}
+
+FrameExporter::FrameExporter(const std::string& path, int width, int height, int frameRate, int threadNum)
+    : _path(path), _y4m(endsWith(path, ".y4m")), _frameDigits(0), _zeroPad(false), _width(width), _height(height),
+      _frameSize(size_t(width) * height * 4), _mapped(nullptr), _next(0), _jobs(SLOT_NUM), _video(nullptr),
+      _nextWrite(0), _frameNum(0), _written(0), _captureMs(0.0), _statFrames(0) {
+    if (!_y4m && _path.find('%') == std::string::npos) {
+        _path += "%05d.png";
+    }
+    if (!_y4m) {
+        splitPattern(_path, _namePrefix, _nameSuffix, _frameDigits, _zeroPad);
+    }
+    if (_y4m) {
+        _video = fopen(_path.c_str(), "wb");
+        if (_video == nullptr) {
+            throw std::runtime_error("FrameExporter - FrameExporter, cannot open " + _path);
+        }
+        // C420jpeg is the chroma siting of toYuv420, players assume limited range without XCOLORRANGE
+        fprintf(_video, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XCOLORRANGE=FULL\n", width, height, frameRate);
+    }
+    for (auto i = 0; i < SLOT_NUM; i++) {
+        _slots[i].fence = 0;
+        _slots[i].frame = 0;
+        _slots[i].repeat = 1;
+        _slots[i].busy = false;
+    }
+
+    GLint previousBuffer;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousBuffer);
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffer);
+    _persistent = GLEW_ARB_buffer_storage != 0;
+    if (_persistent) {
+        // the encoders read the slots straight from the mapping, cached client memory suits them best
+        GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_PACK_BUFFER, _frameSize * SLOT_NUM, nullptr, flags | GL_CLIENT_STORAGE_BIT);
+        _mapped = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, _frameSize * SLOT_NUM, flags);
+        if (_mapped == nullptr) {
+            throw std::runtime_error("FrameExporter - FrameExporter, cannot map the pixel buffer");
+        }
+    } else {
+        glBufferData(GL_PIXEL_PACK_BUFFER, _frameSize * SLOT_NUM, nullptr, GL_STREAM_READ);
+        for (auto i = 0; i < SLOT_NUM; i++) {
+            _slots[i].copy.resize(_frameSize);
+        }
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, previousBuffer);
+
+    if (threadNum <= 0) {
+        threadNum = std::max(1u, std::thread::hardware_concurrency());
+    }
+    for (auto i = 0; i < threadNum; i++) {
+        _workers.push_back(std::thread(&FrameExporter::encode, this));
+    }
+}
+
+FrameExporter::~FrameExporter() {
+    GLint previousBuffer;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffer);
+    dispatch(_pending.size());
+    _jobs.close();
+    for (auto& worker : _workers) {
+        worker.join();
+    }
+    if (_persistent) {
+        glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+    }
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, previousBuffer);
+    glDeleteBuffers(1, &_buffer);
+    if (_video != nullptr) {
+        fclose(_video);
+    }
+}
+
+void FrameExporter::capture(int repeat) {
+    auto start = std::chrono::steady_clock::now();
+    GLint previousBuffer;
+    glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &previousBuffer);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, _buffer);
+
+    // the slot of the oldest readback comes next in the ring, it has to be finished before it is reused
+    Slot& slot = _slots[_next];
+    dispatch(slot.fence != 0 ? 1 : 0);
+    {
+        std::unique_lock<std::mutex> lock(_slotMutex);
+        _slotReleased.wait(lock, [&slot]() { return !slot.busy; });
+        slot.busy = true;
+    }
+
+    // with a pixel pack buffer bound the last argument is an offset into it, the copy runs on the GPU
+    glReadPixels(0, 0, _width, _height, GL_RGBA, GL_UNSIGNED_BYTE, (void*)(_frameSize * _next));
+    slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    slot.frame = _frameNum;
+    slot.repeat = std::max(repeat, 1);
+    _frameNum += slot.repeat;
+    _pending.push_back(_next);
+    _next = (_next + 1) % SLOT_NUM;
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, previousBuffer);
+    _captureMs += elapsedMs(start);
+    _statFrames++;
+}
+
+void FrameExporter::resetStats() {
+    _captureMs = 0.0;
+    _statFrames = 0;
+}
+
+void FrameExporter::dispatch(size_t waitNum) {
+    size_t taken = 0;
+    for (; taken < _pending.size(); taken++) {
+        Slot& slot = _slots[_pending[taken]];
+        if (taken < waitNum) {
+            // flush on the first try, otherwise the fence may never be submitted and the wait never ends
+            GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+            while (glClientWaitSync(slot.fence, flags, 1000000) == GL_TIMEOUT_EXPIRED) {
+                flags = 0;
+            }
+        } else if (glClientWaitSync(slot.fence, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            // the readbacks finish in order, the later ones are not done either
+            break;
+        }
+        glDeleteSync(slot.fence);
+        slot.fence = 0;
+        if (!_persistent) {
+            size_t offset = _frameSize * _pending[taken];
+            const void* mapped = glMapBufferRange(GL_PIXEL_PACK_BUFFER, offset, _frameSize, GL_MAP_READ_BIT);
+            if (mapped == nullptr) {
+                throw std::runtime_error("FrameExporter - dispatch, cannot map the pixel buffer");
+            }
+            memcpy(slot.copy.data(), mapped, _frameSize);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        Job job = {_pending[taken], slot.frame, slot.repeat};
+        // never blocks, there are never more jobs than slots
+        _jobs.push(job);
+    }
+    _pending.erase(_pending.begin(), _pending.begin() + taken);
+}
+
+void FrameExporter::releaseSlot(int slot) {
+    std::lock_guard<std::mutex> lock(_slotMutex);
+    _slots[slot].busy = false;
+    _slotReleased.notify_all();
+}
+
+void FrameExporter::encode() {
+    std::vector<unsigned char> converted;
+    Job job;
+    while (_jobs.pop(job)) {
+        const unsigned char* pixels = _persistent ? _mapped + _frameSize * job.slot : _slots[job.slot].copy.data();
+        if (_y4m) {
+            static const char frameHeader[] = "FRAME\n";
+            size_t headerSize = sizeof(frameHeader) - 1;
+            size_t chromaSize = size_t((_width + 1) / 2) * ((_height + 1) / 2);
+            converted.resize(headerSize + size_t(_width) * _height + 2 * chromaSize);
+            memcpy(converted.data(), frameHeader, headerSize);
+            toYuv420(pixels, _width, _height, converted.data() + headerSize);
+            releaseSlot(job.slot);
+
+            // the frames are converted in any order but written in sequence, the turn is kept until the write
+            // is done so the other encoders only wait for their own turn, not for the lock
+            std::unique_lock<std::mutex> lock(_writeMutex);
+            _writeTurn.wait(lock, [this, &job]() { return _nextWrite == job.frame; });
+            lock.unlock();
+            for (auto i = 0; i < job.repeat; i++) {
+                if (fwrite(converted.data(), 1, converted.size(), _video) != converted.size()) {
+                    printf("[EXPORT] failed writing frame %llu to %s\n", (unsigned long long)(job.frame + i),
+                           _path.c_str());
+                } else {
+                    _written++;
+                }
+            }
+            lock.lock();
+            _nextWrite += job.repeat;
+            _writeTurn.notify_all();
+        } else {
+            // the alpha of the framebuffer is not meant to be seen
+            size_t pixelNum = size_t(_width) * _height;
+            converted.resize(pixelNum * 3);
+            for (size_t i = 0; i < pixelNum; i++) {
+                memcpy(&converted[i * 3], pixels + i * 4, 3);
+            }
+            releaseSlot(job.slot);
+
+            for (auto i = 0; i < job.repeat; i++) {
+                char number[32];
+                snprintf(number, sizeof(number), _zeroPad ? "%0*llu" : "%*llu", _frameDigits,
+                         (unsigned long long)(job.frame + i));
+                try {
+                    ImageWriter::writePng(_namePrefix + number + _nameSuffix, converted.data(), _width, _height, 3);
+                    _written++;
+                } catch (std::runtime_error& e) {
+                    printf("[EXPORT] %s\n", e.what());
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,141 @@
+/**
+ * exports the rendered frames as a PNG sequence or a Y4M video, while the application keeps running.
+ *
+ * glReadPixels into client memory waits for the GPU to finish the frame. the exporter reads into a ring of pixel
+ * pack buffers instead: the copy runs on the GPU, a fence per slot tells when it is done, and the slot is handed to
+ * a pool of worker threads that convert and write it. the render thread only queues commands and never touches the
+ * disk.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef FRAME_EXPORTER_HPP
+#define FRAME_EXPORTER_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include <GL/glew.h>
+
+#include "blockingQueue.hpp"
+
+class FrameExporter {
+public:
+    /**
+     * slots of the ring: frames being read back by the GPU and frames being encoded. capture only waits when all of
+     * them are taken, i.e. when the disk can not keep up
+     */
+    static const int SLOT_NUM = 6;
+
+    /**
+     * @brief open the output and start the encoders.
+     *
+     * a path ending with .y4m is a single YUV 4:2:0 video, written in frame order. any other path is a pattern of
+     * PNG files numbered from 0 with one %d, %Nd or %0Nd for the number and %% for a % (e.g. frames/globe_%05d.png),
+     * "%05d.png" is appended if it has no %. throws if the pattern has any other conversion.
+     *
+     * @param frameRate frames per second stored in the Y4M header
+     * @param threadNum encoder threads, 0 for one per hardware thread
+     */
+    FrameExporter(const std::string& path, int width, int height, int frameRate, int threadNum = 0);
+
+    // wait for the frames in flight, then stop the encoders and close the output
+    ~FrameExporter();
+
+    /**
+     * @brief queue the readback of the framebuffer bound for reading, bottom row first as every GL image.
+     *
+     * hands the readbacks the GPU finished meanwhile to the encoders. the pixel pack buffer binding is restored.
+     * call it after drawing and before swapping the buffers.
+     *
+     * @param repeat output frames the picture stands for, e.g. the simulation steps since the last capture, so the
+     *        output keeps its frame rate when frames were not drawn
+     */
+    void capture(int repeat = 1);
+
+    // output frames, the repeated ones included
+    uint64_t getFrameCount() const { return _frameNum; }
+
+    // frames written to disk so far
+    uint64_t getWrittenCount() const { return _written; }
+
+    // CPU milliseconds of capture, averaged since the last reset. more than a fraction of a millisecond means it
+    // waited for a free slot, the encoders or the disk are too slow
+    double getAverageCaptureMs() const { return _statFrames > 0 ? _captureMs / _statFrames : 0.0; }
+
+    void resetStats();
+
+private:
+    struct Slot {
+        GLsync fence;
+        // the first output frame of the picture and how many it fills
+        uint64_t frame;
+        int repeat;
+        // the GPU or an encoder still uses the slot
+        bool busy;
+        // the pixels, when the buffer can not stay mapped
+        std::vector<unsigned char> copy;
+    };
+
+    struct Job {
+        int slot;
+        uint64_t frame;
+        int repeat;
+    };
+
+    std::string _path;
+    bool _y4m;
+    // a PNG name is _namePrefix, the frame number padded to _frameDigits and _nameSuffix
+    std::string _namePrefix;
+    std::string _nameSuffix;
+    int _frameDigits;
+    bool _zeroPad;
+    int _width;
+    int _height;
+    size_t _frameSize;
+    bool _persistent;
+
+    GLuint _buffer;
+    const unsigned char* _mapped;
+    Slot _slots[SLOT_NUM];
+    // the slot of the next capture
+    int _next;
+    // frames read back, oldest first, by slot
+    std::vector<int> _pending;
+
+    std::mutex _slotMutex;
+    std::condition_variable _slotReleased;
+
+    BlockingQueue<Job> _jobs;
+    std::vector<std::thread> _workers;
+
+    // the Y4M file, written by one encoder at a time in frame order
+    FILE* _video;
+    std::mutex _writeMutex;
+    std::condition_variable _writeTurn;
+    uint64_t _nextWrite;
+
+    uint64_t _frameNum;
+    std::atomic<uint64_t> _written;
+    double _captureMs;
+    int _statFrames;
+
+    // hand the finished readbacks to the encoders, waiting for the GPU to finish the first waitNum of them
+    void dispatch(size_t waitNum);
+
+    // the body of the encoder threads
+    void encode();
+
+    void releaseSlot(int slot);
+
+    // forbid copying, the GL objects and the threads are owned
+    FrameExporter(const FrameExporter&);
+    FrameExporter& operator=(const FrameExporter&);
+};
+
+#endif
@@ -0,0 +1,322 @@
+/* finite-time Lyapunov exponents of the time dependent currents, whose ridges are the Lagrangian coherent
+ * structures
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "ftle.hpp"
+#include <math.h>
+#include <algorithm>
+
+#include "derivedFields.hpp"
+#include "jobSystem.hpp"
+#include "rk4.hpp"
+#include "validMask.hpp"
+
+// points integrated together, a multiple of the SIMD width
+static const int LANES = 8;
+
+// the axes of a PointBatch
+static const int ROW = 0;
+static const int COLUMN = 1;
+
+typedef LaneBatch<2, LANES> PointBatch;
+
+// the corners and weights of a point for the bilinear interpolation of a grid
+struct Bilinear {
+    size_t i00;
+    size_t i01;
+    size_t i10;
+    size_t i11;
+    float row;
+    float column;
+
+    // the value of the grid at the point, NaN if a corner is NaN
+    float operator()(const float* grid) const {
+        float south = grid[i00] + (grid[i01] - grid[i00]) * column;
+        float north = grid[i10] + (grid[i11] - grid[i10]) * column;
+        return south + (north - south) * row;
+    }
+};
+
+// the points out of a grid of rowNum x columnNum take its edge, the columns wrap around if wrap is set
+static inline Bilinear bilinear(int rowNum, int columnNum, bool wrap, float row, float column) {
+    row = std::min(std::max(row, 0.0f), float(rowNum - 1));
+    if (wrap) {
+        column -= floorf(column / columnNum) * columnNum;
+    } else {
+        column = std::min(std::max(column, 0.0f), float(columnNum - 1));
+    }
+    int row0 = std::min(int(row), std::max(rowNum - 2, 0));
+    int column0 = std::min(int(column), columnNum - 1);
+    int row1 = std::min(row0 + 1, rowNum - 1);
+    int column1 = column0 + 1 < columnNum ? column0 + 1 : (wrap ? 0 : column0);
+    Bilinear weights;
+    weights.i00 = size_t(row0) * columnNum + column0;
+    weights.i01 = size_t(row0) * columnNum + column1;
+    weights.i10 = size_t(row1) * columnNum + column0;
+    weights.i11 = size_t(row1) * columnNum + column1;
+    weights.row = row - row0;
+    weights.column = column - column0;
+    return weights;
+}
+
+FtleEngine::FtleEngine(const FtleParam& param)
+    : _param(param), _latNum(0), _lonNum(0), _wrap(false), _flowRows(0), _flowColumns(0), _hasPrevious(false),
+      _steps(0) {
+    _param.refinement = std::max(_param.refinement, 1);
+    _param.stepsPerInterval = std::max(_param.stepsPerInterval, 1);
+    _param.windowIntervals = std::max(_param.windowIntervals, 1);
+}
+
+void FtleEngine::convertSnapshot(const GeoArray<float>& u, const GeoArray<float>& v, Snapshot& snapshot) const {
+    size_t count = size_t(_latNum) * _lonNum;
+    snapshot.rows.resize(count);
+    snapshot.columns.resize(count);
+    double latRadians = _latInterval * M_PI / 180.0;
+    double lonRadians = _lonInterval * M_PI / 180.0;
+    float rowScale = float(1.0 / (EARTH_RADIUS * latRadians));
+    ValidMask mask(u, v);
+    JobSystem::init().parallelFor(0, _latNum, JobSystem::rowGrain(_lonNum), [&](int first, int last) {
+        for (auto m = first; m < last; m++) {
+            double cosLatitude = cos((_latStart + m * _latInterval) * M_PI / 180.0);
+            float columnScale = cosLatitude < MIN_COS_LATITUDE ? NAN :
+                                float(1.0 / (EARTH_RADIUS * cosLatitude * lonRadians));
+            for (auto n = 0; n < _lonNum; n++) {
+                size_t i = size_t(m) * _lonNum + n;
+                bool valid = mask.isValid(m, n);
+                snapshot.rows[i] = valid ? v.array_p_[i] * rowScale : NAN;
+                snapshot.columns[i] = valid ? u.array_p_[i] * columnScale : NAN;
+            }
+        }
+    });
+}
+
+bool FtleEngine::pushSnapshot(const GeoArray<float>& u, const GeoArray<float>& v) {
+    if (!isSameGeoInfo(u, v) || u.getStatus() != GeoArray<float>::ARRAY_STATUS_SUCCEED ||
+        v.getStatus() != GeoArray<float>::ARRAY_STATUS_SUCCEED || u.latitude_num_ < 2 || u.longitude_num_ < 2) {
+        return false;
+    }
+    if (_latNum == 0) {
+        _latNum = u.latitude_num_;
+        _lonNum = u.longitude_num_;
+        _latStart = u.latitude_start_;
+        _latInterval = u.latitude_interval_;
+        _lonStart = u.longitude_start_;
+        _lonInterval = u.longitude_interval_;
+        _wrap = fabs(_lonInterval) * _lonNum >= 360.0 - 1e-6;
+        int refinement = _param.refinement;
+        _flowRows = (_latNum - 1) * refinement + 1;
+        _flowColumns = _wrap ? _lonNum * refinement : (_lonNum - 1) * refinement + 1;
+    } else if (u.latitude_num_ != _latNum || u.longitude_num_ != _lonNum || u.latitude_start_ != _latStart ||
+               u.latitude_interval_ != _latInterval || u.longitude_start_ != _lonStart ||
+               u.longitude_interval_ != _lonInterval) {
+        return false;
+    }
+
+    Snapshot current;
+    convertSnapshot(u, v, current);
+    if (_flowValid.empty()) {
+        // the land does not move, the first snapshot tells where it is
+        _flowValid.resize(size_t(_flowRows) * _flowColumns);
+        float cellsPerPoint = 1.0f / _param.refinement;
+        for (auto i = 0; i < _flowRows; i++) {
+            for (auto j = 0; j < _flowColumns; j++) {
+                Bilinear weights = bilinear(_latNum, _lonNum, _wrap, i * cellsPerPoint, j * cellsPerPoint);
+                float rows = weights(current.rows.data());
+                float columns = weights(current.columns.data());
+                _flowValid[size_t(i) * _flowColumns + j] = rows == rows && columns == columns;
+            }
+        }
+    }
+    if (_hasPrevious) {
+        _maps.push_back(FlowMap());
+        integrate(_previous, current, _maps.back());
+        if (int(_maps.size()) > _param.windowIntervals) {
+            _maps.pop_front();
+        }
+    }
+    _previous = std::move(current);
+    _hasPrevious = true;
+    return true;
+}
+
+void FtleEngine::integrate(const Snapshot& from, const Snapshot& to, FlowMap& map) {
+    size_t count = size_t(_flowRows) * _flowColumns;
+    map.rows.resize(count);
+    map.columns.resize(count);
+    double interval = _param.snapshotInterval;
+    int steps = _param.stepsPerInterval;
+    float step = float((_param.forward ? interval : -interval) / steps);
+    double start = _param.forward ? 0.0 : interval;
+    float cellsPerPoint = 1.0f / _param.refinement;
+    int latNum = _latNum;
+    int lonNum = _lonNum;
+    bool wrap = _wrap;
+
+    // the currents at a time of the interval, linear between the snapshots. a point out of a regional grid or on a
+    // cell without data stops
+    auto velocity = [&](double time, const PointBatch& points) {
+        float alpha = float(time / interval);
+        PointBatch result;
+        for (auto lane = 0; lane < LANES; lane++) {
+            float row = points.axes[ROW][lane];
+            float column = points.axes[COLUMN][lane];
+            Bilinear weights = bilinear(latNum, lonNum, wrap, row, column);
+            float rows0 = weights(from.rows.data());
+            float columns0 = weights(from.columns.data());
+            float rows = rows0 + (weights(to.rows.data()) - rows0) * alpha;
+            float columns = columns0 + (weights(to.columns.data()) - columns0) * alpha;
+            bool inside = row >= 0.0f && row <= latNum - 1 && (wrap || (column >= 0.0f && column <= lonNum - 1));
+            bool valid = inside && rows == rows && columns == columns;
+            result.axes[ROW][lane] = valid ? rows : 0.0f;
+            result.axes[COLUMN][lane] = valid ? columns : 0.0f;
+        }
+        return result;
+    };
+
+    JobSystem::init().parallelFor(0, _flowRows, 1, [&](int first, int last) {
+        for (auto i = first; i < last; i++) {
+            for (auto j = 0; j < _flowColumns; j += LANES) {
+                PointBatch points;
+                for (auto lane = 0; lane < LANES; lane++) {
+                    // the lanes past the end of the row repeat its last point
+                    points.axes[ROW][lane] = i * cellsPerPoint;
+                    points.axes[COLUMN][lane] = std::min(j + lane, _flowColumns - 1) * cellsPerPoint;
+                }
+                PointBatch origin = points;
+                double time = start;
+                for (auto s = 0; s < steps; s++, time += step) {
+                    points = rk4Step(points, time, step, velocity);
+                }
+                int laneNum = std::min(LANES, _flowColumns - j);
+                size_t index = size_t(i) * _flowColumns + j;
+                for (auto lane = 0; lane < laneNum; lane++) {
+                    map.rows[index + lane] = points.axes[ROW][lane] - origin.axes[ROW][lane];
+                    map.columns[index + lane] = points.axes[COLUMN][lane] - origin.axes[COLUMN][lane];
+                }
+            }
+            _steps += uint64_t((_flowColumns + LANES - 1) / LANES) * LANES * steps;
+        }
+    });
+}
+
+bool FtleEngine::compute(GeoArray<float>& ftle) {
+    if (!isReady()) {
+        return false;
+    }
+    size_t count = size_t(_flowRows) * _flowColumns;
+    std::vector<float> finalRows(count);
+    std::vector<float> finalColumns(count);
+    int refinement = _param.refinement;
+    float cellsPerPoint = 1.0f / refinement;
+    auto& jobs = JobSystem::init();
+
+    // compose the flow maps of the window in the order the points go through them, interpolating each one where
+    // the previous ones took the point
+    jobs.parallelFor(0, _flowRows, 1, [&](int first, int last) {
+        for (auto i = first; i < last; i++) {
+            for (auto j = 0; j < _flowColumns; j++) {
+                float row = i * cellsPerPoint;
+                float column = j * cellsPerPoint;
+                for (auto k = 0; k < int(_maps.size()); k++) {
+                    const FlowMap& map = _maps[_param.forward ? k : _maps.size() - 1 - k];
+                    Bilinear weights = bilinear(_flowRows, _flowColumns, _wrap, row * refinement,
+                                                column * refinement);
+                    row += weights(map.rows.data());
+                    column += weights(map.columns.data());
+                }
+                finalRows[size_t(i) * _flowColumns + j] = row;
+                finalColumns[size_t(i) * _flowColumns + j] = column;
+            }
+        }
+    });
+
+    ftle = GeoArray<float>();
+    ftle.latitude_num_ = _flowRows;
+    ftle.longitude_num_ = _flowColumns;
+    ftle.latitude_start_ = _latStart;
+    ftle.latitude_interval_ = _latInterval / refinement;
+    ftle.latitude_end_ = _latStart + ftle.latitude_interval_ * (_flowRows - 1);
+    ftle.longitude_start_ = _lonStart;
+    ftle.longitude_interval_ = _lonInterval / refinement;
+    ftle.longitude_end_ = _lonStart + ftle.longitude_interval_ * (_flowColumns - 1);
+    ftle.has_invalid_value_ = true;
+    ftle.invalid_value_ = DERIVED_FILL_VALUE;
+    ftle.status_ = GeoArray<float>::ARRAY_STATUS_SUCCEED;
+    ftle.array_p_ = new float[count];
+    float* output = ftle.array_p_;
+
+    double latRadians = ftle.latitude_interval_ * M_PI / 180.0;
+    double lonRadians = ftle.longitude_interval_ * M_PI / 180.0;
+    double time = _param.snapshotInterval * _param.windowIntervals;
+    // from the stretching over the window to 1/day
+    double scale = 86400.0 / (2.0 * time);
+    // a cell of the currents is refinement points of the flow map grid
+    double wrapPoints = double(_lonNum) * refinement;
+
+    /* the Jacobian of the flow map from central differences of the final positions, in meters on the sphere. the
+     * FTLE is log of the largest singular value of the Jacobian over the time, the largest eigenvalue of the
+     * Cauchy-Green tensor J^T J gives its square.
+     */
+    jobs.parallelFor(0, _flowRows, 1, [&](int first, int last) {
+        for (auto i = first; i < last; i++) {
+            double cosLatitude = cos((_latStart + i * cellsPerPoint * _latInterval) * M_PI / 180.0);
+            for (auto j = 0; j < _flowColumns; j++) {
+                size_t index = size_t(i) * _flowColumns + j;
+                output[index] = DERIVED_FILL_VALUE;
+                bool hasColumns = _wrap || (j > 0 && j + 1 < _flowColumns);
+                if (i == 0 || i + 1 == _flowRows || !hasColumns || cosLatitude < MIN_COS_LATITUDE) {
+                    continue;
+                }
+                size_t west = size_t(i) * _flowColumns + (j > 0 ? j - 1 : _flowColumns - 1);
+                size_t east = size_t(i) * _flowColumns + (j + 1 < _flowColumns ? j + 1 : 0);
+                size_t south = index - _flowColumns;
+                size_t north = index + _flowColumns;
+                // the neighbours on land would not move, the differences would make ridges along the coasts
+                if (!_flowValid[index] || !_flowValid[west] || !_flowValid[east] || !_flowValid[south] ||
+                    !_flowValid[north]) {
+                    continue;
+                }
+                // the positions are in cells of the currents, the differences in points of the flow map grid
+                auto eastward = [&](size_t a, size_t b) {
+                    double columns = (finalColumns[a] - finalColumns[b]) * double(refinement);
+                    if (_wrap) {
+                        columns -= floor(columns / wrapPoints + 0.5) * wrapPoints;
+                    }
+                    double row = 0.5 * (finalRows[a] + finalRows[b]);
+                    double latitude = (_latStart + row * _latInterval) * M_PI / 180.0;
+                    return columns * lonRadians * EARTH_RADIUS * cos(latitude);
+                };
+                auto northward = [&](size_t a, size_t b) {
+                    return (finalRows[a] - finalRows[b]) * double(refinement) * latRadians * EARTH_RADIUS;
+                };
+                double dx = 2.0 * lonRadians * EARTH_RADIUS * cosLatitude;
+                double dy = 2.0 * latRadians * EARTH_RADIUS;
+                double f00 = eastward(east, west) / dx;
+                double f10 = northward(east, west) / dx;
+                double f01 = eastward(north, south) / dy;
+                double f11 = northward(north, south) / dy;
+                double a = f00 * f00 + f10 * f10;
+                double b = f00 * f01 + f10 * f11;
+                double d = f01 * f01 + f11 * f11;
+                double largest = 0.5 * (a + d) + sqrt(0.25 * (a - d) * (a - d) + b * b);
+                if (largest > 0.0) {
+                    output[index] = float(log(largest) * scale);
+                }
+            }
+        }
+    });
+
+    float minVal = DERIVED_FILL_VALUE;
+    float maxVal = -DERIVED_FILL_VALUE;
+    for (size_t i = 0; i < count; i++) {
+        if (output[i] != DERIVED_FILL_VALUE) {
+            minVal = std::min(minVal, output[i]);
+            maxVal = std::max(maxVal, output[i]);
+        }
+    }
+    ftle.minVal_ = minVal <= maxVal ? minVal : 0.0f;
+    ftle.maxVal_ = minVal <= maxVal ? maxVal : 0.0f;
+    return true;
+}
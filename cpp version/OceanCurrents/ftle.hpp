@@ -0,0 +1,114 @@
+/* finite-time Lyapunov exponents of the time dependent currents, whose ridges are the Lagrangian coherent
+ * structures
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef FTLE_HPP
+#define FTLE_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <deque>
+#include <vector>
+
+#include "GeoArray.h"
+
+struct FtleParam {
+    // seconds between two snapshots of the currents
+    double snapshotInterval = 3600.0;
+    // RK4 steps per snapshot interval
+    int stepsPerInterval = 12;
+    // snapshot intervals per FTLE window, the integration time is windowIntervals * snapshotInterval
+    int windowIntervals = 24;
+    // false integrates backward in time, the ridges are then the attracting structures instead of the repelling ones
+    bool forward = true;
+    // flow map points per grid cell along each axis, ridges are much thinner than the cells of the currents
+    int refinement = 2;
+};
+
+/**
+ * @brief FTLE maps over a sliding window of snapshots.
+ *
+ * integrating every point over the whole window again for each map would repeat most of the work of the previous
+ * one. the engine integrates a flow map per snapshot interval instead, once, when the snapshot closing it arrives,
+ * and a window composes the flow maps it covers by interpolating them: a new map costs the RK4 steps of a single
+ * interval. the flow maps are integrated in batches of points, row by row on the workers of the JobSystem.
+ *
+ * the currents are linear in time between the snapshots and bilinear in space. a point that reaches land or a cell
+ * without data stops there, a point that leaves a regional grid stops at its edge.
+ */
+class FtleEngine {
+public:
+    explicit FtleEngine(const FtleParam& param);
+
+    /**
+     * @brief add the currents of the next snapshot, snapshotInterval after the previous one, and integrate the flow
+     *        map of the interval between them.
+     *
+     * @return false if the currents were not read or their grid is not the one of the first snapshot
+     */
+    bool pushSnapshot(const GeoArray<float>& u, const GeoArray<float>& v);
+
+    // the flow maps of a whole window are there
+    bool isReady() const { return int(_maps.size()) == _param.windowIntervals; }
+
+    /**
+     * @brief the FTLE of the last window in 1/day, on the flow map grid.
+     *
+     * a forward window starts windowIntervals snapshots before the last one, a backward window starts at the last
+     * one. points on land or next to it get DERIVED_FILL_VALUE.
+     *
+     * @return false if the engine is not ready
+     */
+    bool compute(GeoArray<float>& ftle);
+
+    // RK4 steps of a batch lane so far, about the number of flow map points times the steps per interval per map
+    uint64_t getStepCount() const { return _steps; }
+
+private:
+    // the currents of a snapshot in grid cells per second, NaN without data
+    struct Snapshot {
+        std::vector<float> rows;
+        std::vector<float> columns;
+    };
+
+    // where the points of the flow map grid went over an interval, in grid cells
+    struct FlowMap {
+        std::vector<float> rows;
+        std::vector<float> columns;
+    };
+
+    FtleParam _param;
+
+    // the grid of the currents, from the first snapshot
+    int _latNum;
+    int _lonNum;
+    double _latStart;
+    double _latInterval;
+    double _lonStart;
+    double _lonInterval;
+    // the grid covers all longitudes, so its columns wrap around
+    bool _wrap;
+
+    // the flow map grid
+    int _flowRows;
+    int _flowColumns;
+
+    // the points of the flow map grid that start on valid cells
+    std::vector<char> _flowValid;
+
+    Snapshot _previous;
+    bool _hasPrevious;
+
+    // the flow maps of the last window, oldest interval first
+    std::deque<FlowMap> _maps;
+
+    std::atomic<uint64_t> _steps;
+
+    void convertSnapshot(const GeoArray<float>& u, const GeoArray<float>& v, Snapshot& snapshot) const;
+
+    void integrate(const Snapshot& from, const Snapshot& to, FlowMap& map);
+};
+
+#endif
@@ -0,0 +1,126 @@
+/**
+ * the OpenGL side of the profiler: GPU timer queries and the live AntTweakBar panel.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "gpuProfiler.hpp"
+#include <stdio.h>
+#include <string>
+
+// seconds between two refreshes of the panel, faster is unreadable anyway
+static const double PANEL_REFRESH_INTERVAL = 0.5;
+
+GpuTimerPool::GpuTimerPool() : _active(false) {}
+
+GpuTimerPool::~GpuTimerPool() {
+    if (!_queries.empty()) {
+        glDeleteQueries(GLsizei(_queries.size()), _queries.data());
+    }
+}
+
+void GpuTimerPool::begin(ProfileStage stage) {
+    if (!Profiler::init().isEnabled() || _pending.size() >= MAX_PENDING) {
+        return;
+    }
+    if (_freeQueries.empty()) {
+        GLuint query;
+        glGenQueries(1, &query);
+        _queries.push_back(query);
+        _freeQueries.push_back(query);
+    }
+    _current.query = _freeQueries.back();
+    _current.stage = stage;
+    _current.submitted = Profiler::Clock::now();
+    _freeQueries.pop_back();
+    glBeginQuery(GL_TIME_ELAPSED, _current.query);
+    _active = true;
+}
+
+void GpuTimerPool::end() {
+    if (!_active) {
+        return;
+    }
+    glEndQuery(GL_TIME_ELAPSED);
+    _pending.push_back(_current);
+    _active = false;
+}
+
+void GpuTimerPool::collect() {
+    Profiler& profiler = Profiler::init();
+    // the queries complete in order, stop at the first one not ready
+    while (!_pending.empty()) {
+        PendingQuery& pending = _pending.front();
+        GLint available = 0;
+        glGetQueryObjectiv(pending.query, GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) {
+            break;
+        }
+        GLuint64 nanoseconds = 0;
+        glGetQueryObjectui64v(pending.query, GL_QUERY_RESULT, &nanoseconds);
+        profiler.recordGpu(pending.stage, pending.submitted, nanoseconds / 1000.0);
+        _freeQueries.push_back(pending.query);
+        _pending.pop_front();
+    }
+}
+
+ProfilerPanel::ProfilerPanel(int width, int height) : _lastUpdate(0.0) {
+    for (auto stage = 0; stage < PROFILE_STAGE_NUM; stage++) {
+        for (auto clock = 0; clock < PROFILE_CLOCK_NUM; clock++) {
+            _means[stage][clock] = 0.0f;
+            _p95s[stage][clock] = 0.0f;
+            _lastCounts[stage][clock] = 0;
+            _lastSums[stage][clock] = 0.0;
+        }
+    }
+    TwInit(TW_OPENGL_CORE, nullptr);
+    TwWindowSize(width, height);
+    _bar = TwNewBar("Profiler");
+    TwDefine(" Profiler label='Frame time (ms)' size='240 320' valueswidth=70 refresh=0.5 color='40 40 40' ");
+    for (auto stage = 0; stage < PROFILE_STAGE_NUM; stage++) {
+        std::string name = Profiler::getStageName(ProfileStage(stage));
+        std::string group = " group=" + name + " ";
+        TwAddVarRO(_bar, (name + "_cpu").c_str(), TW_TYPE_FLOAT, &_means[stage][PROFILE_CPU],
+                   (group + "label='cpu mean' precision=3").c_str());
+        TwAddVarRO(_bar, (name + "_cpu95").c_str(), TW_TYPE_FLOAT, &_p95s[stage][PROFILE_CPU],
+                   (group + "label='cpu p95' precision=3").c_str());
+        TwAddVarRO(_bar, (name + "_gpu").c_str(), TW_TYPE_FLOAT, &_means[stage][PROFILE_GPU],
+                   (group + "label='gpu mean' precision=3").c_str());
+        TwAddVarRO(_bar, (name + "_gpu95").c_str(), TW_TYPE_FLOAT, &_p95s[stage][PROFILE_GPU],
+                   (group + "label='gpu p95' precision=3").c_str());
+    }
+}
+
+ProfilerPanel::~ProfilerPanel() {
+    TwTerminate();
+}
+
+void ProfilerPanel::update(double time) {
+    if (time - _lastUpdate < PANEL_REFRESH_INTERVAL) {
+        return;
+    }
+    _lastUpdate = time;
+    Profiler& profiler = Profiler::init();
+    for (auto stage = 0; stage < PROFILE_STAGE_NUM; stage++) {
+        for (auto clock = 0; clock < PROFILE_CLOCK_NUM; clock++) {
+            ProfileHistogram histogram = profiler.getHistogram(ProfileStage(stage), ProfileClock(clock));
+            uint64_t count = histogram.getCount();
+            double sum = histogram.getMeanMs() * count;
+            if (count < _lastCounts[stage][clock]) {
+                // the profiler was cleared
+                _lastCounts[stage][clock] = 0;
+                _lastSums[stage][clock] = 0.0;
+            }
+            if (count > _lastCounts[stage][clock]) {
+                _means[stage][clock] = float((sum - _lastSums[stage][clock]) / (count - _lastCounts[stage][clock]));
+            }
+            _p95s[stage][clock] = float(histogram.getPercentileMs(0.95));
+            _lastCounts[stage][clock] = count;
+            _lastSums[stage][clock] = sum;
+        }
+    }
+}
+
+void ProfilerPanel::draw() {
+    TwDraw();
+}
@@ -0,0 +1,113 @@
+/**
+ * the OpenGL side of the profiler: GPU timer queries and the live AntTweakBar panel.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef GPU_PROFILER_HPP
+#define GPU_PROFILER_HPP
+
+#include <deque>
+#include <vector>
+#include <GL/glew.h>
+#include <AntTweakBar.h>
+#include "profiler.hpp"
+
+/**
+ * @brief pool of GL_TIME_ELAPSED queries whose results are collected asynchronously.
+ *
+ * a query result is only ready a few frames after it was issued; reading it earlier would stall the CPU until
+ * the GPU catches up. collect() only takes the results already available and feeds them to the Profiler.
+ * time elapsed queries can not nest, so the GPU scopes must not overlap.
+ */
+class GpuTimerPool {
+public:
+    // queries in flight at most, more scopes are not timed until some results arrive
+    static const size_t MAX_PENDING = 64;
+
+    GpuTimerPool();
+
+    ~GpuTimerPool();
+
+    void begin(ProfileStage stage);
+
+    void end();
+
+    // record the results ready so far, call once per frame
+    void collect();
+
+private:
+    struct PendingQuery {
+        GLuint query;
+        ProfileStage stage;
+        Profiler::Clock::time_point submitted;
+    };
+
+    std::vector<GLuint> _queries;
+
+    std::vector<GLuint> _freeQueries;
+
+    std::deque<PendingQuery> _pending;
+
+    PendingQuery _current;
+
+    bool _active;
+
+    GpuTimerPool(const GpuTimerPool&);
+    GpuTimerPool& operator=(const GpuTimerPool&);
+};
+
+/**
+ * @brief measure the GPU time of the commands issued in the enclosing block.
+ */
+class GpuProfileScope {
+public:
+    GpuProfileScope(GpuTimerPool& pool, ProfileStage stage) : _pool(pool) {
+        _pool.begin(stage);
+    }
+
+    ~GpuProfileScope() {
+        _pool.end();
+    }
+
+private:
+    GpuTimerPool& _pool;
+
+    GpuProfileScope(const GpuProfileScope&);
+    GpuProfileScope& operator=(const GpuProfileScope&);
+};
+
+/**
+ * @brief AntTweakBar panel showing the CPU and GPU time of every stage.
+ *
+ * the means are over the last refresh interval, the 95th percentiles since the start.
+ */
+class ProfilerPanel {
+public:
+    ProfilerPanel(int width, int height);
+
+    ~ProfilerPanel();
+
+    // refresh the values from the profiler, at most twice a second
+    void update(double time);
+
+    void draw();
+
+private:
+    TwBar* _bar;
+
+    double _lastUpdate;
+
+    float _means[PROFILE_STAGE_NUM][PROFILE_CLOCK_NUM];
+
+    float _p95s[PROFILE_STAGE_NUM][PROFILE_CLOCK_NUM];
+
+    // the count and sum at the last update, to get the mean of the interval
+    uint64_t _lastCounts[PROFILE_STAGE_NUM][PROFILE_CLOCK_NUM];
+
+    double _lastSums[PROFILE_STAGE_NUM][PROFILE_CLOCK_NUM];
+
+    ProfilerPanel(const ProfilerPanel&);
+    ProfilerPanel& operator=(const ProfilerPanel&);
+};
+
+#endif
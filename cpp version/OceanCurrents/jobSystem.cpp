@@ -0,0 +1,393 @@
+/**
+ * work-stealing job system shared by the loading, the field builds, the OLIC and particle passes and the batch
+ * pipeline.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "jobSystem.hpp"
+#include <algorithm>
+#include <chrono>
+#include <exception>
+
+struct JobSystem::Job {
+    std::function<void()> fn;
+    bool main;
+    // unfinished dependencies, plus one while the job is being submitted
+    std::atomic<int> blockers;
+    std::atomic<bool> done;
+    // guards done against the continuations being added
+    std::mutex mutex;
+    std::vector<JobHandle> continuations;
+    std::exception_ptr error;
+};
+
+struct JobSystem::RangeState {
+    const std::function<void(int, int)>* fn;
+    int grain;
+    // items not done yet
+    std::atomic<int> remaining;
+    std::mutex mutex;
+    std::exception_ptr error;
+};
+
+JobSystem* JobSystem::_instance = nullptr;
+
+JobSystem& JobSystem::init(int threadNum) {
+    if (JobSystem::_instance != nullptr) {
+        return *JobSystem::_instance;
+    }
+    auto system = new JobSystem();
+    system->_queued = 0;
+    system->_mainQueued = 0;
+    system->_mainThread = std::this_thread::get_id();
+    system->_sleepingWorkers = 0;
+    system->_sleepingWaiters = 0;
+    system->_running = true;
+    if (threadNum <= 0) {
+        threadNum = std::max(1, int(std::thread::hardware_concurrency()) - 1);
+    }
+    for (auto i = 0; i < threadNum; i++) {
+        std::unique_ptr<Worker> worker(new Worker());
+        worker->jobs = 0;
+        worker->steals = 0;
+        worker->idleMicros = 0;
+        system->_workers.push_back(std::move(worker));
+    }
+    {
+        // the workers start by taking this lock, so they only look for tasks once all the ids are known
+        std::lock_guard<std::mutex> lock(system->_sleepMutex);
+        for (auto i = 0; i < threadNum; i++) {
+            Worker& worker = *system->_workers[i];
+            worker.thread = std::thread(&JobSystem::workerLoop, system, i);
+            worker.id = worker.thread.get_id();
+        }
+    }
+    JobSystem::_instance = system;
+    return *system;
+}
+
+JobSystem::JobHandle JobSystem::submit(std::function<void()> fn, const std::vector<JobHandle>& dependencies) {
+    return submitJob(std::move(fn), dependencies, false);
+}
+
+JobSystem::JobHandle JobSystem::submitMain(std::function<void()> fn, const std::vector<JobHandle>& dependencies) {
+    return submitJob(std::move(fn), dependencies, true);
+}
+
+JobSystem::JobHandle JobSystem::submitJob(std::function<void()> fn, const std::vector<JobHandle>& dependencies,
+                                          bool main) {
+    JobHandle job = std::make_shared<Job>();
+    job->fn = std::move(fn);
+    job->main = main;
+    job->done = false;
+    job->blockers = int(dependencies.size()) + 1;
+    for (const JobHandle& dependency : dependencies) {
+        if (!dependency) {
+            job->blockers--;
+            continue;
+        }
+        std::lock_guard<std::mutex> lock(dependency->mutex);
+        if (dependency->done) {
+            job->blockers--;
+        } else {
+            dependency->continuations.push_back(job);
+        }
+    }
+    if (--job->blockers == 0) {
+        schedule(job);
+    }
+    return job;
+}
+
+void JobSystem::wait(const JobHandle& job) {
+    helpUntil([&job]() { return job->done.load(); });
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+}
+
+bool JobSystem::isDone(const JobHandle& job) const {
+    return job->done;
+}
+
+void JobSystem::parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& fn) {
+    if (end <= begin) {
+        return;
+    }
+    if (grain >= end - begin || _workers.empty()) {
+        fn(begin, end);
+        return;
+    }
+    auto state = std::make_shared<RangeState>();
+    state->fn = &fn;
+    state->grain = std::max(grain, 1);
+    state->remaining = end - begin;
+    runRange(state, begin, end);
+    helpUntil([&state]() { return state->remaining == 0; });
+    if (state->error) {
+        std::rethrow_exception(state->error);
+    }
+}
+
+void JobSystem::parallelFor2d(int width, int height, int tileWidth, int tileHeight,
+                              const std::function<void(int, int, int, int)>& fn) {
+    int columns = (width + tileWidth - 1) / tileWidth;
+    int rows = (height + tileHeight - 1) / tileHeight;
+    // the tiles in row-major order, a piece of the split range is a band of neighbouring tiles
+    parallelFor(0, columns * rows, 1, [&](int first, int last) {
+        for (auto tile = first; tile < last; tile++) {
+            int x0 = tile % columns * tileWidth;
+            int y0 = tile / columns * tileHeight;
+            fn(x0, y0, std::min(x0 + tileWidth, width), std::min(y0 + tileHeight, height));
+        }
+    });
+}
+
+void JobSystem::runRange(const std::shared_ptr<RangeState>& state, int begin, int end) {
+    while (end - begin > state->grain) {
+        int middle = begin + (end - begin) / 2;
+        push([this, state, middle, end]() { runRange(state, middle, end); });
+        end = middle;
+    }
+    try {
+        (*state->fn)(begin, end);
+    } catch (...) {
+        std::lock_guard<std::mutex> lock(state->mutex);
+        if (!state->error) {
+            state->error = std::current_exception();
+        }
+    }
+    // the caller may return as soon as this reaches 0, fn is not used any more
+    if ((state->remaining -= end - begin) == 0) {
+        notifyProgress();
+    }
+}
+
+int JobSystem::runMainJobs(int maxJobs) {
+    int count = 0;
+    while (count < maxJobs) {
+        JobHandle job;
+        {
+            std::lock_guard<std::mutex> lock(_mainMutex);
+            if (_mainJobs.empty()) {
+                break;
+            }
+            job = _mainJobs.front();
+            _mainJobs.pop_front();
+            _mainQueued--;
+        }
+        run(job);
+        count++;
+        if (job->error) {
+            std::rethrow_exception(job->error);
+        }
+    }
+    return count;
+}
+
+void JobSystem::setMainWakeup(std::function<void()> wakeup) {
+    std::lock_guard<std::mutex> lock(_mainMutex);
+    _mainWakeup = wakeup;
+}
+
+JobSystem::WorkerStats JobSystem::getStats(int worker) const {
+    WorkerStats stats;
+    stats.jobs = _workers[worker]->jobs;
+    stats.steals = _workers[worker]->steals;
+    stats.idleSeconds = _workers[worker]->idleMicros / 1e6;
+    return stats;
+}
+
+void JobSystem::resetStats() {
+    for (auto& worker : _workers) {
+        worker->jobs = 0;
+        worker->steals = 0;
+        worker->idleMicros = 0;
+    }
+}
+
+void JobSystem::finalize() {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _running = false;
+    }
+    _workAvailable.notify_all();
+    for (auto& worker : _workers) {
+        worker->thread.join();
+    }
+    _instance = nullptr;
+    delete this;
+}
+
+int JobSystem::getWorkerIndex() const {
+    std::thread::id id = std::this_thread::get_id();
+    for (size_t i = 0; i < _workers.size(); i++) {
+        if (_workers[i]->id == id) {
+            return int(i);
+        }
+    }
+    return -1;
+}
+
+void JobSystem::push(std::function<void()> task) {
+    int self = getWorkerIndex();
+    if (self >= 0) {
+        Worker& worker = *_workers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        worker.tasks.push_back(std::move(task));
+        _queued++;
+    } else {
+        std::lock_guard<std::mutex> lock(_injectedMutex);
+        _injected.push_back(std::move(task));
+        _queued++;
+    }
+    // a sleeper that checked _queued before the push is waiting already, taking the lock is enough to not miss it
+    if (_sleepingWorkers > 0 || _sleepingWaiters > 0) {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _workAvailable.notify_one();
+        _progress.notify_all();
+    }
+}
+
+bool JobSystem::take(int self, std::function<void()>& task) {
+    if (_queued == 0) {
+        return false;
+    }
+    if (self >= 0) {
+        Worker& worker = *_workers[self];
+        std::lock_guard<std::mutex> lock(worker.mutex);
+        if (!worker.tasks.empty()) {
+            task = std::move(worker.tasks.back());
+            worker.tasks.pop_back();
+            _queued--;
+            return true;
+        }
+    }
+    {
+        std::lock_guard<std::mutex> lock(_injectedMutex);
+        if (!_injected.empty()) {
+            task = std::move(_injected.front());
+            _injected.pop_front();
+            _queued--;
+            return true;
+        }
+    }
+    // start next to self, so the thieves do not all queue up on the same deque
+    int workerNum = int(_workers.size());
+    for (auto i = 1; i <= workerNum; i++) {
+        int victim = (self + i) % workerNum;
+        if (victim == self) {
+            continue;
+        }
+        Worker& other = *_workers[victim];
+        std::lock_guard<std::mutex> lock(other.mutex);
+        if (!other.tasks.empty()) {
+            task = std::move(other.tasks.front());
+            other.tasks.pop_front();
+            _queued--;
+            if (self >= 0) {
+                _workers[self]->steals++;
+            }
+            return true;
+        }
+    }
+    return false;
+}
+
+void JobSystem::helpUntil(const std::function<bool()>& done) {
+    int self = getWorkerIndex();
+    bool main = std::this_thread::get_id() == _mainThread;
+    std::function<void()> task;
+    while (!done()) {
+        if (main && _mainQueued > 0 && runMainJobs(1) > 0) {
+            continue;
+        }
+        if (take(self, task)) {
+            task();
+            task = nullptr;
+            if (self >= 0) {
+                _workers[self]->jobs++;
+            }
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        _sleepingWaiters++;
+        _progress.wait(lock, [&]() { return done() || _queued > 0 || (main && _mainQueued > 0); });
+        _sleepingWaiters--;
+    }
+}
+
+void JobSystem::schedule(const JobHandle& job) {
+    if (!job->main) {
+        push([this, job]() { run(job); });
+        return;
+    }
+    std::function<void()> wakeup;
+    {
+        std::lock_guard<std::mutex> lock(_mainMutex);
+        _mainJobs.push_back(job);
+        _mainQueued++;
+        wakeup = _mainWakeup;
+    }
+    if (wakeup) {
+        wakeup();
+    }
+    // the main thread may be waiting for something else
+    notifyProgress();
+}
+
+void JobSystem::run(const JobHandle& job) {
+    try {
+        job->fn();
+    } catch (...) {
+        job->error = std::current_exception();
+    }
+    // the captures may hold a lot, e.g. a decoded image
+    job->fn = nullptr;
+    std::vector<JobHandle> continuations;
+    {
+        std::lock_guard<std::mutex> lock(job->mutex);
+        job->done = true;
+        continuations.swap(job->continuations);
+    }
+    for (const JobHandle& continuation : continuations) {
+        if (--continuation->blockers == 0) {
+            schedule(continuation);
+        }
+    }
+    notifyProgress();
+}
+
+void JobSystem::notifyProgress() {
+    if (_sleepingWaiters > 0) {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+        _progress.notify_all();
+    }
+}
+
+void JobSystem::workerLoop(int self) {
+    {
+        std::lock_guard<std::mutex> lock(_sleepMutex);
+    }
+    Worker& worker = *_workers[self];
+    std::function<void()> task;
+    while (true) {
+        if (take(self, task)) {
+            task();
+            task = nullptr;
+            worker.jobs++;
+            continue;
+        }
+        std::unique_lock<std::mutex> lock(_sleepMutex);
+        if (!_running) {
+            return;
+        }
+        auto start = std::chrono::steady_clock::now();
+        _sleepingWorkers++;
+        _workAvailable.wait(lock, [this]() { return _queued > 0 || !_running; });
+        _sleepingWorkers--;
+        worker.idleMicros += std::chrono::duration_cast<std::chrono::microseconds>(
+            std::chrono::steady_clock::now() - start).count();
+    }
+}
@@ -0,0 +1,182 @@
+/**
+ * work-stealing job system shared by the loading, the field builds, the OLIC and particle passes and the batch
+ * pipeline, so they split the cores between them instead of each starting its own threads.
+ *
+ * every worker owns a deque of jobs. it pushes and pops at the back, so the pieces of a split range run depth first
+ * while their data is still in cache, and idle workers steal from the front, where the oldest and biggest pieces
+ * are. a thread waiting for a job runs other jobs meanwhile instead of blocking, so jobs may wait for jobs without
+ * deadlocking and there are never more busy threads than workers plus waiters.
+ *
+ * GL calls have to stay on the thread of the context: main jobs are queued apart and only run by that thread, in
+ * runMainJobs or while it waits.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef JOB_SYSTEM_HPP
+#define JOB_SYSTEM_HPP
+
+#include <limits.h>
+#include <stdint.h>
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class JobSystem {
+public:
+    struct Job;
+
+    // a submitted job, to wait for or to depend on
+    typedef std::shared_ptr<Job> JobHandle;
+
+    struct WorkerStats {
+        // jobs run by the worker, the pieces of parallelFor included
+        uint64_t jobs;
+        // jobs taken from the deque of another worker
+        uint64_t steals;
+        // time spent asleep for want of jobs
+        double idleSeconds;
+    };
+
+    // cells a piece of a pass over the rows of a grid covers at least, so a job is worth more than its scheduling
+    static const int GRAIN_CELLS = 16384;
+
+    // the grain of parallelFor over rows of the given number of cells
+    static int rowGrain(int rowCells) { return std::max(1, GRAIN_CELLS / std::max(rowCells, 1)); }
+
+    /**
+     * @brief factory methods for singleton, call it first on the main thread.
+     *
+     * @param threadNum workers, 0 for one per hardware thread but the main one
+     */
+    static JobSystem& init(int threadNum = 0);
+
+    /**
+     * @brief run fn on a worker once all the dependencies are finished, returns right away.
+     *
+     * a job runs after its dependencies even if they threw, wait rethrows the exception of the job it waits for.
+     * null dependencies are ignored.
+     */
+    JobHandle submit(std::function<void()> fn, const std::vector<JobHandle>& dependencies = std::vector<JobHandle>());
+
+    // the same, but fn runs on the main thread, e.g. to upload what the dependencies computed
+    JobHandle submitMain(std::function<void()> fn,
+                         const std::vector<JobHandle>& dependencies = std::vector<JobHandle>());
+
+    // block until the job is finished, running other jobs meanwhile, main jobs included on the main thread
+    void wait(const JobHandle& job);
+
+    bool isDone(const JobHandle& job) const;
+
+    /**
+     * @brief call fn(begin, end) on pieces of [begin, end) of at most grain items, in parallel, and wait for them.
+     *
+     * the range is split in halves, a worker stealing a half splits it further. a grain covering the whole range
+     * runs it on the calling thread. the first exception thrown by fn is rethrown once all the pieces are done.
+     */
+    void parallelFor(int begin, int end, int grain, const std::function<void(int, int)>& fn);
+
+    // the same over the tiles of tileWidth x tileHeight covering [0, width) x [0, height), fn(x0, y0, x1, y1)
+    void parallelFor2d(int width, int height, int tileWidth, int tileHeight,
+                       const std::function<void(int, int, int, int)>& fn);
+
+    /**
+     * @brief run the main jobs ready to run, at most maxJobs, call it on the main thread every frame.
+     *
+     * rethrows the exception of a main job, after finishing it.
+     *
+     * @return the number of jobs run
+     */
+    int runMainJobs(int maxJobs = INT_MAX);
+
+    // main jobs ready to run
+    int getMainJobCount() const { return _mainQueued; }
+
+    // called on any thread whenever a main job gets ready, e.g. to wake the render loop
+    void setMainWakeup(std::function<void()> wakeup);
+
+    int getWorkerNum() const { return int(_workers.size()); }
+
+    WorkerStats getStats(int worker) const;
+
+    void resetStats();
+
+    // stop the workers once the queued tasks are done, jobs still waiting for their dependencies never run
+    void finalize();
+
+private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+        std::thread::id id;
+        std::atomic<uint64_t> jobs;
+        std::atomic<uint64_t> steals;
+        std::atomic<uint64_t> idleMicros;
+    };
+
+    // what the pieces of one parallelFor share
+    struct RangeState;
+
+    static JobSystem* _instance;
+
+    std::vector<std::unique_ptr<Worker>> _workers;
+
+    // tasks pushed by threads that are not workers, taken oldest first
+    std::mutex _injectedMutex;
+    std::deque<std::function<void()>> _injected;
+
+    // tasks in all the deques, tells the sleepers there is something to take
+    std::atomic<int> _queued;
+
+    // guards the main jobs and the wakeup
+    std::mutex _mainMutex;
+    std::deque<JobHandle> _mainJobs;
+    std::atomic<int> _mainQueued;
+    std::thread::id _mainThread;
+    std::function<void()> _mainWakeup;
+
+    // workers out of tasks sleep on _workAvailable, threads waiting for a job on _progress
+    std::mutex _sleepMutex;
+    std::condition_variable _workAvailable;
+    std::condition_variable _progress;
+    std::atomic<int> _sleepingWorkers;
+    std::atomic<int> _sleepingWaiters;
+
+    std::atomic<bool> _running;
+
+    // the worker running on this thread, -1 for the other threads
+    int getWorkerIndex() const;
+
+    void push(std::function<void()> task);
+
+    // take a task: the back of the own deque, then the injected ones, then the front of another deque
+    bool take(int self, std::function<void()>& task);
+
+    // run tasks, and main jobs on the main thread, until done returns true, sleeping when there are none
+    void helpUntil(const std::function<bool()>& done);
+
+    JobHandle submitJob(std::function<void()> fn, const std::vector<JobHandle>& dependencies, bool main);
+
+    void schedule(const JobHandle& job);
+
+    void run(const JobHandle& job);
+
+    // run the piece [begin, end) of a parallelFor, pushing its halves beyond the grain for the others
+    void runRange(const std::shared_ptr<RangeState>& state, int begin, int end);
+
+    // wake the waiters, all of them since any may wait for what just finished
+    void notifyProgress();
+
+    void workerLoop(int self);
+
+    // singleton, forbid instantiating from client.
+    JobSystem() {}
+};
+
+#endif
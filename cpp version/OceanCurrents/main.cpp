@@ -1,6 +1,10 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <algorithm>
 #include <vector>
+#include <memory>
 
 #include <GL/glew.h>
 #include <glfw3.h>
@@ -9,183 +13,395 @@
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "utils/shaderProgram.hpp"
-#include "utils/imageLoader.hpp"
-#include "utils/objectLoader.hpp"
+#include "utils/sphereGenerator.hpp"
 #include "controller.hpp"
 #include "applicationContext.hpp"
-#include "NetCDFArray.h"
+#include "simulation.hpp"
+#include "renderer.hpp"
+#include "renderScheduler.hpp"
+#include "particleRenderer.hpp"
+#include "frameExporter.hpp"
+#include "textureLoader.hpp"
+#include "jobSystem.hpp"
+#include "virtualTexture.hpp"
+#include "profiler.hpp"
+#include "gpuProfiler.hpp"
 
 
 using namespace glm;
 
-void testNetCDF() {
-    NetCDFArray nca("2015031500_ocean.nc");
-
-    /*get attributes*/
-    std::vector<std::string> var_lists = nca.getVariableList();
-    std::cout << "the attributes are:" << std::endl;
-    for (std::vector<std::string>::iterator it = var_lists.begin();
-    it != var_lists.end(); ++it) {
-        std::cout << *it << "   ";
-        if (it + 1 == var_lists.end())
-            std::cout << std::endl;
+/**
+ * usage: OceanCurrents [--headless [frames]] [--trace file.json|file.csv] [--no-profile] [--vt image.bmp]
+ *                      [--particles [count]] [--size WxH] [--export frames_%05d.png|video.y4m]
+ *
+ * --headless renders into an offscreen framebuffer without window or display, stopping after the given number
+ * of frames (600 by default).
+ * --trace writes the profiler samples at exit, as a Chrome trace for .json and as per-stage statistics for .csv.
+ * --no-profile turns the profiler off.
+ * --vt shows a BMP of any size as the globe base layer through the virtual texture instead of color.bmp.
+ * --particles animates particle trails over the currents instead of the OLIC texture, 1000000 particles by default.
+ * --size sets the window or offscreen framebuffer size, 1024x1024 by default.
+ * --export writes a frame per simulation step, without the profiler panel, as numbered PNG files or as one Y4M
+ * video at the simulation step rate. a step the display skipped repeats the frame before, a pause is left out. the
+ * frames are read back and encoded asynchronously, the rendering only waits when the encoders fall more than a few
+ * frames behind. the PNG files are stored without compression.
+ *
+ * frames are only drawn when something changed, space pauses the OLIC animation so a still globe costs no CPU.
+ */
+int main(int argc, char** argv) {
+    bool headless = false;
+    unsigned int frameLimit = 0;
+    std::string tracePath;
+    std::string virtualTexturePath;
+    std::string exportPath;
+    int width = 1024;
+    int height = 1024;
+    ParticleParam particleParam;
+    auto& profiler = Profiler::init();
+    for (auto i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--headless") == 0) {
+            headless = true;
+            frameLimit = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 600;
+        } else if (strcmp(argv[i], "--trace") == 0 && i + 1 < argc) {
+            tracePath = argv[++i];
+        } else if (strcmp(argv[i], "--vt") == 0 && i + 1 < argc) {
+            virtualTexturePath = argv[++i];
+        } else if (strcmp(argv[i], "--export") == 0 && i + 1 < argc) {
+            exportPath = argv[++i];
+        } else if (strcmp(argv[i], "--size") == 0 && i + 1 < argc) {
+            if (sscanf(argv[++i], "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                printf("invalid size %s, expected e.g. 1920x1080\n", argv[i]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--particles") == 0) {
+            particleParam.count = (i + 1 < argc && isdigit(argv[i + 1][0])) ? atoi(argv[++i]) : 1000000;
+        } else if (strcmp(argv[i], "--no-profile") == 0) {
+            profiler.setEnabled(false);
+        }
+    }
+    bool csvTrace = tracePath.size() > 4 && tracePath.compare(tracePath.size() - 4, 4, ".csv") == 0;
+    profiler.setTracing(!tracePath.empty() && !csvTrace);
+
+    auto& glContext = ApplicationContext::init(ConfigBuilder().windowTitle("OceanCurrents")
+                                                              .fragmentShader("OceanCurrents.frag")
+                                                              .vertexShader("OceanCurrents.vert")
+                                                              .windowHeight(height)
+                                                              .windowWidth(width)
+                                                              .color(0.0, 0.0, 0.0, 0.0)
+                                                              .headless(headless)
+                                                              .frameLimit(frameLimit)
+                                                              .build());
+
+    auto& renderer = Renderer::init(glContext);
+
+    // the workers shared by the loading, the simulation and the particles, main jobs run in the render loop
+    auto& jobs = JobSystem::init();
+
+    // sleeps between the frames when nothing changes
+    auto& scheduler = RenderScheduler::init(glContext);
+    jobs.setMainWakeup([&scheduler]() { scheduler.invalidate(); });
+
+    // decoded by the workers, the globe shows a placeholder until the upload
+    auto& textureLoader = TextureLoader::init();
+    auto texture = textureLoader.load("color.bmp");
+
+    // huge imagery goes through the virtual texture, the GPU only holds the pages in view
+    std::unique_ptr<VirtualTexture> virtualTexture;
+    if (!virtualTexturePath.empty()) {
+        virtualTexture.reset(new VirtualTexture(virtualTexturePath));
+        printf("virtual texture, %d levels, %.1f MB of GPU memory\n", virtualTexture->getLevelNum(),
+               virtualTexture->getGpuBytes() / 1048576.0);
     }
 
-    /*get altitudes*/
-    std::vector<levels_t> level_lists = nca.getLevelsList();
-    std::cout << "the altitudes are:" << std::endl;
-    for (std::vector<levels_t>::iterator it = level_lists.begin(); it != level_lists.end(); ++it) {
-        std::cout << *it << "   ";
-        if (it + 1 == level_lists.end())
-            std::cout << std::endl;
+    // globe meshes for every level of detail, generated on the workers the first time the camera gets to them
+    std::vector<Mesh> globeLods(Controller::MAX_LOD + 1);
+    std::vector<JobSystem::JobHandle> globeJobs(Controller::MAX_LOD + 1);
+
+    // OLIC or particles of the surface currents on the globe texture, computed on the simulation thread and
+    // streamed to the GPU whenever a new frame is finished
+    OlicParam olicParam;
+    olicParam.width = 2048;
+    olicParam.height = 1024;
+    olicParam.wrapLongitude = true;
+    TextureStream* olicStream = nullptr;
+    std::unique_ptr<ParticleRenderer> particleRenderer;
+    // a persistent stream takes the OLIC frames right from the simulation thread, a mapped one through a copy
+    unsigned char* olicSlots[TextureStream::SLOT_NUM];
+    auto directOlic = false;
+    if (particleParam.count > 0) {
+        particleRenderer.reset(new ParticleRenderer(particleParam, olicParam.width, olicParam.height));
+        printf("%d particles\n", particleParam.count);
+    } else {
+        olicStream = glContext.createTextureStream(olicParam.width, olicParam.height, olicParam.pixelFormat);
+        printf("OLIC texture stream, %s pixel buffers\n", olicStream->isPersistent() ? "persistent" : "mapped");
+        directOlic = olicStream->isPersistent();
+        for (auto i = 0; directOlic && i < TextureStream::SLOT_NUM; i++) {
+            olicSlots[i] = olicStream->getSlot(i);
+        }
+    }
+    std::unique_ptr<Simulation> simulation(new Simulation("2015031500_ocean.nc", olicParam, particleParam,
+                                                          [&scheduler]() { scheduler.invalidate(); },
+                                                          directOlic ? olicSlots : nullptr));
+    uint64_t particleGeneration = 0;
+    // the simulation step of the last exported frame
+    uint64_t exportGeneration = 0;
+
+    // the program compiled meanwhile, this only waits for what is left of it
+    ShaderProgram* program = glContext.getShaderProgram();
+    auto programId = program->getProgramId();
+    renderer.bindFrameUniforms(programId);
+
+    // samplers and the blend factor never change, set them once
+    glUseProgram(programId);
+    glUniform1i(program->getUniform("myTextureSampler"), 0);
+    glUniform1i(program->getUniform("olicTextureSampler"), 1);
+    // no OLIC or trails until the simulation finished its first frame
+    glUniform1f(program->getUniform("olicBlend"), 0.0f);
+    if (virtualTexture) {
+        virtualTexture->setUniforms(program);
+    } else {
+        glUniform1i(program->getUniform("virtualTextureEnabled"), 0);
     }
 
-    {
-        /*select a time frame tick. 0 - 23*/
-        size_t tick = 1;
+    RenderCommand globe;
+    globe.program = programId;
+    globe.textures[0] = texture;
+    globe.textures[1] = particleRenderer ? particleRenderer->getTexture() : olicStream->getTexture();
+    if (virtualTexture) {
+        globe.textures[VirtualTexture::TABLE_UNIT] = virtualTexture->getPageTable();
+        globe.textures[VirtualTexture::ATLAS_UNIT] = virtualTexture->getAtlas();
+    }
 
-        /*select an attribute.*/
-        std::string attribute_str = var_lists[6];
-        std::cout << "the attribute " << attribute_str << " has been selected" << std::endl;
+    auto lastTime = glContext.getTime();
+    auto lastCpuTime = RenderScheduler::getProcessCpuSeconds();
+    auto firstFrame = true;
+    auto olicShown = false;
+    auto virtualTextureShown = false;
+    auto spaceWasPressed = false;
 
-        /*select an alititude index*/
-        size_t level_index = 4;
+    Controller* controller = Controller::init();
+    controller->setAspectRatio(float(width) / height);
 
-        /*give a GeoArray instance to save the result*/
-        GeoArray<float> U;
+    // set scroll callback
+    if (!glContext.isHeadless()) {
+        glfwSetScrollCallback(glContext.getWindow(), Controller::OnScroll);
+        glfwSetMouseButtonCallback(glContext.getWindow(), Controller::OnMouseButtonEvent);
+    }
 
-        /*read geo grid data from the netcdf file*/
-        nca.getGeoArrayData(U, attribute_str, tick, level_index);
+    std::unique_ptr<FrameExporter> exporter;
+    if (!exportPath.empty()) {
+        exporter.reset(new FrameExporter(exportPath, width, height, Simulation::STEP_RATE));
+    }
 
-        std::cout << "max value = " << U.maxVal_ << std::endl << "min value = " << U.minVal_ << std::endl;
-        std::cout << "latitude count = " << U.latitude_num_ << "; from " << U.latitude_start_ << " to " << U.latitude_end_ << std::endl;
-        std::cout << "longitude count = " << U.longitude_num_ << "; from " << U.longitude_start_ << " to " << U.longitude_end_ << std::endl;
-        std::cout << "data[1][300] = " << U(1, 300) << "; namely, the value of attribute U at (latitude[1] = " << U.latitude_start_ + 1 * U.latitude_interval_
-            << ", longitude[300] = " << U.longitude_start_ + 300 * U.longitude_interval_ << ")" << std::endl;
+    std::unique_ptr<GpuTimerPool> gpuTimers(new GpuTimerPool());
+    std::unique_ptr<ProfilerPanel> profilerPanel;
+    if (!glContext.isHeadless()) {
+        profilerPanel.reset(new ProfilerPanel(width, height));
     }
-}
 
-int main(void) {
-    auto glContext = ApplicationContext::init(ConfigBuilder().windowTitle("OceanCurrents")
-                                                             .fragmentShader("OceanCurrents.frag")
-                                                             .vertexShader("OceanCurrents.vert")
-                                                             .windowHeight(1024)
-                                                             .windowWidth(1024)
-                                                             .color(0.0, 0.0, 0.0, 0.0)
-                                                             .build());
-
-    // get uniforms
-    auto matrixId = glContext.getShaderProgram()->getUniform("MVP");
-    auto viewMatrixId = glContext.getShaderProgram()->getUniform("V");
-    auto modelMatrixId = glContext.getShaderProgram()->getUniform("M");
-    auto texture = ImageLoader::loadBmpAsTexture("color.bmp");
-    auto textureId = glContext.getShaderProgram()->getUniform("myTextureSampler");
-    auto lightId = glContext.getShaderProgram()->getUniform("LightPosition_worldspace");
-
-    ObjectLoader loader = ObjectLoader::loadObj("sphere.obj");
-
-    // populate buffers
-    auto vertexBuffer = glContext.populateBuffer(loader.getVertices());
-    auto uvBuffer = glContext.populateBuffer(loader.getUvs());
-    auto normalBuffer = glContext.populateBuffer(loader.getNormals());
-    auto elementBuffer = glContext.populateElementBuffer(loader.getIndices());
-
-    auto lastTime = glfwGetTime();
-    auto nbFrames = 0;
+    do {
+        scheduler.wait();
+        auto currentTime = glContext.getTime();
+        if (currentTime - lastTime > 1.0) {
+            // the whole time since the last report, which may have been spent asleep
+            auto elapsed = currentTime - lastTime;
+            auto frames = scheduler.getFrameCount();
+            auto cpuTime = RenderScheduler::getProcessCpuSeconds();
+            printf("%f fps, %.1f GL calls/frame, %.1f wakeups/s, CPU %.1f%%, idle %.0f%%", frames / elapsed,
+                   renderer.getCallCount() / double(std::max<uint64_t>(frames, 1)),
+                   scheduler.getWakeupCount() / elapsed, 100.0 * (cpuTime - lastCpuTime) / elapsed,
+                   100.0 * scheduler.getIdleSeconds() / elapsed);
+            renderer.resetCallCount();
+            scheduler.resetStats();
+            double workerIdle = 0.0;
+            uint64_t steals = 0;
+            for (auto i = 0; i < jobs.getWorkerNum(); i++) {
+                JobSystem::WorkerStats stats = jobs.getStats(i);
+                workerIdle += stats.idleSeconds;
+                steals += stats.steals;
+            }
+            printf(", workers idle %.0f%%, %llu steals", 100.0 * workerIdle / (elapsed * jobs.getWorkerNum()),
+                   (unsigned long long)steals);
+            jobs.resetStats();
+            if (olicStream != nullptr && simulation->hasCurrents()) {
+                printf(", OLIC level %d, upload %f ms (fence wait %f ms), %llu simulation frames skipped",
+                       simulation->getDetailLevel(), olicStream->getAverageUploadMs(), olicStream->getAverageWaitMs(),
+                       (unsigned long long)simulation->getSkippedCount());
+                olicStream->resetStats();
+                simulation->resetSkippedCount();
+            } else if (particleRenderer && simulation->hasCurrents()) {
+                printf(", %llu simulation steps skipped", (unsigned long long)simulation->getSkippedCount());
+                simulation->resetSkippedCount();
+            }
+            if (exporter) {
+                printf(", %llu frames exported, capture %f ms", (unsigned long long)exporter->getWrittenCount(),
+                       exporter->getAverageCaptureMs());
+                exporter->resetStats();
+            }
+            printf("\n");
+            lastTime = currentTime;
+            lastCpuTime = cpuTime;
+        }
 
-    Controller* controller = Controller::init();
+        if (!glContext.isHeadless()) {
+            controller->refreshMatrices(glContext.getWindow());
+            auto spacePressed = glfwGetKey(glContext.getWindow(), GLFW_KEY_SPACE) == GLFW_PRESS;
+            if (spacePressed && !spaceWasPressed) {
+                simulation->setPaused(!simulation->isPaused());
+            }
+            spaceWasPressed = spacePressed;
+        }
 
-    // set scroll callback
-    glfwSetScrollCallback(glContext.getWindow(), Controller::OnScroll);
-    glfwSetMouseButtonCallback(glContext.getWindow(), Controller::OnMouseButtonEvent);
+        // the constants are only rebuilt and uploaded when the camera or the model moved
+        if (controller->consumeChanges()) {
+            FrameUniforms uniforms;
+            uniforms.view = controller->getViewMatrix();
+            uniforms.model = controller->getModelMatrix();
+            uniforms.mvp = controller->getProjectionMatrix() * uniforms.view * uniforms.model;
+            uniforms.lightPosition = glm::vec4(4, 4, 4, 0);
+            renderer.setFrameUniforms(uniforms);
+            simulation->setFootprint(controller->getGlobeScreenSize(height));
+            scheduler.invalidate();
+        }
 
-    testNetCDF();
-    
+        // the uploads change the picture. one per frame, so a burst of them does not stall the camera, a new one
+        // wakes the loop through the main wakeup
+        if (jobs.runMainJobs(1) > 0) {
+            scheduler.invalidate();
+        }
+        if (jobs.getMainJobCount() > 0) {
+            scheduler.requestAnimationFrame();
+        }
+        if (virtualTexture) {
+            if (virtualTexture->update(controller->getModelMatrix(), controller->getViewMatrix(),
+                                       controller->getProjectionMatrix(), width, height) > 0) {
+                scheduler.invalidate();
+            }
+            if (virtualTexture->getMissingCount() > 0) {
+                scheduler.requestAnimationFrame();
+            }
+            // the pages are built in the background, switch from the plain texture once they are
+            if (!virtualTextureShown && virtualTexture->isReady()) {
+                glUseProgram(programId);
+                virtualTexture->setUniforms(program);
+                scheduler.invalidate();
+                virtualTextureShown = true;
+            }
+        }
 
-    do {
-        auto currentTime = glfwGetTime();
-        nbFrames++;
-        if (currentTime - lastTime > 1.0) {
-            printf("%f ms/frame\n", 1000.0 / double(nbFrames));
-            nbFrames = 0;
-            lastTime += 1.0;
+        // never waits for the simulation, the globe keeps the previous OLIC frame until a new one is finished. the
+        // simulation invalidated the picture when it finished the frame. a slot written by the simulation goes back
+        // to it with the next frame taken, so that waits until the GPU copied the slot out, without blocking
+        bool slotFree = !directOlic || olicStream->isSlotFree(simulation->getFrameSlot());
+        if (!slotFree) {
+            scheduler.requestAnimationFrame();
+        }
+        if (slotFree && simulation->acquireFrame()) {
+            const std::vector<unsigned char>& frame = simulation->getFrame();
+            ProfileScope uploadScope(PROFILE_UPLOAD);
+            GpuProfileScope gpuUploadScope(*gpuTimers, PROFILE_UPLOAD);
+            if (particleRenderer) {
+                // steps skipped in between lengthen the segments rather than break the trails
+                particleRenderer->update((const float*)frame.data(),
+                                         int(simulation->getFrameGeneration() - particleGeneration));
+                particleGeneration = simulation->getFrameGeneration();
+            } else if (directOlic) {
+                olicStream->commitSlot(simulation->getFrameSlot());
+            } else {
+                memcpy(olicStream->beginFrame(), frame.data(), frame.size());
+                olicStream->commitFrame();
+            }
+            if (!olicShown && (!particleRenderer || particleRenderer->hasTrails())) {
+                glUseProgram(programId);
+                glUniform1f(program->getUniform("olicBlend"), 1.0f);
+                olicShown = true;
+            }
         }
+
+        if (!scheduler.beginFrame()) {
+            continue;
+        }
+        ProfileScope frameScope(PROFILE_FRAME);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        controller->refreshMatrices(glContext.getWindow());
-
-        glUseProgram(glContext.getShaderProgram()->getProgramId());
-
-        auto ProjectionMatrix = controller->getProjectionMatrix();
-        auto ViewMatrix = controller->getViewMatrix();
-        auto ModelMatrix = controller->getModelMatrix();
-        auto MVP = ProjectionMatrix * ViewMatrix * ModelMatrix;
-        glUniformMatrix4fv(matrixId, 1, GL_FALSE, &MVP[0][0]);
-        glUniformMatrix4fv(modelMatrixId, 1, GL_FALSE, &ModelMatrix[0][0]);
-        glUniformMatrix4fv(viewMatrixId, 1, GL_FALSE, &ViewMatrix[0][0]);
-        glm::vec3 lightPos = glm::vec3(4, 4, 4);
-        glUniform3f(lightId, lightPos.x, lightPos.y, lightPos.z);
-        
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_2D, texture);
-        glUniform1i(textureId, 0);
-
-        glEnableVertexAttribArray(0);
-        glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
-        glVertexAttribPointer(
-            0,                  // attribute
-            3,                  // size
-            GL_FLOAT,           // type
-            GL_FALSE,           // normalized?
-            0,                  // stride
-            (void*)0            // array buffer offset
-            );
-
-        // 2nd attribute buffer : UVs
-        glEnableVertexAttribArray(1);
-        glBindBuffer(GL_ARRAY_BUFFER, uvBuffer);
-        glVertexAttribPointer(
-            1,                                // attribute
-            2,                                // size
-            GL_FLOAT,                         // type
-            GL_FALSE,                         // normalized?
-            0,                                // stride
-            (void*)0                          // array buffer offset
-            );
-
-        // 3rd attribute buffer : normals
-        glEnableVertexAttribArray(2);
-        glBindBuffer(GL_ARRAY_BUFFER, normalBuffer);
-        glVertexAttribPointer(
-            2,                                // attribute
-            3,                                // size
-            GL_FLOAT,                         // type
-            GL_FALSE,                         // normalized?
-            0,                                // stride
-            (void*)0                          // array buffer offset
-            );
-
-        // Index buffer
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, elementBuffer);
-
-        // Draw the triangles !
-        glDrawElements(
-            GL_TRIANGLES,      // mode
-            loader.getIndices().size(),    // count
-            GL_UNSIGNED_SHORT,   // type
-            (void*)0           // element array buffer offset
-            );
-
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(1);
-        glDisableVertexAttribArray(2);
+        int lod = controller->getLod();
+        if (!globeJobs[lod]) {
+            auto data = std::make_shared<MeshData>();
+            auto generate = jobs.submit([data, lod]() { *data = SphereGenerator::icosphere(lod); });
+            globeJobs[lod] = jobs.submitMain([&jobs, &renderer, &scheduler, &globeLods, data, lod, generate]() {
+                jobs.wait(generate);
+                globeLods[lod] = renderer.createMesh(*data);
+                scheduler.invalidate();
+            }, {generate});
+        }
+        // the closest level generated so far stands in, only the very first one is waited for
+        int shown = -1;
+        for (auto distance = 0; shown < 0 && distance <= Controller::MAX_LOD; distance++) {
+            if (lod - distance >= 0 && globeLods[lod - distance].vertexArray != 0) {
+                shown = lod - distance;
+            } else if (lod + distance <= Controller::MAX_LOD && globeLods[lod + distance].vertexArray != 0) {
+                shown = lod + distance;
+            }
+        }
+        if (shown < 0) {
+            jobs.wait(globeJobs[lod]);
+            shown = lod;
+        }
+        globe.mesh = globeLods[shown];
+        renderer.submit(globe);
+        {
+            ProfileScope drawScope(PROFILE_DRAW);
+            GpuProfileScope gpuDrawScope(*gpuTimers, PROFILE_DRAW);
+            renderer.flush();
+        }
+        // a frame of the output per simulation step, so it plays at STEP_RATE: a redraw without a new step, e.g. of
+        // the camera, is not exported, the steps the render thread skipped repeat the frame. the globe stands still
+        // without currents, every frame drawn is exported then
+        uint64_t generation = simulation->getFrameGeneration();
+        if (exporter && (generation > exportGeneration || !simulation->hasCurrents())) {
+            ProfileScope exportScope(PROFILE_EXPORT);
+            GpuProfileScope gpuExportScope(*gpuTimers, PROFILE_EXPORT);
+            exporter->capture(int(std::max<uint64_t>(generation - exportGeneration, 1)));
+            exportGeneration = generation;
+        }
+        gpuTimers->collect();
+
+        if (profilerPanel) {
+            profilerPanel->update(currentTime);
+            profilerPanel->draw();
+        }
 
         // Swap buffers
-        glfwSwapBuffers(glContext.getWindow());
-        glfwPollEvents();
-    } while (glfwGetKey(glContext.getWindow(), GLFW_KEY_ESCAPE) != GLFW_PRESS &&
-             glfwWindowShouldClose(glContext.getWindow()) == 0);
+        glContext.swapBuffers();
+        if (firstFrame) {
+            printf("first frame after %f s, default program %s\n", glContext.getTime(),
+                   program->isFromCache() ? "from the binary cache" : "compiled");
+            firstFrame = false;
+        }
+    } while (!glContext.shouldClose());
 
+    if (csvTrace) {
+        profiler.writeCsv(tracePath);
+    } else if (!tracePath.empty()) {
+        profiler.writeChromeTrace(tracePath);
+    }
+    simulation.reset();
+    // the last uploads may still wake the scheduler
+    textureLoader.finalize();
+    jobs.setMainWakeup(nullptr);
+    scheduler.finalize();
+    // the GL objects have to go before the context, the exporter finishes writing the frames in flight
+    if (exporter) {
+        uint64_t frames = exporter->getFrameCount();
+        exporter.reset();
+        printf("%llu frames exported to %s\n", (unsigned long long)frames, exportPath.c_str());
+    }
+    particleRenderer.reset();
+    profilerPanel.reset();
+    gpuTimers.reset();
+    virtualTexture.reset();
+    renderer.finalize();
+    jobs.finalize();
     glContext.finalize();
     return 0;
 }
@@ -4,7 +4,11 @@
  */
 
 #include "olic.hpp"
+#include "colorMap.hpp"
+#include "rng.hpp"
+#include "jobSystem.hpp"
 #include <algorithm>
+#include <string.h>
 
 OlicContext* OlicContext::_instance = nullptr;
 
@@ -17,6 +21,10 @@ OlicContext & OlicContext::init(OlicParam &olicParam, VectorField &field) {
     return *_instance;
 }
 
+OlicContext* OlicContext::create(OlicParam &olicParam, VectorField &field) {
+    return new OlicContext(olicParam, field);
+}
+
 /**
  * @brief constructor for factory method to preduce the singlton. 
  * @param olicParam {@link OlicParam} instance holding vita algorithm parameters
@@ -26,15 +34,53 @@ OlicContext & OlicContext::init(OlicParam &olicParam, VectorField &field) {
  */
 OlicContext::OlicContext(OlicParam &olicParam, VectorField &field) {
     _param = &olicParam;
-    auto size = olicParam.width * olicParam.height;
+    _layout = TileLayout(olicParam.width, olicParam.height);
+    auto size = _layout.getSize();
     // initial: black
-    _sourceTex = std::vector<float>(size, 0.0f);
-    _resultTex = std::vector<float>(size, 0.0f);
-    _hitCounts = std::vector<int>(size, 0);
-    _relateDroplets = std::vector<int>(size, -1);
+    _sourceTex = std::vector<uint8_t>(size, 0);
+    _hitCounts = HitMap(size, olicParam.maxHitNum);
+    _relateDroplets = DropletIdMap(size, _layout.getTileNum());
     _droplets = std::vector<Droplet>();
+    // one intensity map for each phrase of the ramp filter
+    _texCache = std::vector<std::vector<uint8_t>>(2 * olicParam.sideLength + 1);
+    _texDrawn = std::vector<std::vector<uint64_t>>(_texCache.size());
+    _colorLut = defaultColorLut();
+    _intensity = nullptr;
+    _drawn = nullptr;
     _field = &field;
+    _globalOffset = 0;
+    _rampTable = RampFilterTable(olicParam.sideLength);
+    _sampleTexels = std::vector<float>(_rampTable.getSampleLength());
+    _sampleMask = std::vector<float>(_rampTable.getSampleLength());
     buildSourceTexture(olicParam);
+    buildLandPixels();
+}
+
+/**
+ * @brief mark the pixels over land, out of the grid or in the padding of the layout. a tile with no grid cell with
+ * data under it is answered by the blocks of the field's mask, about half of the canvas of a regional domain.
+ */
+void OlicContext::buildLandPixels() {
+    int tilesPerRow = (_param->width + TileLayout::TILE_SIZE - 1) / TileLayout::TILE_SIZE;
+    _landPixels = std::vector<uint64_t>(_layout.getSize() / 64, ~uint64_t(0));
+    // a tile owns its words
+    runBlocks(_layout.getTileNum(), _param->threadNum, [&](int tile) {
+        int x0 = tile % tilesPerRow * TileLayout::TILE_SIZE;
+        int y0 = tile / tilesPerRow * TileLayout::TILE_SIZE;
+        int x1 = std::min(x0 + TileLayout::TILE_SIZE, _param->width);
+        int y1 = std::min(y0 + TileLayout::TILE_SIZE, _param->height);
+        if (!_field->hasValidCells(x0, y0, x1, y1)) {
+            return;
+        }
+        for (auto y = y0; y < y1; y++) {
+            for (auto x = x0; x < x1; x++) {
+                if (_field->isValid(glm::vec2(x, y))) {
+                    size_t index = _layout.index(x, y);
+                    _landPixels[index >> 6] &= ~(uint64_t(1) << (index & 63));
+                }
+            }
+        }
+    });
 }
 
 /**
@@ -46,39 +92,144 @@ OlicContext::OlicContext(OlicParam &olicParam, VectorField &field) {
  * have to be efficient enough. So its a challenge to dig out a perfect algorithm to generate the source
  * texture.
  *
- * but util now, a persudo-random generator method is still adopted. 
+ * but util now, a persudo-random generator method is still adopted. it is counter based and seeded by
+ * {@link OlicParam#seed}, so the droplets only depend on the seed, not on the thread count.
  * TODO: improve the source texture generating strategy.
  */
 void OlicContext::buildSourceTexture(OlicParam& olicParam) {
-    auto size = olicParam.width * olicParam.height;
-    // init the source texture
-    for (auto i = 0; i < size; i++) {
-        if (rand() > 1.0 - olicParam.dropletRate) {
-            int xCoords = i % olicParam.width;
-            int yCoords = int(i / olicParam.width);
-
-            // make sure the droplet is within the canvas
-            if (xCoords < olicParam.width - olicParam.dimPixel &&
-                yCoords < olicParam.height - olicParam.dimPixel) {
-                // store this droplet and give it a random local offset
-                _droplets.push_back(Droplet(xCoords, yCoords, int(rand() * 2 * olicParam.sideLength)));
-                int dropletIndex = _droplets.size() - 1;
-                // set this pixel and the around dim pixels to max intensity
-                for (auto k = 0; k < olicParam.dimPixel; ++k) {
-                    for (auto j = 0; j < olicParam.dimPixel; ++j) {
-                        _sourceTex[(xCoords + k) + (yCoords + j) * olicParam.width] = 1.0f;
-                        // store the pixel's related droplet
-                        _relateDroplets[xCoords + yCoords * olicParam.width] = dropletIndex;
-                    }
+    CounterRng rng(olicParam.seed);
+    // a block is a row of tiles, so two blocks never share a tile of _relateDroplets
+    const int blockHeight = TileLayout::TILE_SIZE;
+    const int blockNum = (olicParam.height + blockHeight - 1) / blockHeight;
+
+    // 1. pick the droplets of each block, every pixel draws its own numbers so the result is the same in any order
+    std::vector<std::vector<Droplet>> blockDroplets(blockNum);
+    runBlocks(blockNum, olicParam.threadNum, [&](int block) {
+        int yEnd = std::min((block + 1) * blockHeight, olicParam.height);
+        for (auto yCoords = block * blockHeight; yCoords < yEnd; yCoords++) {
+            for (auto xCoords = 0; xCoords < olicParam.width; xCoords++) {
+                uint64_t counter = uint64_t(yCoords) * olicParam.width + xCoords;
+                // make sure the droplet is within the canvas, droplets crossing the edge of a globe canvas wrap
+                if (rng.uniform(counter, 0) < olicParam.dropletRate &&
+                    (olicParam.wrapLongitude || xCoords < olicParam.width - olicParam.dimPixel) &&
+                    yCoords < olicParam.height - olicParam.dimPixel) {
+                    // store this droplet and give it a random local offset
+                    int offset = rng.uniformInt(counter, 2 * olicParam.sideLength, 1);
+                    blockDroplets[block].push_back(Droplet(xCoords, yCoords, offset));
+                }
+            }
+        }
+    });
+
+    // 2. droplet indices follow the raster order no matter how the blocks were scheduled
+    for (auto& droplets : blockDroplets) {
+        _droplets.insert(_droplets.end(), droplets.begin(), droplets.end());
+    }
+
+    // 3. each block stamps the rows it owns, including the tails of the droplets starting in the block above.
+    // droplets are visited in index order, so overlapping droplets resolve the same way as a serial pass
+    runBlocks(blockNum, olicParam.threadNum, [&](int block) {
+        int yBegin = block * blockHeight;
+        int yEnd = std::min(yBegin + blockHeight, olicParam.height);
+        auto first = std::lower_bound(_droplets.begin(), _droplets.end(), yBegin - olicParam.dimPixel + 1,
+                                      [](const Droplet& droplet, int y) { return droplet.yPos < y; });
+        for (auto it = first; it != _droplets.end() && it->yPos < yEnd; ++it) {
+            int dropletIndex = int(it - _droplets.begin());
+            // set this pixel and the around dim pixels to max intensity
+            for (auto k = 0; k < olicParam.dimPixel; ++k) {
+                for (auto j = std::max(0, yBegin - it->yPos); j < olicParam.dimPixel && it->yPos + j < yEnd; ++j) {
+                    auto index = _layout.index(wrapX(it->xPos + k), it->yPos + j);
+                    _sourceTex[index] = 1;
+                    // store the pixel's related droplet
+                    _relateDroplets.set(index, dropletIndex);
                 }
             }
         }
+    });
+}
+
+/**
+ * @brief run fn(block) for every block in [0, blockNum), on the calling thread if threadNum is 1 and on the workers
+ * of the JobSystem otherwise.
+ */
+void OlicContext::runBlocks(int blockNum, int threadNum, const std::function<void(int)>& fn) {
+    if (threadNum == 1) {
+        for (auto block = 0; block < blockNum; block++) {
+            fn(block);
+        }
+        return;
+    }
+    JobSystem::init().parallelFor(0, blockNum, 1, [&fn](int first, int last) {
+        for (auto block = first; block < last; block++) {
+            fn(block);
+        }
+    });
+}
+
+void OlicContext::setColorLut(const std::vector<glm::u8vec4>& lut) {
+    assert(lut.size() == COLOR_LUT_SIZE);
+    _colorLut = lut;
+    for (auto i = 0; i < int(_texCache.size()); i++) {
+        _texCache[i].clear();
+        _texDrawn[i].clear();
+    }
+    _texelBase.clear();
+}
+
+void OlicContext::refreshOLIC(unsigned char* output) {
+    int width = _param->width;
+    size_t pixelNum = size_t(width) * _param->height;
+    int baseBytes = getBytesPerPixel() - 1;
+    std::vector<uint8_t>& cached = _texCache[_globalOffset];
+    std::vector<uint64_t>& drawn = _texDrawn[_globalOffset];
+    if (cached.empty()) {
+        // calculate into the cache, the output may be mapped GPU memory which is slow to scatter into or read back
+        if (_texelBase.empty()) {
+            _texelBase.assign(pixelNum * baseBytes, 0);
+        }
+        cached.resize(pixelNum);
+        drawn.resize((pixelNum + 63) / 64);
+        _intensity = cached.data();
+        _drawn = drawn.data();
+        calculateOLIC();
+        _intensity = nullptr;
+        _drawn = nullptr;
     }
+
+    /* join the intensity of the phrase with the bytes all the phrases share, every row is written front to back.
+     * a phrase may not draw every pixel another one draws, its undrawn pixels stay transparent black
+     */
+    const uint8_t* intensity = cached.data();
+    const uint64_t* drawnBits = drawn.data();
+    const uint8_t* base = _texelBase.data();
+    bool rgba = _param->pixelFormat == OLIC_PIXEL_RGBA8;
+    JobSystem::init().parallelFor(0, _param->height, JobSystem::rowGrain(width), [&](int first, int last) {
+        for (auto i = size_t(first) * width; i < size_t(last) * width; i++) {
+            if (((drawnBits[i >> 6] >> (i & 63)) & 1) == 0) {
+                memset(output + i * (baseBytes + 1), 0, baseBytes + 1);
+            } else if (rgba) {
+                unsigned char* texel = output + i * 4;
+                texel[0] = base[i * 3];
+                texel[1] = base[i * 3 + 1];
+                texel[2] = base[i * 3 + 2];
+                texel[3] = intensity[i];
+            } else {
+                output[i * 2] = intensity[i];
+                output[i * 2 + 1] = base[i];
+            }
+        }
+    });
+    _globalOffset = (_globalOffset + 1) % _texCache.size();
 }
 
 void OlicContext::calculateOLIC() {
+    // pixels no streamline passes through stay transparent black
+    memset(_intensity, 0, size_t(_param->width) * _param->height);
+    memset(_drawn, 0, (size_t(_param->width) * _param->height + 63) / 64 * sizeof(uint64_t));
+    _hitCounts.clear();
+
     int halfWidth = _param->width / 2;
-    int halfHeight = _param->width / 2;
+    int halfHeight = _param->height / 2;
 
     /* OLIC only allow one pixel be colored once, so if we scan points from upper to bottom, the streamline will be 
      * will be clusterd in the upper left of the canvas, which is inhomogeneous.
@@ -92,14 +243,16 @@ void OlicContext::calculateOLIC() {
         points.push_back(std::pair<int, int>(i % halfWidth, i / halfWidth + halfHeight));
         points.push_back(std::pair<int, int>(i % halfWidth + halfWidth, i / halfWidth + halfHeight));
 
-        // for the point that has not hitted yet, calculate steamline and convolve to get final result
+        // for the point that has not hitted yet, calculate steamline and convolve to get final result. the pixels
+        // over land stay transparent
         for (std::pair<int, int> point : points) {
-            if (getHitCount(point) < _param->maxHitNum) {
+            if (!isLand(point) && getHitCount(point) < _param->maxHitNum) {
                 StreamLine* streamLine = this->calculateStreamLine(point);
                 if (streamLine != nullptr) {
                     convolve(streamLine);
+                    delete streamLine;
                 }
-                _hitCounts[point.first + point.second * _param->width]++;
+                _hitCounts.hit(pixelIndex(point));
             }
         }
     }
@@ -111,24 +264,33 @@ StreamLine* OlicContext::calculateStreamLine(std::pair<int, int> point) {
     glm::vec2 currentFoward(point.first, point.second);
     glm::vec2 currentBackward(point.first, point.second);
     int hittedDropletIndex = -1;
+    bool fowardStopped = false;
+    bool backwardStopped = false;
 
-    // calculate forward integral and backward integral
+    // calculate forward integral and backward integral. a side ends where the point stops moving, such as over land
+    // with no current, the points left repeat it without integrating any further
     for (auto i = 0; i < _param->sideLength; i++) {
-        glm::vec2 nextFoward = _field->RKIntergral(currentFoward, _param->integralStep);
-        fowardPoints[i] = nextFoward;
-        currentFoward = nextFoward;
+        if (!fowardStopped) {
+            glm::vec2 nextFoward = _field->RKIntergral(currentFoward, _param->integralStep);
+            fowardStopped = nextFoward == currentFoward;
+            currentFoward = nextFoward;
+        }
+        fowardPoints[i] = currentFoward;
 
-        glm::vec2 nextBackward = _field->RKIntergral(currentBackward, -_param->integralStep);
-        backwardPoints[i] = nextBackward;
-        currentBackward = nextBackward;
+        if (!backwardStopped) {
+            glm::vec2 nextBackward = _field->RKIntergral(currentBackward, -_param->integralStep);
+            backwardStopped = nextBackward == currentBackward;
+            currentBackward = nextBackward;
+        }
+        backwardPoints[i] = currentBackward;
 
         if (hittedDropletIndex < 0) {
-            int m = getRelateDropletIndex(currentFoward);
-            int n = getRelateDropletIndex(currentBackward);
-            if (n > 0) {
+            int m = isInclude(currentFoward) ? getRelateDropletIndex(currentFoward) : -1;
+            int n = isInclude(currentBackward) ? getRelateDropletIndex(currentBackward) : -1;
+            if (n >= 0) {
                 hittedDropletIndex = n;
             }
-            if (m > 0) {
+            if (m >= 0) {
                 hittedDropletIndex = m;
             }
         }
@@ -138,36 +300,113 @@ StreamLine* OlicContext::calculateStreamLine(std::pair<int, int> point) {
     if (hittedDropletIndex < 0 && getRelateDropletIndex(point) < 0) {
         return nullptr;
     }
-    // reverse the backward points to get the correct order
-    std::reverse(backwardPoints.begin(), backwardPoints.end());
-    backwardPoints.resize(2 * _param->sideLength);
-    backwardPoints.insert(backwardPoints.end(), fowardPoints.begin(), fowardPoints.end());
+    // the reversed backward points, the point itself and the forward points, so the point is in the middle
+    StreamLine* streamLine = new StreamLine();
+    streamLine->points.reserve(2 * _param->sideLength + 1);
+    streamLine->points.assign(backwardPoints.rbegin(), backwardPoints.rend());
+    streamLine->points.push_back(glm::vec2(point.first, point.second));
+    streamLine->points.insert(streamLine->points.end(), fowardPoints.begin(), fowardPoints.end());
+    streamLine->length = streamLine->points.size();
 
     // record the droplet info for this pixel
     if (getRelateDropletIndex(point) < 0) {
-        _relateDroplets[point.first + point.second * 2] = hittedDropletIndex;
+        _relateDroplets.set(pixelIndex(point), hittedDropletIndex);
     }
-    StreamLine* streamLine = new StreamLine();
-    streamLine->points = backwardPoints;
-    streamLine->length = backwardPoints.size();
     return streamLine;
 }
 
+bool OlicContext::gatherSamples(StreamLine *streamLine, float *texels, float *mask) const {
+    bool complete = true;
+    for (auto i = 0; i < streamLine->length; i++) {
+        auto currentPoint = streamLine->points[i];
+        if (isInclude(currentPoint)) {
+            texels[i] = getSourceTexel(currentPoint);
+            mask[i] = 1.0f;
+        } else {
+            texels[i] = 0.0f;
+            mask[i] = 0.0f;
+            complete = false;
+        }
+    }
+    return complete;
+}
+
+const float* OlicContext::getRampWeights(StreamLine *streamLine) const {
+    auto midPoint = streamLine->points[streamLine->length / 2];
+    return _rampTable.getWeights(getRelateDroplet(midPoint).offset + _globalOffset);
+}
+
+void OlicContext::finishConvolve(StreamLine *streamLine, float intensity, float acum) {
+    if (acum > 0.0f) {
+        auto midPoint = streamLine->points[streamLine->length / 2];
+        int index = int(round(midPoint.x)) + int(round(midPoint.y)) * _param->width;
+        writeTexel(index, intensity / acum, _field->getNormalizedMagnitude(midPoint));
+    }
+}
+
+template <int SideLength>
+void OlicContext::convolveFixed(StreamLine *streamLine) {
+    const int sampleLength = 2 * SideLength + 1;
+    float texels[sampleLength];
+    float mask[sampleLength];
+    bool complete = gatherSamples(streamLine, texels, mask);
+    const float* weights = getRampWeights(streamLine);
+    float intensity = weightedSum<sampleLength>(texels, weights);
+    // the table weights sum to 1, only the streamlines leaving the canvas need their weights accumulated
+    float acum = complete ? 1.0f : weightedSum<sampleLength>(mask, weights);
+    finishConvolve(streamLine, intensity, acum);
+}
+
 /**
  * @brief convolve the streamline to get the final intensity of those points.
+ *
+ * the common side lengths are dispatched to convolveFixed, the others share the same weight table but loop over
+ * a runtime length.
  */
 void OlicContext::convolve(StreamLine *streamLine) {
-    int mid = streamLine->length / 2;
-    auto midPoint = streamLine->points[mid];
-    float intensity = 0.0f;
-    float acum = 0.0f;
-    for (auto i = -_param->sideLength; i <= _param->sideLength; i++) {
-        auto currentPoint = streamLine->points[mid + i];
-        if (isInclude(currentPoint)) {
-            float filterWeight = RampFilter(mid + i, getRelateDroplet(midPoint).offset, streamLine->length);
-            intensity += getSourceTexel(currentPoint) * filterWeight;
-            acum += filterWeight;
-        }
+    switch (_param->sideLength) {
+    case 10:
+        convolveFixed<10>(streamLine);
+        return;
+    case 20:
+        convolveFixed<20>(streamLine);
+        return;
+    case 30:
+        convolveFixed<30>(streamLine);
+        return;
+    case 50:
+        convolveFixed<50>(streamLine);
+        return;
+    case 100:
+        convolveFixed<100>(streamLine);
+        return;
+    default:
+        break;
+    }
+    int sampleLength = _rampTable.getSampleLength();
+    bool complete = gatherSamples(streamLine, _sampleTexels.data(), _sampleMask.data());
+    const float* weights = getRampWeights(streamLine);
+    float intensity = weightedSum(_sampleTexels.data(), weights, sampleLength);
+    float acum = complete ? 1.0f : weightedSum(_sampleMask.data(), weights, sampleLength);
+    finishConvolve(streamLine, intensity, acum);
+}
+
+/**
+ * @brief fused output stage: the intensity goes to the map of the phrase as a byte, no float texture in between.
+ *
+ * the other bytes of the texel do not depend on the phrase, every phrase writes the same ones to _texelBase.
+ */
+void OlicContext::writeTexel(int index, float intensity, float magnitude) {
+    _intensity[index] = (uint8_t)(std::min(std::max(intensity, 0.0f), 1.0f) * 255.0f + 0.5f);
+    _drawn[index >> 6] |= uint64_t(1) << (index & 63);
+    unsigned char magnitudeByte = (unsigned char)(magnitude * 255.0f + 0.5f);
+    if (_param->pixelFormat == OLIC_PIXEL_RGBA8) {
+        const glm::u8vec4& color = _colorLut[magnitudeByte * (COLOR_LUT_SIZE - 1) / 255];
+        uint8_t* base = &_texelBase[size_t(index) * 3];
+        base[0] = color.r;
+        base[1] = color.g;
+        base[2] = color.b;
+    } else {
+        _texelBase[index] = magnitudeByte;
     }
-    _resultTex[round(midPoint).x + round(midPoint).y * _param->width] = intensity / acum;
 }
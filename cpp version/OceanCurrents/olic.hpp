@@ -8,8 +8,20 @@
 
 #include <stdlib.h>
 #include <vector>
+#include <functional>
 #include <glm/glm.hpp>
+#include <glm/gtc/type_precision.hpp>
 #include "vectorField.hpp"
+#include "rampFilter.hpp"
+#include "pixelMap.hpp"
+
+// layout of the texels written by OlicContext::refreshOLIC, the value is the bytes per pixel
+enum OlicPixelFormat {
+    // color from the velocity magnitude LUT in RGB, OLIC intensity in A
+    OLIC_PIXEL_RGBA8 = 4,
+    // OLIC intensity in R, normalized velocity magnitude in G, color mapping is left to the shader
+    OLIC_PIXEL_RG8 = 2
+};
 
 struct OlicParam {
     // the forward or backward sample length in LIC, cooresponding to the notation 'L' in paper
@@ -31,6 +43,21 @@ struct OlicParam {
     int width = 1024;
 
     int height = 1024;
+
+    // the ouput texel layout
+    OlicPixelFormat pixelFormat = OLIC_PIXEL_RGBA8;
+
+    // seed of the droplets generator, the same seed always gives the same droplets
+    unsigned int seed = 20150315;
+
+    // 1 generates the droplets on the calling thread, any other value on the workers of the JobSystem
+    int threadNum = 0;
+
+    /* the canvas is the equirectangular texture of the whole globe: x is periodic, streamlines and droplets
+     * crossing +-180 degrees continue on the other side. pair it with a VectorField built on a globe canvas,
+     * which scales the steps by latitude.
+     */
+    bool wrapLongitude = false;
 };
 
 struct Droplet {
@@ -56,6 +83,9 @@ class OlicContext {
 public:
     // static factory method that create or offer olicContext instance
     static OlicContext& init(OlicParam &olicParam, VectorField &field);
+
+    // create a context independent of the singleton, e.g. one per frame of a batch. the caller deletes it
+    static OlicContext* create(OlicParam &olicParam, VectorField &field);
     
     
     // judge if the given point located in canvas
@@ -63,7 +93,8 @@ public:
         return isInclude(std::pair<int, int>(round(point.x), round(point.y)));
     }
     bool isInclude(std::pair<int, int> point) const {
-        return point.first >= 0 && point.first < _param->width && point.second >= 0 && point.second < _param->height;
+        return (_param->wrapLongitude || (point.first >= 0 && point.first < _param->width)) &&
+               point.second >= 0 && point.second < _param->height;
     }
 
     // get the texel of the source texture in the given point
@@ -71,14 +102,14 @@ public:
         return getSourceTexel(std::pair<int, int>(round(point.x), round(point.y)));
     }
     float getSourceTexel(std::pair<int, int> point) const {
-        return _sourceTex[point.first + _param->width * point.second];
+        return _sourceTex[pixelIndex(point)];
     }
 
     Droplet getRelateDroplet(glm::vec2 point) const {
         return getRelateDroplet(std::pair<int, int>(round(point.x), round(point.y)));
     }
     Droplet getRelateDroplet(std::pair<int, int> point) const {
-        int index =  _relateDroplets[point.first + _param->width * point.second];
+        int index = _relateDroplets.get(pixelIndex(point));
         return _droplets[index];
     }
 
@@ -86,54 +117,126 @@ public:
         return getRelateDropletIndex(std::pair<int, int>(round(point.x), round(point.y)));
     }
     int getRelateDropletIndex(std::pair<int, int> point) const {
-        return _relateDroplets[point.first + _param->width * point.second];
+        return _relateDroplets.get(pixelIndex(point));
     }
 
     int getHitCount(std::pair<int, int> point) const {
-        return _hitCounts[point.first + _param->width * point.second];
+        return _hitCounts.get(pixelIndex(point));
     }
 
+    int getBytesPerPixel() const {
+        return _param->pixelFormat;
+    }
+
+    // bytes of a whole output texture, the buffer passed to refreshOLIC must hold at least this much
+    size_t getOutputSize() const {
+        return size_t(_param->width) * _param->height * getBytesPerPixel();
+    }
+
+    // replace the velocity magnitude LUT, only used by OLIC_PIXEL_RGBA8, drops the cached textures
+    void setColorLut(const std::vector<glm::u8vec4>& lut);
+
     /**
-     * @brief refresh and return the OLIC texture every frame
+     * @brief refresh the OLIC texture every frame and write it to the given upload-ready buffer
      *
      * this method will check the cache for the certain phrase, if the cooresponding texture has not been calculated,
-     * calcalate it and store it in the cache.
+     * calcalate it into the cache. the cache keeps a byte per pixel and phrase, the texels are assembled while
+     * copying out. the output rows are only written sequentially, so it can be mapped GPU memory.
+     *
+     * @param output row-major texels in the {@link OlicParam#pixelFormat} layout, see getOutputSize()
      */
-    std::vector<glm::vec4> & refreshOLIC();
+    void refreshOLIC(unsigned char* output);
 
 private:
     // the singleton instance
     static OlicContext* _instance;
     // olic algo parameters instance
     OlicParam* _param;
-    // the low frequency texture map
-    std::vector<float> _sourceTex;
-    // the result texture
-    std::vector<float> _resultTex;
+    // tiled layout shared by all the per-pixel maps below
+    TileLayout _layout;
+    // the low frequency texture map, 0 or 1 for each pixel
+    std::vector<uint8_t> _sourceTex;
+    // a bit per pixel in the tiled layout, set over land and out of the grid, a tile is TILE_PIXELS / 64 words
+    std::vector<uint64_t> _landPixels;
     // count how many times a pixel is calculated
-    std::vector<int> _hitCounts;
+    HitMap _hitCounts;
     // record all droplets
     std::vector<Droplet> _droplets;
     // record the index of responsibel droplet for each piexl
-    std::vector<int> _relateDroplets;
-    // cache for the cycle animation textures
-    std::vector<std::vector<glm::vec4>> _texCache;
+    DropletIdMap _relateDroplets;
+    // cache for the cycle animation textures, the OLIC intensity of every phrase as a row-major byte per pixel
+    std::vector<std::vector<uint8_t>> _texCache;
+    // a bit per pixel and phrase, set where the phrase drew the pixel
+    std::vector<std::vector<uint64_t>> _texDrawn;
+    // the other bytes of every texel, the LUT color or the magnitude, the same for all the phrases
+    std::vector<uint8_t> _texelBase;
+    // velocity magnitude to color look up table
+    std::vector<glm::u8vec4> _colorLut;
+    // the intensity map being calculated, set by refreshOLIC
+    uint8_t* _intensity;
+    uint64_t* _drawn;
     // the vector field instance
     VectorField* _field;
     // global offset of ramp filter, change it to shift all the ramp filters.
     int _globalOffset;
+    // normalized ramp filter weights for every phrase of the current side length
+    RampFilterTable _rampTable;
+    // per streamline scratch of the runtime length convolution
+    std::vector<float> _sampleTexels;
+    std::vector<float> _sampleMask;
 
     explicit OlicContext(OlicParam& olicParam, VectorField& field);
 
+    // map x back into the canvas when the longitude wraps, identity otherwise
+    int wrapX(int x) const {
+        if (!_param->wrapLongitude) {
+            return x;
+        }
+        x %= _param->width;
+        return x < 0 ? x + _param->width : x;
+    }
+
+    // index of the point in the per-pixel maps
+    size_t pixelIndex(std::pair<int, int> point) const {
+        return _layout.index(wrapX(point.first), point.second);
+    }
+
     void buildSourceTexture(OlicParam& olicParam);
 
+    void buildLandPixels();
+
+    // the pixel is over land or out of the grid, no streamline starts there. the point is in the canvas
+    bool isLand(std::pair<int, int> point) const {
+        size_t index = pixelIndex(point);
+        return ((_landPixels[index >> 6] >> (index & 63)) & 1) != 0;
+    }
+
+    static void runBlocks(int blockNum, int threadNum, const std::function<void(int)>& fn);
+
     void calculateOLIC();
 
     StreamLine* calculateStreamLine(std::pair<int, int> point);
 
     void convolve(StreamLine* streamLine);
 
-    float RampFilter(int pos, int localOffset, int sampleLength);
+    // convolution with the side length fixed at compile time, see convolve for the specialized values
+    template <int SideLength>
+    void convolveFixed(StreamLine* streamLine);
+
+    /**
+     * gather the source texels along the streamline, mask is 1 for samples inside the canvas and 0 otherwise
+     * @return true if all the samples are inside the canvas
+     */
+    bool gatherSamples(StreamLine* streamLine, float* texels, float* mask) const;
+
+    // ramp filter weights of the streamline, decided by its droplet's local offset and the global offset
+    const float* getRampWeights(StreamLine* streamLine) const;
+
+    // normalize the convolution result and write it to the texel of the streamline's middle point
+    void finishConvolve(StreamLine* streamLine, float intensity, float acum);
+
+    // pack the intensity and the velocity magnitude of a pixel into the output texture
+    void writeTexel(int index, float intensity, float magnitude);
 };
 
 #endif
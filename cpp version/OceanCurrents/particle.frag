@@ -0,0 +1,10 @@
+#version 330 core
+
+in vec3 color;
+
+// velocity magnitude color in rgb, trail intensity in a, as the OLIC texture
+out vec4 trail;
+
+void main(){
+	trail = vec4(color, 1.0);
+}
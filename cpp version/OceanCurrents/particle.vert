@@ -0,0 +1,25 @@
+#version 330 core
+
+// two consecutive states of one particle: x and y in canvas pixels, age in steps, normalized magnitude
+layout(location = 0) in vec4 previousState;
+layout(location = 1) in vec4 currentState;
+
+// the canvas of the particles, also the size of the trails texture
+uniform vec2 canvasSize;
+// simulation steps between the two states
+uniform float steps;
+uniform sampler2D colorLutSampler;
+
+out vec3 color;
+
+void main(){
+	vec4 state = gl_VertexID == 0 ? previousState : currentState;
+	// a particle respawned in between, or wrapping around the longitude, has no segment: both ends are clipped
+	if (currentState.z != previousState.z + steps || abs(currentState.x - previousState.x) > canvasSize.x * 0.5) {
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+	} else {
+		// canvas pixel x covers [x, x + 1) of the texture
+		gl_Position = vec4((state.xy + 0.5) / canvasSize * 2.0 - 1.0, 0.0, 1.0);
+	}
+	color = textureLod(colorLutSampler, vec2(currentState.w, 0.5), 0.0).rgb;
+}
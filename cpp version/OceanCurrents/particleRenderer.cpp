@@ -0,0 +1,177 @@
+/**
+ * draws the particle trails into a texture of the globe canvas, shown on the globe in place of the OLIC texture.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "particleRenderer.hpp"
+#include <string.h>
+#include <stdexcept>
+#include <vector>
+
+#include "colorMap.hpp"
+
+ParticleRenderer::ParticleRenderer(const ParticleParam& param, int width, int height)
+    : _param(param), _width(width), _height(height),
+      _slotSize(size_t(param.count) * ParticleSystem::VERTEX_FLOATS * sizeof(float)), _mapped(nullptr),
+      _previous(-1), _drawn(false) {
+    for (auto i = 0; i < SLOT_NUM; i++) {
+        _fences[i] = 0;
+    }
+
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // the canvas wraps around the longitude
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    GLint previousFramebuffer;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &_framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, _texture, 0);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        throw std::runtime_error("ParticleRenderer - ParticleRenderer, incomplete trails framebuffer");
+    }
+    const GLfloat transparent[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    glClearBufferfv(GL_COLOR, 0, transparent);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    std::vector<glm::u8vec4> lut = defaultColorLut();
+    glGenTextures(1, &_colorLut);
+    glBindTexture(GL_TEXTURE_2D, _colorLut);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, COLOR_LUT_SIZE, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, lut.data());
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+
+    GLint previousVertexArray;
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+    glGenVertexArrays(1, &_vertexArray);
+    glBindVertexArray(_vertexArray);
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    _persistent = GLEW_ARB_buffer_storage != 0;
+    if (_persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_ARRAY_BUFFER, _slotSize * SLOT_NUM, nullptr, flags);
+        _mapped = (unsigned char*)glMapBufferRange(GL_ARRAY_BUFFER, 0, _slotSize * SLOT_NUM, flags);
+        if (_mapped == nullptr) {
+            throw std::runtime_error("ParticleRenderer - ParticleRenderer, cannot map the particle buffer");
+        }
+    } else {
+        glBufferData(GL_ARRAY_BUFFER, _slotSize * SLOT_NUM, nullptr, GL_STREAM_DRAW);
+    }
+    // one segment per instance, both of its vertices read the same two states
+    for (GLuint attribute = 0; attribute < 2; attribute++) {
+        glEnableVertexAttribArray(attribute);
+        glVertexAttribDivisor(attribute, 1);
+    }
+    glBindVertexArray(previousVertexArray);
+
+    auto& registry = ShaderRegistry::init();
+    _lineProgram = registry.load("particleTrails", "particle.vert", "particle.frag");
+    _fadeProgram = registry.load("trailFade", "trailFade.vert", "trailFade.frag");
+}
+
+ParticleRenderer::~ParticleRenderer() {
+    for (auto i = 0; i < SLOT_NUM; i++) {
+        if (_fences[i] != 0) {
+            glDeleteSync(_fences[i]);
+        }
+    }
+    if (_persistent) {
+        glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+    glDeleteBuffers(1, &_buffer);
+    glDeleteVertexArrays(1, &_vertexArray);
+    glDeleteFramebuffers(1, &_framebuffer);
+    glDeleteTextures(1, &_colorLut);
+    glDeleteTextures(1, &_texture);
+}
+
+void ParticleRenderer::update(const float* vertices, int steps) {
+    int slot = (_previous + 1) % SLOT_NUM;
+    GLsync& fence = _fences[slot];
+    if (fence != 0) {
+        // flush on the first try, otherwise the fence may never be submitted and the wait never ends
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED) {
+            flags = 0;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+
+    size_t offset = _slotSize * slot;
+    glBindBuffer(GL_ARRAY_BUFFER, _buffer);
+    if (_persistent) {
+        memcpy(_mapped + offset, vertices, _slotSize);
+    } else {
+        // the fence already guarantees the GPU is done with the slot, so the driver need not synchronize
+        void* mapped = glMapBufferRange(GL_ARRAY_BUFFER, offset, _slotSize,
+            GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+        if (mapped == nullptr) {
+            throw std::runtime_error("ParticleRenderer - update, cannot map the particle buffer");
+        }
+        memcpy(mapped, vertices, _slotSize);
+        glUnmapBuffer(GL_ARRAY_BUFFER);
+    }
+
+    int previous = _previous;
+    _previous = slot;
+    if (previous < 0) {
+        // the first states, no segment yet
+        return;
+    }
+
+    GLint previousFramebuffer, previousProgram, previousVertexArray, viewport[4];
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGetIntegerv(GL_CURRENT_PROGRAM, &previousProgram);
+    glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &previousVertexArray);
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLboolean blend = glIsEnabled(GL_BLEND);
+    glBindFramebuffer(GL_FRAMEBUFFER, _framebuffer);
+    glViewport(0, 0, _width, _height);
+    glBindVertexArray(_vertexArray);
+
+    // intensity = intensity * fade - 1 / 255, the colors stay
+    glEnable(GL_BLEND);
+    glBlendEquationSeparate(GL_FUNC_ADD, GL_FUNC_REVERSE_SUBTRACT);
+    glBlendFuncSeparate(GL_ZERO, GL_ONE, GL_ONE, GL_CONSTANT_ALPHA);
+    glBlendColor(0.0f, 0.0f, 0.0f, _param.fade);
+    glUseProgram(_fadeProgram->getProgramId());
+    glDrawArrays(GL_TRIANGLES, 0, 3);
+    glBlendEquation(GL_FUNC_ADD);
+    glDisable(GL_BLEND);
+
+    // the new segments replace what is below them
+    GLuint lineProgram = _lineProgram->getProgramId();
+    glUseProgram(lineProgram);
+    glUniform2f(_lineProgram->getUniform("canvasSize"), float(_width), float(_height));
+    glUniform1f(_lineProgram->getUniform("steps"), float(steps));
+    glUniform1i(_lineProgram->getUniform("colorLutSampler"), 0);
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, _colorLut);
+    glVertexAttribPointer(0, 4, GL_FLOAT, GL_FALSE, 0, (void*)(_slotSize * previous));
+    glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 0, (void*)offset);
+    glDrawArraysInstanced(GL_LINES, 0, 2, _param.count);
+    // the previous slot is not read any more after this draw
+    _fences[previous] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    _drawn = true;
+
+    if (blend) {
+        glEnable(GL_BLEND);
+    }
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glBindVertexArray(previousVertexArray);
+    glUseProgram(previousProgram);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
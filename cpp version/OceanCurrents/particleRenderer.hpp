@@ -0,0 +1,76 @@
+/**
+ * draws the particle trails into a texture of the globe canvas, shown on the globe in place of the OLIC texture.
+ *
+ * every step the trails fade a little and each particle adds the segment from its previous position to the new
+ * one. the particle states are streamed into a ring of slots of one vertex buffer, the segments are one instanced
+ * draw of lines reading two consecutive slots, so the CPU never builds the line vertices.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef PARTICLE_RENDERER_HPP
+#define PARTICLE_RENDERER_HPP
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+#include "particles.hpp"
+#include "utils/shaderProgram.hpp"
+
+class ParticleRenderer {
+public:
+    /**
+     * slots of the ring: the one written, the two read by the last draw as previous and current states, and one
+     * more so the CPU does not wait for the draw before
+     */
+    static const int SLOT_NUM = 4;
+
+    // the trails texture is width x height, the canvas of the particles
+    ParticleRenderer(const ParticleParam& param, int width, int height);
+
+    ~ParticleRenderer();
+
+    /**
+     * @brief add the segments from the previous states to these ones and fade the older trails.
+     *
+     * restores the framebuffer, viewport, program and vertex array it changes. the texture is left bound to the
+     * active unit.
+     *
+     * @param vertices ParticleSystem::VERTEX_FLOATS floats per particle, as written by ParticleSystem::step
+     * @param steps simulation steps since the previous states, more than 1 if some were skipped
+     */
+    void update(const float* vertices, int steps);
+
+    GLuint getTexture() const { return _texture; }
+
+    // a step was drawn, the texture is not empty
+    bool hasTrails() const { return _drawn; }
+
+private:
+    ParticleParam _param;
+    int _width;
+    int _height;
+    size_t _slotSize;
+    bool _persistent;
+
+    GLuint _texture;
+    GLuint _framebuffer;
+    GLuint _colorLut;
+
+    GLuint _buffer;
+    GLuint _vertexArray;
+    unsigned char* _mapped;
+    // set after the last draw reading the slot
+    GLsync _fences[SLOT_NUM];
+    // the slot of the previous states, -1 before the first update
+    int _previous;
+    bool _drawn;
+
+    ShaderProgram* _lineProgram;
+    ShaderProgram* _fadeProgram;
+
+    // forbid copying, the GL objects are owned
+    ParticleRenderer(const ParticleRenderer&);
+    ParticleRenderer& operator=(const ParticleRenderer&);
+};
+
+#endif
@@ -0,0 +1,95 @@
+/* particles drifting with the currents, as the animation of the JS viewer
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "particles.hpp"
+#include <algorithm>
+#include <math.h>
+#include <glm/glm.hpp>
+
+#include "jobSystem.hpp"
+
+// draws on land before a respawn gives up and waits for the next step, as field.randomize of the JS viewer
+static const int MAX_SPAWN_TRIES = 30;
+
+ParticleSystem::ParticleSystem(const ParticleParam& param, VectorField& field, int width, int height)
+    : _param(param), _width(width), _height(height), _rng(param.seed), _stepNum(0),
+      _samples(size_t(width) * height), _x(param.count), _y(param.count), _age(param.count) {
+    _stepScale = field.getMaxMagnitude() > 0.0f ? _param.maxStep / field.getMaxMagnitude() : 0.0f;
+    auto& jobs = JobSystem::init();
+    // square tiles, the neighbouring pixels of a tile read neighbouring cells of the grid
+    jobs.parallelFor2d(width, height, 64, 64, [this, &field](int x0, int y0, int x1, int y1) {
+        for (auto y = y0; y < y1; y++) {
+            for (auto x = x0; x < x1; x++) {
+                FieldSample& sample = _samples[size_t(y) * _width + x];
+                glm::vec2 vector = field.getVector(std::pair<int, int>(x, y));
+                sample.x = vector.x;
+                sample.y = vector.y;
+                sample.magnitude = field.getNormalizedMagnitude(glm::vec2(x, y));
+            }
+        }
+    });
+
+    int chunkNum = (_param.count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    jobs.parallelFor(0, chunkNum, 1, [this](int first, int last) {
+        int end = std::min(last * CHUNK_SIZE, _param.count);
+        for (auto i = first * CHUNK_SIZE; i < end; i++) {
+            respawn(i);
+            _age[i] = float(_rng.uniformInt(uint64_t(i), _param.maxAge, 2));
+        }
+    });
+}
+
+void ParticleSystem::respawn(int i) {
+    /* the particles of a chunk respawn in their own latitude band, so the thread advecting the chunk reads a small
+     * part of the samples instead of missing the cache on every particle. the bands cover areas of the sphere in
+     * proportion to the chunk sizes, which keeps the particles even over the sphere.
+     */
+    int first = i / CHUNK_SIZE * CHUNK_SIZE;
+    int chunkSize = std::min(CHUNK_SIZE, _param.count - first);
+    for (auto tries = 0; tries < MAX_SPAWN_TRIES; tries++) {
+        uint64_t counter = (_stepNum * MAX_SPAWN_TRIES + tries) * uint64_t(_param.count) + i;
+        // the sine of the latitude is uniform, not the latitude
+        float band = (first + _rng.uniform(counter, 1) * chunkSize) / _param.count;
+        float latitude = asin(2.0f * band - 1.0f);
+        _x[i] = _rng.uniform(counter, 0) * _width;
+        _y[i] = std::min(std::max((latitude / float(M_PI) + 0.5f) * _height - 0.5f, 0.0f), float(_height - 1));
+        const FieldSample& field = sample(_x[i], _y[i]);
+        if (field.x != 0.0f || field.y != 0.0f) {
+            break;
+        }
+    }
+    _age[i] = 0.0f;
+}
+
+void ParticleSystem::step(float* output) {
+    int chunkNum = (_param.count + CHUNK_SIZE - 1) / CHUNK_SIZE;
+    JobSystem::init().parallelFor(0, chunkNum, 1, [this, output](int first, int last) {
+        int end = std::min(last * CHUNK_SIZE, _param.count);
+        float* vertex = output + size_t(first) * CHUNK_SIZE * VERTEX_FLOATS;
+        for (auto i = first * CHUNK_SIZE; i < end; i++, vertex += VERTEX_FLOATS) {
+            if (_age[i] >= _param.maxAge) {
+                respawn(i);
+            } else {
+                const FieldSample& field = sample(_x[i], _y[i]);
+                float x = _x[i] + field.x * _stepScale;
+                float y = _y[i] + field.y * _stepScale;
+                // the longitude wraps around, leaving through a pole or stopping on land ends the particle
+                x = x < 0.0f ? x + _width : (x >= _width ? x - _width : x);
+                if ((field.x == 0.0f && field.y == 0.0f) || y < 0.0f || y > _height - 1) {
+                    _age[i] = float(_param.maxAge);
+                } else {
+                    _x[i] = x;
+                    _y[i] = y;
+                    _age[i] += 1.0f;
+                }
+            }
+            vertex[0] = _x[i];
+            vertex[1] = _y[i];
+            vertex[2] = _age[i];
+            vertex[3] = sample(_x[i], _y[i]).magnitude;
+        }
+    });
+    _stepNum++;
+}
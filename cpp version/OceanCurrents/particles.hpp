@@ -0,0 +1,97 @@
+/* particles drifting with the currents, as the animation of the JS viewer
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef PARTICLES_HPP
+#define PARTICLES_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+#include "rng.hpp"
+#include "vectorField.hpp"
+
+struct ParticleParam {
+    // particles alive at any time, 0 shows the OLIC texture instead
+    int count = 0;
+    // steps a particle lives before it respawns somewhere else, the first ages are random so they do not all
+    // respawn together
+    int maxAge = 100;
+    // canvas pixels a particle moves per step in the fastest current
+    float maxStep = 1.5f;
+    // share of the trails left after each step, the rest fades out
+    float fade = 0.97f;
+    // seed of the spawn positions, the same seed always gives the same animation
+    unsigned int seed = 20150315;
+};
+
+/**
+ * @brief particles on the equirectangular canvas of the whole globe, as structure of arrays.
+ *
+ * a step moves every particle along the field, chunk by chunk on the workers of the JobSystem. a particle that gets
+ * old, leaves the grid or stops on land respawns at a random point of the ocean, spread evenly over the sphere. the
+ * field is sampled once per canvas pixel up front, a step only reads that table.
+ */
+class ParticleSystem {
+public:
+    // floats per particle written by step: x and y in canvas pixels, age in steps, normalized magnitude
+    static const int VERTEX_FLOATS = 4;
+
+    // particles per chunk, a chunk is advected by one thread and respawns in its own band of latitudes
+    static const int CHUNK_SIZE = 16384;
+
+    // the field must be built on a globe canvas of width x height pixels
+    ParticleSystem(const ParticleParam& param, VectorField& field, int width, int height);
+
+    /**
+     * @brief advect every particle one step and write their state to output, sequentially.
+     *
+     * @param output getVertexBytes() bytes, may be write combined memory
+     */
+    void step(float* output);
+
+    int getCount() const { return _param.count; }
+
+    size_t getVertexBytes() const { return size_t(_param.count) * VERTEX_FLOATS * sizeof(float); }
+
+private:
+    struct FieldSample {
+        // the vector of VectorField::getVector, x already stretched by the latitude
+        float x;
+        float y;
+        float magnitude;
+    };
+
+    ParticleParam _param;
+
+    int _width;
+    int _height;
+
+    // field units to canvas pixels per step
+    float _stepScale;
+
+    CounterRng _rng;
+
+    // steps done, part of the random counters so every respawn draws new numbers
+    uint64_t _stepNum;
+
+    // the field at every canvas pixel, row by row
+    std::vector<FieldSample> _samples;
+
+    std::vector<float> _x;
+    std::vector<float> _y;
+    std::vector<float> _age;
+
+    // the sample of the pixel nearest to a canvas point, y in [0, height - 1]
+    const FieldSample& sample(float x, float y) const {
+        int column = int(x + 0.5f);
+        return _samples[size_t(int(y + 0.5f)) * _width + (column < _width ? column : column - _width)];
+    }
+
+    // move particle i to a random point of the ocean, giving up after a few tries on land
+    void respawn(int i);
+};
+
+#endif
@@ -0,0 +1,160 @@
+/**
+ * frame time instrumentation: RAII CPU scopes, per-stage histograms and trace dumps.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "profiler.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <stdexcept>
+
+// buckets per octave of the histograms
+static const double BUCKETS_PER_OCTAVE = 4.0;
+
+Profiler* Profiler::_instance = nullptr;
+
+void ProfileHistogram::add(double microseconds) {
+    int bucket = microseconds > 1.0 ? int(log2(microseconds) * BUCKETS_PER_OCTAVE) : 0;
+    _buckets[std::min(bucket, BUCKET_NUM - 1)]++;
+    _count++;
+    _sum += microseconds;
+    _min = std::min(_min, microseconds);
+    _max = std::max(_max, microseconds);
+}
+
+void ProfileHistogram::clear() {
+    std::fill(_buckets, _buckets + BUCKET_NUM, 0);
+    _count = 0;
+    _sum = 0.0;
+    _min = 1e300;
+    _max = 0.0;
+}
+
+double ProfileHistogram::getPercentileMs(double fraction) const {
+    if (_count == 0) {
+        return 0.0;
+    }
+    uint64_t target = uint64_t(ceil(fraction * _count));
+    uint64_t seen = 0;
+    for (auto i = 0; i < BUCKET_NUM; i++) {
+        seen += _buckets[i];
+        if (seen >= target) {
+            // the upper bound of the bucket, but never more than the largest sample
+            return std::min(pow(2.0, (i + 1) / BUCKETS_PER_OCTAVE), _max) / 1000.0;
+        }
+    }
+    return getMaxMs();
+}
+
+Profiler& Profiler::init() {
+    if (Profiler::_instance != nullptr) {
+        return *Profiler::_instance;
+    }
+    auto profiler = new Profiler();
+    profiler->_enabled = true;
+    profiler->_tracing = false;
+    profiler->_startTime = Clock::now();
+    Profiler::_instance = profiler;
+    return *profiler;
+}
+
+const char* Profiler::getStageName(ProfileStage stage) {
+    static const char* names[PROFILE_STAGE_NUM] = {"frame", "ingest", "olic", "particles", "upload", "draw", "export"};
+    return names[stage];
+}
+
+int Profiler::getThreadIndex() {
+    std::thread::id id = std::this_thread::get_id();
+    for (size_t i = 0; i < _threads.size(); i++) {
+        if (_threads[i] == id) {
+            return int(i);
+        }
+    }
+    _threads.push_back(id);
+    return int(_threads.size() - 1);
+}
+
+void Profiler::record(ProfileStage stage, ProfileClock clock, Clock::time_point start, Clock::time_point end) {
+    double duration = std::chrono::duration<double, std::micro>(end - start).count();
+    std::lock_guard<std::mutex> lock(_mutex);
+    _histograms[stage][clock].add(duration);
+    if (_tracing && _events.size() < MAX_TRACE_EVENTS) {
+        TraceEvent event;
+        event.stage = stage;
+        event.clock = clock;
+        event.thread = getThreadIndex();
+        event.start = std::chrono::duration<double, std::micro>(start - _startTime).count();
+        event.duration = duration;
+        _events.push_back(event);
+    }
+}
+
+void Profiler::recordGpu(ProfileStage stage, Clock::time_point submitted, double microseconds) {
+    auto duration = std::chrono::duration<double, std::micro>(microseconds);
+    auto end = submitted + std::chrono::duration_cast<Clock::duration>(duration);
+    record(stage, PROFILE_GPU, submitted, end);
+}
+
+ProfileHistogram Profiler::getHistogram(ProfileStage stage, ProfileClock clock) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _histograms[stage][clock];
+}
+
+void Profiler::clear() {
+    std::lock_guard<std::mutex> lock(_mutex);
+    for (auto& stageHistograms : _histograms) {
+        for (auto& histogram : stageHistograms) {
+            histogram.clear();
+        }
+    }
+    _events.clear();
+}
+
+void Profiler::writeChromeTrace(const std::string& path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        throw std::runtime_error("Profiler - writeChromeTrace, cannot open " + path);
+    }
+    fprintf(file, "{\"traceEvents\":[\n");
+    // name the tracks: one per CPU thread, GPU events on a track of their own after them
+    int gpuTrack = int(_threads.size());
+    for (int i = 0; i <= gpuTrack; i++) {
+        fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}},\n",
+                i, i == gpuTrack ? "GPU" : "CPU thread", i);
+    }
+    for (size_t i = 0; i < _events.size(); i++) {
+        const TraceEvent& event = _events[i];
+        fprintf(file, "{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}%s\n",
+                getStageName(event.stage), event.clock == PROFILE_GPU ? "gpu" : "cpu",
+                event.clock == PROFILE_GPU ? gpuTrack : event.thread, event.start, event.duration,
+                i + 1 < _events.size() ? "," : "");
+    }
+    fprintf(file, "],\"displayTimeUnit\":\"ms\"}\n");
+    fclose(file);
+}
+
+void Profiler::writeCsv(const std::string& path) {
+    std::lock_guard<std::mutex> lock(_mutex);
+    FILE* file = fopen(path.c_str(), "w");
+    if (!file) {
+        throw std::runtime_error("Profiler - writeCsv, cannot open " + path);
+    }
+    fprintf(file, "stage,clock,count,mean_ms,min_ms,max_ms,p50_ms,p95_ms,p99_ms\n");
+    for (auto stage = 0; stage < PROFILE_STAGE_NUM; stage++) {
+        for (auto clock = 0; clock < PROFILE_CLOCK_NUM; clock++) {
+            const ProfileHistogram& histogram = _histograms[stage][clock];
+            if (histogram.getCount() == 0) {
+                continue;
+            }
+            fprintf(file, "%s,%s,%llu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", getStageName(ProfileStage(stage)),
+                    clock == PROFILE_GPU ? "gpu" : "cpu", (unsigned long long)histogram.getCount(),
+                    histogram.getMeanMs(), histogram.getMinMs(), histogram.getMaxMs(),
+                    histogram.getPercentileMs(0.5), histogram.getPercentileMs(0.95),
+                    histogram.getPercentileMs(0.99));
+        }
+    }
+    fclose(file);
+}
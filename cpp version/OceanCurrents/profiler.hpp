@@ -0,0 +1,170 @@
+/**
+ * frame time instrumentation: RAII CPU scopes, per-stage histograms and trace dumps.
+ *
+ * a scope costs two clock reads and a short locked update, so a few scopes per frame stay far below 1% of the
+ * frame. GPU times are fed in by GpuTimerPool (gpuProfiler.hpp), which keeps this part free of OpenGL.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef PROFILER_HPP
+#define PROFILER_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum ProfileStage {
+    PROFILE_FRAME = 0,
+    PROFILE_INGEST,
+    PROFILE_OLIC,
+    PROFILE_PARTICLES,
+    PROFILE_UPLOAD,
+    PROFILE_DRAW,
+    PROFILE_EXPORT,
+    PROFILE_STAGE_NUM
+};
+
+// where a duration was measured
+enum ProfileClock {
+    PROFILE_CPU = 0,
+    PROFILE_GPU,
+    PROFILE_CLOCK_NUM
+};
+
+/**
+ * @brief log scale histogram of durations, 4 buckets per octave from 1 microsecond to about 1 second.
+ */
+class ProfileHistogram {
+public:
+    static const int BUCKET_NUM = 80;
+
+    ProfileHistogram() { clear(); }
+
+    void add(double microseconds);
+
+    void clear();
+
+    uint64_t getCount() const { return _count; }
+
+    double getMeanMs() const { return _count > 0 ? _sum / _count / 1000.0 : 0.0; }
+
+    double getMinMs() const { return _count > 0 ? _min / 1000.0 : 0.0; }
+
+    double getMaxMs() const { return _max / 1000.0; }
+
+    // upper bound of the bucket holding the given fraction of the samples, e.g. 0.95
+    double getPercentileMs(double fraction) const;
+
+private:
+    uint64_t _buckets[BUCKET_NUM];
+    uint64_t _count;
+    double _sum;
+    double _min;
+    double _max;
+};
+
+struct TraceEvent {
+    ProfileStage stage;
+    ProfileClock clock;
+    // a small id per thread, GPU events use their own track
+    int thread;
+    // microseconds since the profiler was initialized
+    double start;
+    double duration;
+};
+
+class Profiler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // at most this many trace events are kept, later ones are dropped
+    static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+    // factory methods for singleton.
+    static Profiler& init();
+
+    static const char* getStageName(ProfileStage stage);
+
+    // a disabled profiler ignores every scope and sample
+    bool isEnabled() const { return _enabled; }
+
+    void setEnabled(bool enabled) { _enabled = enabled; }
+
+    // keep every sample as a trace event for writeChromeTrace, off by default
+    void setTracing(bool tracing) { _tracing = tracing; }
+
+    void record(ProfileStage stage, ProfileClock clock, Clock::time_point start, Clock::time_point end);
+
+    // a GPU duration, placed on the timeline at the CPU time the work was submitted
+    void recordGpu(ProfileStage stage, Clock::time_point submitted, double microseconds);
+
+    // a copy of the histogram, safe to read while other threads record
+    ProfileHistogram getHistogram(ProfileStage stage, ProfileClock clock);
+
+    void clear();
+
+    /**
+     * @brief dump the trace events in the Chrome trace event format, open it in chrome://tracing or Perfetto.
+     */
+    void writeChromeTrace(const std::string& path);
+
+    // one line per stage and clock: count, mean, min, max and percentiles in milliseconds
+    void writeCsv(const std::string& path);
+
+private:
+    static Profiler* _instance;
+
+    std::atomic<bool> _enabled;
+
+    std::atomic<bool> _tracing;
+
+    Clock::time_point _startTime;
+
+    std::mutex _mutex;
+
+    ProfileHistogram _histograms[PROFILE_STAGE_NUM][PROFILE_CLOCK_NUM];
+
+    std::vector<TraceEvent> _events;
+
+    // trace ids of the threads that recorded so far
+    std::vector<std::thread::id> _threads;
+
+    int getThreadIndex();
+
+    // singleton, forbid instantiating from client.
+    Profiler() {}
+};
+
+/**
+ * @brief measure the CPU time of the enclosing block as one sample of a stage.
+ */
+class ProfileScope {
+public:
+    explicit ProfileScope(ProfileStage stage) : _stage(stage), _profiler(Profiler::init()) {
+        _active = _profiler.isEnabled();
+        if (_active) {
+            _start = Profiler::Clock::now();
+        }
+    }
+
+    ~ProfileScope() {
+        if (_active) {
+            _profiler.record(_stage, PROFILE_CPU, _start, Profiler::Clock::now());
+        }
+    }
+
+private:
+    ProfileStage _stage;
+    Profiler& _profiler;
+    bool _active;
+    Profiler::Clock::time_point _start;
+
+    ProfileScope(const ProfileScope&);
+    ProfileScope& operator=(const ProfileScope&);
+};
+
+#endif
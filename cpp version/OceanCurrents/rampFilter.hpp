@@ -0,0 +1,88 @@
+/* precomputed ramp filter weights for OLIC convolution
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef RAMP_FILTER_HPP
+#define RAMP_FILTER_HPP
+
+#include <vector>
+
+/**
+ * @brief ramp filter weights of every phrase for a given side length
+ *
+ * the weight of the sample at pos is ((pos + phrase) % sampleLength + 1) / sampleLength, where phrase is the sum of
+ * the droplet's local offset and the global offset. a streamline always has sampleLength = 2 * sideLength + 1 samples,
+ * so the weights only depend on (sideLength, phrase) and can be computed once. the stored weights are normalized,
+ * their sum is 1 and no accumulation is needed as long as all the samples are inside the canvas.
+ */
+class RampFilterTable {
+public:
+    explicit RampFilterTable(int sideLength = 0) {
+        _sampleLength = 2 * sideLength + 1;
+        _weights = std::vector<float>(_sampleLength * _sampleLength);
+        // sum of (k / sampleLength) for k in [1, sampleLength]
+        float acum = (_sampleLength + 1) / 2.0f;
+        for (auto phrase = 0; phrase < _sampleLength; phrase++) {
+            for (auto pos = 0; pos < _sampleLength; pos++) {
+                float weight = float((pos + phrase) % _sampleLength + 1) / _sampleLength;
+                _weights[phrase * _sampleLength + pos] = weight / acum;
+            }
+        }
+    }
+
+    int getSampleLength() const { return _sampleLength; }
+
+    // normalized weights of the given phrase, getSampleLength() entries
+    const float* getWeights(int phrase) const {
+        phrase %= _sampleLength;
+        if (phrase < 0) {
+            phrase += _sampleLength;
+        }
+        return &_weights[phrase * _sampleLength];
+    }
+
+private:
+    int _sampleLength;
+    std::vector<float> _weights;
+};
+
+/**
+ * @brief sum of texels[i] * weights[i], N is known at compile time so the loop is fully unrolled.
+ *
+ * four independent accumulators keep the lanes apart, which lets the compiler pack them into one SIMD register
+ * without reassociating the float additions.
+ */
+template <int N>
+inline float weightedSum(const float* texels, const float* weights) {
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    int i = 0;
+    for (; i + 4 <= N; i += 4) {
+        acc[0] += texels[i] * weights[i];
+        acc[1] += texels[i + 1] * weights[i + 1];
+        acc[2] += texels[i + 2] * weights[i + 2];
+        acc[3] += texels[i + 3] * weights[i + 3];
+    }
+    for (; i < N; i++) {
+        acc[0] += texels[i] * weights[i];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+// runtime length version of weightedSum, for the side lengths that are not specialized
+inline float weightedSum(const float* texels, const float* weights, int n) {
+    float acc[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        acc[0] += texels[i] * weights[i];
+        acc[1] += texels[i + 1] * weights[i + 1];
+        acc[2] += texels[i + 2] * weights[i + 2];
+        acc[3] += texels[i + 3] * weights[i + 3];
+    }
+    for (; i < n; i++) {
+        acc[0] += texels[i] * weights[i];
+    }
+    return (acc[0] + acc[1]) + (acc[2] + acc[3]);
+}
+
+#endif
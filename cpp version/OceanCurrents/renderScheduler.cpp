@@ -0,0 +1,147 @@
+/**
+ * decides when a frame is drawn, so a still globe costs no CPU.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "renderScheduler.hpp"
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+RenderScheduler* RenderScheduler::_instance = nullptr;
+
+RenderScheduler& RenderScheduler::init(ApplicationContext& context, int animationRate) {
+    if (RenderScheduler::_instance != nullptr) {
+        return *RenderScheduler::_instance;
+    }
+    auto scheduler = new RenderScheduler();
+    scheduler->_context = &context;
+    scheduler->_interval = std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(
+        1.0 / animationRate));
+    // the first frame is always drawn
+    scheduler->_invalid = true;
+    scheduler->_animating = false;
+    scheduler->_nextTick = Clock::now();
+    scheduler->_timerArmed = false;
+    scheduler->_stopping = false;
+    scheduler->resetStats();
+    scheduler->_timer = std::thread([scheduler]() { scheduler->runTimer(); });
+    if (!context.isHeadless()) {
+        glfwSetWindowRefreshCallback(context.getWindow(), RenderScheduler::OnRefresh);
+    }
+    RenderScheduler::_instance = scheduler;
+    return *scheduler;
+}
+
+void RenderScheduler::invalidate() {
+    if (!_invalid.exchange(true)) {
+        _context->wakeEvents();
+    }
+}
+
+void RenderScheduler::requestAnimationFrame() {
+    _animating = true;
+}
+
+void RenderScheduler::wait() {
+    _wakeups++;
+    if (_context->isHeadless() || _invalid) {
+        _context->pollEvents();
+        return;
+    }
+    auto start = Clock::now();
+    if (!_animating) {
+        _context->waitEvents();
+    } else if (start < _nextTick) {
+        {
+            std::lock_guard<std::mutex> lock(_mutex);
+            _wakeTime = _nextTick;
+            _timerArmed = true;
+        }
+        _timerChanged.notify_one();
+        _context->waitEvents();
+        // an event came first, the tick is armed again by the next wait
+        std::lock_guard<std::mutex> lock(_mutex);
+        _timerArmed = false;
+    } else {
+        _context->pollEvents();
+    }
+    _idleSeconds += std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+bool RenderScheduler::beginFrame() {
+    auto now = Clock::now();
+    bool tick = _animating && now >= _nextTick;
+    if (!_invalid.exchange(false) && !tick && !_context->isHeadless()) {
+        return false;
+    }
+    _frames++;
+    _animating = false;
+    // keep the cadence while animating, a late frame starts a new one instead of bunching up the next frames
+    _nextTick += _interval;
+    if (_nextTick < now) {
+        _nextTick = now + _interval;
+    }
+    return true;
+}
+
+void RenderScheduler::resetStats() {
+    _wakeups = 0;
+    _frames = 0;
+    _idleSeconds = 0.0;
+}
+
+double RenderScheduler::getProcessCpuSeconds() {
+#ifdef _WIN32
+    FILETIME creation, exit, kernel, user;
+    if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) {
+        return 0.0;
+    }
+    // 100 ns units
+    auto toSeconds = [](const FILETIME& time) {
+        return (uint64_t(time.dwHighDateTime) << 32 | time.dwLowDateTime) * 1e-7;
+    };
+    return toSeconds(kernel) + toSeconds(user);
+#else
+    struct timespec time;
+    if (clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &time) != 0) {
+        return 0.0;
+    }
+    return time.tv_sec + time.tv_nsec * 1e-9;
+#endif
+}
+
+void RenderScheduler::runTimer() {
+    std::unique_lock<std::mutex> lock(_mutex);
+    while (!_stopping) {
+        if (!_timerArmed) {
+            _timerChanged.wait(lock);
+        } else if (_timerChanged.wait_until(lock, _wakeTime) == std::cv_status::timeout && _timerArmed) {
+            _timerArmed = false;
+            _context->wakeEvents();
+        }
+    }
+}
+
+void RenderScheduler::OnRefresh(GLFWwindow*) {
+    if (_instance != nullptr) {
+        _instance->invalidate();
+    }
+}
+
+void RenderScheduler::finalize() {
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        _stopping = true;
+    }
+    _timerChanged.notify_one();
+    _timer.join();
+    if (_context->getWindow() != nullptr) {
+        glfwSetWindowRefreshCallback(_context->getWindow(), nullptr);
+    }
+    RenderScheduler::_instance = nullptr;
+    delete this;
+}
@@ -0,0 +1,103 @@
+/**
+ * decides when a frame is drawn, so a still globe costs no CPU.
+ *
+ * a frame is drawn when something invalidated the picture: an input event that moved the camera, a finished
+ * simulation frame, an upload, the window being exposed. sources that need several frames, like textures still
+ * streaming in, request animation frames instead, which are drawn at a fixed rate. in between the render thread
+ * sleeps in glfwWaitEvents. GLFW 3.1 has no wait with a timeout, a timer thread posts an empty event at the next
+ * animation tick instead.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef RENDER_SCHEDULER_HPP
+#define RENDER_SCHEDULER_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+
+#include "applicationContext.hpp"
+
+class RenderScheduler {
+public:
+    typedef std::chrono::steady_clock Clock;
+
+    // factory methods for singleton, call it on the GL thread after the context
+    static RenderScheduler& init(ApplicationContext& context, int animationRate = 60);
+
+    // the picture changed, draw a frame as soon as possible. any thread can call it, a waiting render thread wakes
+    void invalidate();
+
+    // draw a frame at the next animation tick, ask again every frame to keep animating
+    void requestAnimationFrame();
+
+    /**
+     * @brief process the events, sleeping first if no frame is due: until the next event when idle, until the
+     * next tick at most when an animation frame is requested.
+     *
+     * headless contexts never sleep.
+     */
+    void wait();
+
+    /**
+     * @brief whether to draw now, consumes the invalidation and the animation request.
+     *
+     * the events of the last wait may still invalidate the picture, call it once they are handled. headless
+     * contexts draw every frame.
+     */
+    bool beginFrame();
+
+    // times the render thread woke up, frames drawn, and seconds spent waiting, since the last reset
+    uint64_t getWakeupCount() const { return _wakeups; }
+
+    uint64_t getFrameCount() const { return _frames; }
+
+    double getIdleSeconds() const { return _idleSeconds; }
+
+    void resetStats();
+
+    // CPU time of the whole process, all threads together
+    static double getProcessCpuSeconds();
+
+    // stop the timer thread
+    void finalize();
+
+private:
+    static RenderScheduler* _instance;
+
+    ApplicationContext* _context;
+
+    Clock::duration _interval;
+
+    std::atomic<bool> _invalid;
+
+    bool _animating;
+
+    // the tick the next animation frame is drawn at
+    Clock::time_point _nextTick;
+
+    uint64_t _wakeups;
+    uint64_t _frames;
+    double _idleSeconds;
+
+    // the timer thread, posting an empty event at _wakeTime if it is set
+    std::thread _timer;
+    std::mutex _mutex;
+    std::condition_variable _timerChanged;
+    Clock::time_point _wakeTime;
+    bool _timerArmed;
+    bool _stopping;
+
+    void runTimer();
+
+    // redraw the window content when the system asks, e.g. after it was covered or resized
+    static void OnRefresh(GLFWwindow* window);
+
+    // singleton, forbid instantiating from client.
+    RenderScheduler() {}
+};
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * thin render layer on top of the application context: immutable meshes, per-frame constants and a sorted
+ * command list.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "renderer.hpp"
+#include <stddef.h>
+#include <string.h>
+#include <algorithm>
+#include <tuple>
+
+Renderer* Renderer::_instance = nullptr;
+
+Renderer& Renderer::init(ApplicationContext& context) {
+    if (Renderer::_instance != nullptr) {
+        return *Renderer::_instance;
+    }
+    auto renderer = new Renderer();
+    renderer->_context = &context;
+    renderer->_frameUniformsValid = false;
+    renderer->_boundProgram = 0;
+    renderer->_boundVertexArray = context.getVertexArrayId();
+    renderer->_callCount = 0;
+
+    glGenBuffers(1, &renderer->_uniformBuffer);
+    glBindBuffer(GL_UNIFORM_BUFFER, renderer->_uniformBuffer);
+    glBufferData(GL_UNIFORM_BUFFER, sizeof(FrameUniforms), nullptr, GL_DYNAMIC_DRAW);
+    // the binding point keeps the buffer, it is never rebound
+    glBindBufferBase(GL_UNIFORM_BUFFER, FRAME_UNIFORMS_BINDING, renderer->_uniformBuffer);
+
+    Renderer::_instance = renderer;
+    return *renderer;
+}
+
+Mesh Renderer::createMesh(const MeshData& data) {
+    Mesh mesh;
+    glGenVertexArrays(1, &mesh.vertexArray);
+    glBindVertexArray(mesh.vertexArray);
+    _vertexArrays.push_back(mesh.vertexArray);
+
+    // one buffer, every attribute of a vertex is fetched from the same cache line
+    GLuint vertexBuffer;
+    glGenBuffers(1, &vertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, vertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, data.vertices.size() * sizeof(Vertex), data.vertices.data(), GL_STATIC_DRAW);
+    glEnableVertexAttribArray(0);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, position));
+    glEnableVertexAttribArray(1);
+    glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, uv));
+    glEnableVertexAttribArray(2);
+    glVertexAttribPointer(2, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, normal));
+
+    // the element buffer binding is part of the VAO state
+    GLuint indexBuffer;
+    glGenBuffers(1, &indexBuffer);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, indexBuffer);
+    glBufferData(GL_ELEMENT_ARRAY_BUFFER, data.indices.size() * sizeof(uint32_t), data.indices.data(), GL_STATIC_DRAW);
+    _buffers.push_back(vertexBuffer);
+    _buffers.push_back(indexBuffer);
+
+    mesh.indexCount = GLsizei(data.indices.size());
+    mesh.indexType = GL_UNSIGNED_INT;
+    // leave the new VAO alone, later buffer setup must not record into it
+    glBindVertexArray(_context->getVertexArrayId());
+    _boundVertexArray = _context->getVertexArrayId();
+    return mesh;
+}
+
+void Renderer::bindFrameUniforms(GLuint program) {
+    GLuint blockIndex = glGetUniformBlockIndex(program, "FrameUniforms");
+    if (blockIndex != GL_INVALID_INDEX) {
+        glUniformBlockBinding(program, blockIndex, FRAME_UNIFORMS_BINDING);
+    }
+}
+
+void Renderer::setFrameUniforms(const FrameUniforms& uniforms) {
+    if (_frameUniformsValid && memcmp(&uniforms, &_frameUniforms, sizeof(FrameUniforms)) == 0) {
+        return;
+    }
+    _frameUniforms = uniforms;
+    _frameUniformsValid = true;
+    glBindBuffer(GL_UNIFORM_BUFFER, _uniformBuffer);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(FrameUniforms), &_frameUniforms);
+    _callCount += 2;
+}
+
+void Renderer::flush() {
+    // group the draws sharing a program, then textures, then mesh; equal commands keep the submission order
+    std::stable_sort(_commands.begin(), _commands.end(), [](const RenderCommand& a, const RenderCommand& b) {
+        return std::make_tuple(a.program, a.textures[0], a.textures[1], a.textures[2], a.textures[3],
+                               a.mesh.vertexArray) <
+               std::make_tuple(b.program, b.textures[0], b.textures[1], b.textures[2], b.textures[3],
+                               b.mesh.vertexArray);
+    });
+
+    GLuint boundTextures[RenderCommand::TEXTURE_UNIT_NUM] = {0, 0, 0, 0};
+    for (const RenderCommand& command : _commands) {
+        if (command.program != _boundProgram) {
+            glUseProgram(command.program);
+            _boundProgram = command.program;
+            _callCount++;
+        }
+        for (auto unit = 0; unit < RenderCommand::TEXTURE_UNIT_NUM; unit++) {
+            if (command.textures[unit] != 0 && command.textures[unit] != boundTextures[unit]) {
+                glActiveTexture(GL_TEXTURE0 + unit);
+                glBindTexture(GL_TEXTURE_2D, command.textures[unit]);
+                boundTextures[unit] = command.textures[unit];
+                _callCount += 2;
+            }
+        }
+        if (command.mesh.vertexArray != _boundVertexArray) {
+            glBindVertexArray(command.mesh.vertexArray);
+            _boundVertexArray = command.mesh.vertexArray;
+            _callCount++;
+        }
+        glDrawElements(GL_TRIANGLES, command.mesh.indexCount, command.mesh.indexType, (void*)0);
+        _callCount++;
+    }
+    _commands.clear();
+}
+
+void Renderer::finalize() {
+    for (GLuint vertexArray : _vertexArrays) {
+        glDeleteVertexArrays(1, &vertexArray);
+    }
+    for (GLuint buffer : _buffers) {
+        glDeleteBuffers(1, &buffer);
+    }
+    glDeleteBuffers(1, &_uniformBuffer);
+    _instance = nullptr;
+    delete this;
+}
@@ -0,0 +1,107 @@
+/**
+ * thin render layer on top of the application context: immutable meshes, per-frame constants and a sorted
+ * command list.
+ *
+ * state is built once instead of every frame: each mesh owns a VAO holding its attribute layout and index buffer,
+ * and the per-frame constants live in one uniform buffer object shared by all the programs. draws are submitted
+ * as commands, sorted by state at flush, and only the state that differs from the previous draw is changed.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef RENDERER_HPP
+#define RENDERER_HPP
+
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+#include "applicationContext.hpp"
+#include "utils/mesh.hpp"
+
+// the uniform block of the shaders, std140 layout
+struct FrameUniforms {
+    glm::mat4 mvp;
+    glm::mat4 view;
+    glm::mat4 model;
+    // w is padding
+    glm::vec4 lightPosition;
+};
+
+// an immutable mesh, ready to draw with a single VAO bind
+struct Mesh {
+    GLuint vertexArray = 0;
+    GLsizei indexCount = 0;
+    GLenum indexType = GL_UNSIGNED_INT;
+};
+
+struct RenderCommand {
+    static const int TEXTURE_UNIT_NUM = 4;
+
+    GLuint program = 0;
+    Mesh mesh;
+    // texture bound to each unit, 0 leaves the unit untouched
+    GLuint textures[TEXTURE_UNIT_NUM] = {0, 0, 0, 0};
+};
+
+class Renderer {
+public:
+    // binding point of the FrameUniforms block
+    static const GLuint FRAME_UNIFORMS_BINDING = 0;
+
+    // factory methods for singleton.
+    static Renderer& init(ApplicationContext& context);
+
+    /**
+     * @brief upload the interleaved vertices and the indices of a mesh and record their layout in a new VAO.
+     *
+     * attribute 0 is the position, 1 the uv and 2 the normal, as in the shaders.
+     */
+    Mesh createMesh(const MeshData& data);
+
+    // connect the FrameUniforms block of the program to the shared uniform buffer
+    void bindFrameUniforms(GLuint program);
+
+    // update the per-frame constants, the buffer is only written when they changed
+    void setFrameUniforms(const FrameUniforms& uniforms);
+
+    void submit(const RenderCommand& command) { _commands.push_back(command); }
+
+    // sort the submitted commands by state and draw them
+    void flush();
+
+    // GL calls issued by the renderer since the last reset
+    unsigned int getCallCount() const { return _callCount; }
+
+    void resetCallCount() { _callCount = 0; }
+
+    void finalize();
+
+private:
+    static Renderer* _instance;
+
+    ApplicationContext* _context;
+
+    std::vector<GLuint> _vertexArrays;
+
+    std::vector<GLuint> _buffers;
+
+    GLuint _uniformBuffer;
+
+    FrameUniforms _frameUniforms;
+
+    bool _frameUniformsValid;
+
+    std::vector<RenderCommand> _commands;
+
+    // state left by the previous draw. program and VAO are only changed by the renderer, so they are trusted
+    // across frames; texture units are shared with uploads (e.g. TextureStream) and only trusted within a flush
+    GLuint _boundProgram;
+
+    GLuint _boundVertexArray;
+
+    unsigned int _callCount;
+
+    // singleton, forbid instantiating from client.
+    Renderer() {}
+};
+
+#endif
@@ -0,0 +1,60 @@
+/* fourth order Runge-Kutta step, shared by the streamlines of OLIC, the flow maps of FTLE and the pathlines of the
+ * volumes
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef RK4_HPP
+#define RK4_HPP
+
+/**
+ * @brief advance point by step along velocity(time, point).
+ *
+ * Point only needs + and * by a float, so it may be a glm::vec2 as well as a LaneBatch of points integrated
+ * together.
+ *
+ * @param time passed to velocity, a steady field may ignore it
+ * @param step negative integrates backward
+ */
+template <typename Point, typename Velocity>
+inline Point rk4Step(const Point& point, double time, float step, const Velocity& velocity) {
+    Point k1 = velocity(time, point) * step;
+    Point k2 = velocity(time + 0.5 * step, point + k1 * 0.5f) * step;
+    Point k3 = velocity(time + 0.5 * step, point + k2 * 0.5f) * step;
+    Point k4 = velocity(time + step, point + k3) * step;
+    return point + k1 * (1.0f / 6) + k2 * (1.0f / 3) + k3 * (1.0f / 3) + k4 * (1.0f / 6);
+}
+
+/**
+ * @brief LANES points of AXES coordinates each, integrated together by rk4Step.
+ *
+ * the lanes are independent, so the arithmetic of rk4Step runs as plain loops the compiler vectorizes.
+ */
+template <int AXES, int LANES>
+struct LaneBatch {
+    float axes[AXES][LANES];
+};
+
+template <int AXES, int LANES>
+inline LaneBatch<AXES, LANES> operator+(const LaneBatch<AXES, LANES>& a, const LaneBatch<AXES, LANES>& b) {
+    LaneBatch<AXES, LANES> sum;
+    for (auto axis = 0; axis < AXES; axis++) {
+        for (auto i = 0; i < LANES; i++) {
+            sum.axes[axis][i] = a.axes[axis][i] + b.axes[axis][i];
+        }
+    }
+    return sum;
+}
+
+template <int AXES, int LANES>
+inline LaneBatch<AXES, LANES> operator*(const LaneBatch<AXES, LANES>& a, float scale) {
+    LaneBatch<AXES, LANES> product;
+    for (auto axis = 0; axis < AXES; axis++) {
+        for (auto i = 0; i < LANES; i++) {
+            product.axes[axis][i] = a.axes[axis][i] * scale;
+        }
+    }
+    return product;
+}
+
+#endif
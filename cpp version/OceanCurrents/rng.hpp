@@ -0,0 +1,48 @@
+/* counter based random number generator
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef RNG_HPP
+#define RNG_HPP
+
+#include <stdint.h>
+
+/**
+ * @brief counter based generator: the number for (seed, stream, counter) is a hash of the three, there is no state.
+ *
+ * any thread can draw any number of the sequence in any order and still get the same values, which makes parallel
+ * generation reproducible. use the counter for the item (e.g. the pixel index) and the stream for the different
+ * draws of one item.
+ */
+class CounterRng {
+public:
+    explicit CounterRng(uint64_t seed = 0) : _seed(seed) {}
+
+    uint64_t next(uint64_t counter, uint32_t stream = 0) const {
+        uint64_t z = mix(_seed ^ mix(uint64_t(stream) + 0x632BE59BD9B4E019ULL));
+        return mix(z + counter * 0x9E3779B97F4A7C15ULL);
+    }
+
+    // uniform float in [0, 1)
+    float uniform(uint64_t counter, uint32_t stream = 0) const {
+        return float(next(counter, stream) >> 40) * (1.0f / 16777216.0f);
+    }
+
+    // uniform integer in [0, bound)
+    int uniformInt(uint64_t counter, int bound, uint32_t stream = 0) const {
+        return int(((next(counter, stream) >> 32) * uint64_t(bound)) >> 32);
+    }
+
+private:
+    uint64_t _seed;
+
+    // splitmix64 finalizer
+    static uint64_t mix(uint64_t z) {
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+};
+
+#endif
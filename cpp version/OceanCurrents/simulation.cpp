@@ -0,0 +1,172 @@
+/**
+ * the simulation thread: loads the data, updates the fields and computes the OLIC or particle frames, apart from
+ * rendering.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "simulation.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <algorithm>
+#include <chrono>
+
+#include "NetCDFArray.h"
+#include "jobSystem.hpp"
+#include "profiler.hpp"
+
+Simulation::Simulation(const std::string& dataPath, const OlicParam& olicParam, const ParticleParam& particleParam,
+                       std::function<void()> onFrame, unsigned char* const* frameSlots)
+    : _dataPath(dataPath), _olicParam(olicParam), _particleParam(particleParam), _onFrame(onFrame), _olicLevel(0),
+      _running(true), _paused(false), _loaded(false), _hasCurrents(false), _detailLevel(0), _lastGeneration(0),
+      _skipped(0) {
+    // sized up front so that no buffer is resized while the other side may hold it
+    size_t frameSize = hasParticles()
+        ? size_t(_particleParam.count) * ParticleSystem::VERTEX_FLOATS * sizeof(float)
+        : size_t(_olicParam.width) * _olicParam.height * _olicParam.pixelFormat;
+    for (auto i = 0; i < 3; i++) {
+        _frameSlots[i] = hasParticles() || frameSlots == nullptr ? nullptr : frameSlots[i];
+        if (_frameSlots[i] == nullptr) {
+            _frames.getBuffer(i).resize(frameSize);
+        }
+    }
+    _thread = std::thread([this]() { run(); });
+}
+
+Simulation::~Simulation() {
+    {
+        std::lock_guard<std::mutex> lock(_pauseMutex);
+        _running = false;
+    }
+    _resumed.notify_one();
+    _thread.join();
+}
+
+void Simulation::setPaused(bool paused) {
+    {
+        std::lock_guard<std::mutex> lock(_pauseMutex);
+        _paused = paused;
+    }
+    _resumed.notify_one();
+}
+
+bool Simulation::acquireFrame() {
+    if (!_frames.acquire()) {
+        return false;
+    }
+    auto generation = _frames.getFrontGeneration();
+    _skipped += generation - _lastGeneration - 1;
+    _lastGeneration = generation;
+    return true;
+}
+
+void Simulation::setFootprint(float globePixels) {
+    // canvas texels per screen pixel in the middle of the globe, where a texel covers the most pixels: the canvas
+    // height spans pi radians of latitude, a radian at the middle spans the radius of the globe on the screen
+    float texelsPerPixel = 2.0f * _olicParam.height / (float(M_PI) * std::max(globePixels, 1.0f));
+    int level = texelsPerPixel > 1.0f ? int(floor(log2f(texelsPerPixel))) : 0;
+    _detailLevel = std::min(std::max(level, 0), MAX_DETAIL_LEVEL);
+}
+
+bool Simulation::load() {
+    ProfileScope ingestScope(PROFILE_INGEST);
+    NetCDFArray nca(_dataPath);
+    GeoArray<float> u, v;
+    if (!nca.getGeoArrayData(u, "uu", 0, 0) || !nca.getGeoArrayData(v, "vv", 0, 0)) {
+        return false;
+    }
+    // every level of detail is built up front, on the workers
+    _pyramid.reset(new FieldPyramid(u, v));
+    if (hasParticles()) {
+        _field.reset(new VectorField(*_pyramid, _olicParam.width, _olicParam.height, true));
+        _particles.reset(new ParticleSystem(_particleParam, *_field, _olicParam.width, _olicParam.height));
+    } else {
+        useOlicLevel(_detailLevel);
+    }
+    return true;
+}
+
+void Simulation::useOlicLevel(int level) {
+    OlicLevel& olic = _olicLevels[level];
+    if (!olic.context) {
+        olic.param = _olicParam;
+        olic.param.width = std::max(_olicParam.width >> level, 1);
+        olic.param.height = std::max(_olicParam.height >> level, 1);
+        olic.field.reset(new VectorField(*_pyramid, olic.param.width, olic.param.height, true));
+        olic.context.reset(OlicContext::create(olic.param, *olic.field));
+    }
+    _levelFrame.resize(level > 0 ? olic.context->getOutputSize() : 0);
+    _olicLevel = level;
+}
+
+// nearest texel stretch of a level canvas over the frame, row by row on the workers
+template <typename Texel>
+static void stretchTexels(const Texel* source, int sourceWidth, int sourceHeight, Texel* output, int width,
+                          int height) {
+    JobSystem::init().parallelFor(0, height, 32, [=](int first, int last) {
+        for (auto y = first; y < last; y++) {
+            const Texel* sourceRow = source + size_t(y) * sourceHeight / height * sourceWidth;
+            Texel* row = output + size_t(y) * width;
+            for (auto x = 0; x < width; x++) {
+                row[x] = sourceRow[size_t(x) * sourceWidth / width];
+            }
+        }
+    });
+}
+
+void Simulation::refreshOlic(unsigned char* output) {
+    OlicLevel& olic = _olicLevels[_olicLevel];
+    if (_olicLevel == 0) {
+        olic.context->refreshOLIC(output);
+        return;
+    }
+    olic.context->refreshOLIC(_levelFrame.data());
+    if (olic.param.pixelFormat == OLIC_PIXEL_RGBA8) {
+        stretchTexels((const uint32_t*)_levelFrame.data(), olic.param.width, olic.param.height, (uint32_t*)output,
+                      _olicParam.width, _olicParam.height);
+    } else {
+        stretchTexels((const uint16_t*)_levelFrame.data(), olic.param.width, olic.param.height, (uint16_t*)output,
+                      _olicParam.width, _olicParam.height);
+    }
+}
+
+void Simulation::run() {
+    _hasCurrents = load();
+    _loaded = true;
+    if (!_hasCurrents) {
+        printf("no surface currents, %s disabled\n", hasParticles() ? "particles" : "OLIC");
+        return;
+    }
+
+    auto step = std::chrono::microseconds(1000000 / STEP_RATE);
+    auto next = std::chrono::steady_clock::now();
+    while (_running) {
+        if (_paused) {
+            // no frames and no wakeups while paused
+            std::unique_lock<std::mutex> lock(_pauseMutex);
+            _resumed.wait(lock, [this]() { return !_paused || !_running; });
+            next = std::chrono::steady_clock::now();
+            continue;
+        }
+        if (_particles) {
+            ProfileScope particlesScope(PROFILE_PARTICLES);
+            _particles->step((float*)_frames.getBack().data());
+        } else {
+            ProfileScope olicScope(PROFILE_OLIC);
+            // a new footprint goes on with the context of its level, the other levels keep theirs
+            int level = _detailLevel;
+            if (level != _olicLevel) {
+                useOlicLevel(level);
+            }
+            int back = _frames.getBackIndex();
+            refreshOlic(_frameSlots[back] != nullptr ? _frameSlots[back] : _frames.getBack().data());
+        }
+        _frames.publish();
+        if (_onFrame) {
+            _onFrame();
+        }
+        // a late step is followed right away by the next one, without catching up on the missed ones
+        next = std::max(next + step, std::chrono::steady_clock::now());
+        std::this_thread::sleep_until(next);
+    }
+}
@@ -0,0 +1,168 @@
+/**
+ * the simulation thread: loads the data, updates the fields and computes the OLIC or particle frames, apart from
+ * rendering.
+ *
+ * the render thread never waits for it. finished frames go through a lock-free triple buffer, the render thread
+ * takes the newest one when it has time to, so a slow OLIC pass only makes the animation skip steps, never the
+ * display or the input handling.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef SIMULATION_HPP
+#define SIMULATION_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "GeoArray.h"
+#include "fieldPyramid.hpp"
+#include "olic.hpp"
+#include "particles.hpp"
+#include "tripleBuffer.hpp"
+#include "vectorField.hpp"
+
+class Simulation {
+public:
+    // simulation steps per second at most, the animation speed does not depend on the display rate
+    static const int STEP_RATE = 60;
+
+    // OLIC canvas halvings at most when the globe is small on the screen
+    static const int MAX_DETAIL_LEVEL = 3;
+
+    /**
+     * @brief start the thread, loading the surface currents of a netCDF file first.
+     *
+     * the frames are olicParam.width * olicParam.height texels in the olicParam.pixelFormat layout, as for
+     * OlicContext::refreshOLIC. with particles, they are the particle states of ParticleSystem::step instead, on a
+     * canvas of the same size.
+     *
+     * @param onFrame called on the simulation thread whenever a frame is finished, e.g. to wake the render thread
+     * @param frameSlots 3 OLIC frames to write into instead of its own, e.g. the slots of a persistent
+     * TextureStream, indexed by getFrameSlot. nullptr for its own, always with particles
+     */
+    Simulation(const std::string& dataPath, const OlicParam& olicParam, const ParticleParam& particleParam,
+               std::function<void()> onFrame = std::function<void()>(), unsigned char* const* frameSlots = nullptr);
+
+    // stop the thread, waiting for the step in progress
+    ~Simulation();
+
+    /**
+     * @brief take the newest frame, call it on the render thread.
+     *
+     * @return false if no frame was finished since the last call, the previous frame stays valid then
+     */
+    bool acquireFrame();
+
+    // the frame taken by the last acquireFrame, empty with frame slots
+    const std::vector<unsigned char>& getFrame() const { return _frames.getFront(); }
+
+    // the frame slot taken by the last acquireFrame. it goes back to the simulation with the next acquireFrame
+    int getFrameSlot() const { return _frames.getFrontIndex(); }
+
+    // steps done up to the frame taken by the last acquireFrame
+    uint64_t getFrameGeneration() const { return _lastGeneration; }
+
+    // the frames are particle states rather than an OLIC texture
+    bool hasParticles() const { return _particleParam.count > 0; }
+
+    // frames finished but never taken, since the last reset
+    uint64_t getSkippedCount() const { return _skipped; }
+
+    void resetSkippedCount() { _skipped = 0; }
+
+    // stop computing frames, the last one stays
+    void setPaused(bool paused);
+
+    bool isPaused() const { return _paused; }
+
+    // loading finished, with or without currents
+    bool isLoaded() const { return _loaded; }
+
+    // the currents were found, frames will come
+    bool hasCurrents() const { return _hasCurrents; }
+
+    /**
+     * @brief tell how large the globe is on the screen, call it on the render thread whenever it changes.
+     *
+     * the OLIC canvas is computed at the resolution that gives about a texel per screen pixel, halving it as long
+     * as it keeps more texels than pixels, and the field is sampled from the matching level of the pyramid: a
+     * level costs a quarter of the one above it. the frames keep their size, a coarser canvas is stretched over
+     * them. particles are not affected.
+     *
+     * @param globePixels diameter of the globe on the screen in pixels
+     */
+    void setFootprint(float globePixels);
+
+    // OLIC canvas halvings of the frames computed from now on
+    int getDetailLevel() const { return _detailLevel; }
+
+private:
+    std::string _dataPath;
+
+    OlicParam _olicParam;
+
+    ParticleParam _particleParam;
+
+    std::function<void()> _onFrame;
+
+    // the OLIC of a level of detail, kept once built so a footprint going back and forth keeps its cached textures
+    struct OlicLevel {
+        // the context keeps a pointer to them
+        OlicParam param;
+        std::unique_ptr<VectorField> field;
+        std::unique_ptr<OlicContext> context;
+    };
+
+    // owned by the simulation thread
+    std::unique_ptr<FieldPyramid> _pyramid;
+    // the field of the particles
+    std::unique_ptr<VectorField> _field;
+    std::unique_ptr<ParticleSystem> _particles;
+    OlicLevel _olicLevels[MAX_DETAIL_LEVEL + 1];
+    int _olicLevel;
+    // the OLIC texture of a level above 0, before it is stretched over the frame
+    std::vector<unsigned char> _levelFrame;
+
+    TripleBuffer<std::vector<unsigned char>> _frames;
+    // nullptr without frame slots, the OLIC frames are the buffers of _frames then
+    unsigned char* _frameSlots[3];
+
+    std::atomic<bool> _running;
+    std::atomic<bool> _paused;
+    std::mutex _pauseMutex;
+    std::condition_variable _resumed;
+    std::atomic<bool> _loaded;
+    std::atomic<bool> _hasCurrents;
+    std::atomic<int> _detailLevel;
+
+    // owned by the render thread
+    uint64_t _lastGeneration;
+    uint64_t _skipped;
+
+    std::thread _thread;
+
+    // the body of the thread
+    void run();
+
+    // read the currents and set the field and the OLIC context or the particles up, false if the file has none
+    bool load();
+
+    // switch the OLIC to a canvas halved level times, setting its field and context up the first time
+    void useOlicLevel(int level);
+
+    // compute the next OLIC texture into output, at the full canvas size
+    void refreshOlic(unsigned char* output);
+
+    // forbid copying, the thread is owned
+    Simulation(const Simulation&);
+    Simulation& operator=(const Simulation&);
+};
+
+#endif
@@ -0,0 +1,81 @@
+/**
+ * loads image textures on the workers of the JobSystem, so large textures do not freeze the startup.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "textureLoader.hpp"
+#include <stdexcept>
+
+TextureLoader* TextureLoader::_instance = nullptr;
+
+TextureLoader& TextureLoader::init() {
+    if (TextureLoader::_instance != nullptr) {
+        return *TextureLoader::_instance;
+    }
+    auto loader = new TextureLoader();
+    loader->_compress = ImageLoader::canCompress();
+    loader->_pending = 0;
+    TextureLoader::_instance = loader;
+    return *loader;
+}
+
+GLuint TextureLoader::load(const std::string& imgPath) {
+    auto found = _textures.find(imgPath);
+    if (found != _textures.end()) {
+        return found->second;
+    }
+    // a grey placeholder, complete so sampling it is defined
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(GL_TEXTURE_2D, texture);
+    const unsigned char grey[4] = {128, 128, 128, 255};
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, 1, 1, 0, GL_RGBA, GL_UNSIGNED_BYTE, grey);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    _textures[imgPath] = texture;
+
+    _pending++;
+    auto result = std::make_shared<Result>();
+    result->texture = texture;
+    result->imgPath = imgPath;
+    bool compress = _compress;
+    auto& jobs = JobSystem::init();
+    JobSystem::JobHandle decode = jobs.submit([result, compress]() {
+        try {
+            result->image = ImageLoader::loadImage(result->imgPath, compress);
+        } catch (const std::exception& e) {
+            result->error = e.what();
+        }
+    });
+    _uploads.push_back(jobs.submitMain([this, result]() { uploadResult(*result); }, {decode}));
+    return texture;
+}
+
+void TextureLoader::finish() {
+    auto& jobs = JobSystem::init();
+    for (auto& upload : _uploads) {
+        jobs.wait(upload);
+    }
+    _uploads.clear();
+}
+
+void TextureLoader::uploadResult(const Result& result) {
+    _pending--;
+    if (!result.error.empty()) {
+        throw std::runtime_error("TextureLoader - update, " + result.imgPath + ": " + result.error);
+    }
+    // new storage under the same id, whoever holds the placeholder gets the image
+    ImageLoader::upload(result.image, result.texture);
+}
+
+void TextureLoader::finalize() {
+    // the uploads hold this loader
+    finish();
+    for (auto& entry : _textures) {
+        glDeleteTextures(1, &entry.second);
+    }
+    _instance = nullptr;
+    delete this;
+}
@@ -0,0 +1,71 @@
+/**
+ * loads image textures on the workers of the JobSystem, so large textures do not freeze the startup.
+ *
+ * a job maps the file, decodes it, builds the mipmaps and block compresses them (or reads all of that from the
+ * cache, see ImageLoader::loadImage). the upload of the finished levels depends on it, as a main job: it runs on the
+ * GL thread in JobSystem::runMainJobs.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef TEXTURE_LOADER_HPP
+#define TEXTURE_LOADER_HPP
+
+#include <atomic>
+#include <map>
+#include <string>
+#include <vector>
+#include <GL/glew.h>
+
+#include "jobSystem.hpp"
+#include "utils/imageLoader.hpp"
+
+class TextureLoader {
+public:
+    // factory methods for singleton, call it on the GL thread, which must be the main thread of the JobSystem
+    static TextureLoader& init();
+
+    /**
+     * @brief the texture of an image file, returned right away.
+     *
+     * the texture is a grey 1x1 placeholder until the decoded image is uploaded, the id stays the same. the upload
+     * throws from JobSystem::runMainJobs if the image could not be decoded, it binds the texture to the active unit.
+     * loading the same file twice returns the same texture.
+     */
+    GLuint load(const std::string& imgPath);
+
+    // block until every texture loaded so far is uploaded
+    void finish();
+
+    // textures loaded but not uploaded yet
+    int getPendingCount() const { return _pending; }
+
+    // finish the loads and delete all the textures
+    void finalize();
+
+private:
+    struct Result {
+        GLuint texture;
+        std::string imgPath;
+        ImageData image;
+        // empty if decoded
+        std::string error;
+    };
+
+    static TextureLoader* _instance;
+
+    // whether the workers compress, queried once on the GL thread
+    bool _compress;
+
+    std::map<std::string, GLuint> _textures;
+
+    std::atomic<int> _pending;
+
+    std::vector<JobSystem::JobHandle> _uploads;
+
+    void uploadResult(const Result& result);
+
+    // singleton, forbid instantiating from client.
+    TextureLoader() {}
+};
+
+#endif
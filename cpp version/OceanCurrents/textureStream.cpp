@@ -0,0 +1,152 @@
+/**
+ * streams a texture that changes every frame (e.g. the OLIC texture) from the CPU to the GPU.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "textureStream.hpp"
+#include <chrono>
+#include <stdexcept>
+
+static double elapsedMs(std::chrono::steady_clock::time_point start) {
+    return std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+TextureStream::TextureStream(int width, int height, int bytesPerPixel)
+    : _width(width), _height(height), _frameSize(size_t(width) * height * bytesPerPixel), _mapped(nullptr),
+      _slot(0), _uploadMs(0.0), _waitMs(0.0), _uploadFrames(0), _frameWaitMs(0.0) {
+    GLenum internalFormat;
+    if (bytesPerPixel == 4) {
+        _format = GL_RGBA;
+        internalFormat = GL_RGBA8;
+    } else if (bytesPerPixel == 2) {
+        _format = GL_RG;
+        internalFormat = GL_RG8;
+    } else {
+        throw std::runtime_error("TextureStream - TextureStream, unsupported bytes per pixel");
+    }
+    for (auto i = 0; i < SLOT_NUM; i++) {
+        _fences[i] = 0;
+    }
+
+    glGenTextures(1, &_texture);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glTexImage2D(GL_TEXTURE_2D, 0, internalFormat, width, height, 0, _format, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    // the OLIC globe texture wraps around the longitude
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenBuffers(1, &_buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+    _persistent = GLEW_ARB_buffer_storage != 0;
+    if (_persistent) {
+        GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        glBufferStorage(GL_PIXEL_UNPACK_BUFFER, _frameSize * SLOT_NUM, nullptr, flags);
+        _mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, _frameSize * SLOT_NUM, flags);
+        if (_mapped == nullptr) {
+            throw std::runtime_error("TextureStream - TextureStream, cannot map the pixel buffer");
+        }
+    } else {
+        glBufferData(GL_PIXEL_UNPACK_BUFFER, _frameSize * SLOT_NUM, nullptr, GL_STREAM_DRAW);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+}
+
+TextureStream::~TextureStream() {
+    for (auto i = 0; i < SLOT_NUM; i++) {
+        if (_fences[i] != 0) {
+            glDeleteSync(_fences[i]);
+        }
+    }
+    if (_persistent) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    glDeleteBuffers(1, &_buffer);
+    glDeleteTextures(1, &_texture);
+}
+
+unsigned char* TextureStream::beginFrame() {
+    auto start = std::chrono::steady_clock::now();
+    GLsync& fence = _fences[_slot];
+    if (fence != 0) {
+        // flush on the first try, otherwise the fence may never be submitted and the wait never ends
+        GLbitfield flags = GL_SYNC_FLUSH_COMMANDS_BIT;
+        while (glClientWaitSync(fence, flags, 1000000) == GL_TIMEOUT_EXPIRED) {
+            flags = 0;
+        }
+        glDeleteSync(fence);
+        fence = 0;
+    }
+    _frameWaitMs = elapsedMs(start);
+
+    size_t offset = _frameSize * _slot;
+    if (_persistent) {
+        return _mapped + offset;
+    }
+    // the fence already guarantees the GPU is done with the slot, so the driver need not synchronize
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+    _mapped = (unsigned char*)glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, offset, _frameSize,
+        GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (_mapped == nullptr) {
+        throw std::runtime_error("TextureStream - beginFrame, cannot map the pixel buffer");
+    }
+    return _mapped;
+}
+
+void TextureStream::commitFrame() {
+    auto start = std::chrono::steady_clock::now();
+    if (!_persistent) {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        _mapped = nullptr;
+    }
+    upload(_slot);
+    _slot = (_slot + 1) % SLOT_NUM;
+
+    _waitMs += _frameWaitMs;
+    _uploadMs += _frameWaitMs + elapsedMs(start);
+    _uploadFrames++;
+}
+
+bool TextureStream::isSlotFree(int slot) {
+    GLsync& fence = _fences[slot];
+    if (fence == 0) {
+        return true;
+    }
+    if (glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) {
+        return false;
+    }
+    glDeleteSync(fence);
+    fence = 0;
+    return true;
+}
+
+void TextureStream::commitSlot(int slot) {
+    auto start = std::chrono::steady_clock::now();
+    upload(slot);
+    _uploadMs += elapsedMs(start);
+    _uploadFrames++;
+}
+
+void TextureStream::upload(int slot) {
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, _buffer);
+    // with a pixel unpack buffer bound the last argument is an offset into it, the copy runs on the GPU
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glBindTexture(GL_TEXTURE_2D, _texture);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, _width, _height, _format, GL_UNSIGNED_BYTE,
+                    (void*)(_frameSize * slot));
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    _fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
+
+void TextureStream::resetStats() {
+    _uploadMs = 0.0;
+    _waitMs = 0.0;
+    _uploadFrames = 0;
+}
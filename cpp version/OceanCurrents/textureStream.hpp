@@ -0,0 +1,102 @@
+/**
+ * streams a texture that changes every frame (e.g. the OLIC texture) from the CPU to the GPU.
+ *
+ * a naive glTexImage2D per frame makes the driver copy the pixels and wait for the GPU to finish with the texture,
+ * which stalls the pipeline at large sizes. this stream keeps a ring of pixel buffer slots instead: the CPU writes
+ * one slot while the GPU copies the previous ones to the texture asynchronously, and a fence per slot makes sure a
+ * slot is not overwritten before its copy is done.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef TEXTURE_STREAM_HPP
+#define TEXTURE_STREAM_HPP
+
+#include <stddef.h>
+#include <GL/glew.h>
+
+class TextureStream {
+public:
+    // slots of the ring: one written by the CPU, one being copied by the GPU, one queued in between
+    static const int SLOT_NUM = 3;
+
+    /**
+     * @brief create the texture and the pixel buffer ring.
+     *
+     * with ARB_buffer_storage the buffer is mapped once, persistently and coherently, for the whole life of the
+     * stream. without it every slot is mapped unsynchronized per frame, the fences still protect it.
+     *
+     * @param bytesPerPixel 4 for RGBA8 texels, 2 for RG8 texels
+     */
+    TextureStream(int width, int height, int bytesPerPixel);
+
+    ~TextureStream();
+
+    /**
+     * @brief the memory of the next slot to write a whole frame into, row-major and bottom row first.
+     *
+     * waits for the GPU if it still copies out of that slot. write it sequentially, the memory is write combined.
+     */
+    unsigned char* beginFrame();
+
+    // queue the copy of the written slot into the texture and move to the next slot. the texture is left bound to
+    // the active texture unit
+    void commitFrame();
+
+    /**
+     * @brief the memory of a slot of a persistent stream, for another thread to write the frames straight into.
+     *
+     * the caller then hands the slots out instead of the ring, e.g. as the buffers of a TripleBuffer, and must not
+     * give a slot back to the writer before isSlotFree. beginFrame and commitFrame are not used then.
+     */
+    unsigned char* getSlot(int slot) const { return _mapped + _frameSize * slot; }
+
+    // true once the GPU copied the slot into the texture, never waits
+    bool isSlotFree(int slot);
+
+    // queue the copy of a slot written through getSlot into the texture, which is left bound as by commitFrame
+    void commitSlot(int slot);
+
+    GLuint getTexture() const { return _texture; }
+
+    size_t getFrameSize() const { return _frameSize; }
+
+    bool isPersistent() const { return _persistent; }
+
+    // CPU milliseconds spent uploading, fence wait plus the copy submission, averaged since the last reset
+    double getAverageUploadMs() const { return _uploadFrames > 0 ? _uploadMs / _uploadFrames : 0.0; }
+
+    // milliseconds spent waiting for the GPU to release a slot, a non-zero value means the ring is too short
+    double getAverageWaitMs() const { return _uploadFrames > 0 ? _waitMs / _uploadFrames : 0.0; }
+
+    void resetStats();
+
+private:
+    int _width;
+    int _height;
+    GLenum _format;
+    size_t _frameSize;
+    bool _persistent;
+
+    GLuint _texture;
+    // one buffer holding all the slots
+    GLuint _buffer;
+    // the whole buffer when mapped persistently, the current slot otherwise
+    unsigned char* _mapped;
+    GLsync _fences[SLOT_NUM];
+    int _slot;
+
+    double _uploadMs;
+    double _waitMs;
+    int _uploadFrames;
+    // fence wait of the frame being written, set by beginFrame
+    double _frameWaitMs;
+
+    // copy a slot into the texture on the GPU and fence it
+    void upload(int slot);
+
+    // forbid copying, the GL objects are owned
+    TextureStream(const TextureStream&);
+    TextureStream& operator=(const TextureStream&);
+};
+
+#endif
@@ -0,0 +1,8 @@
+#version 330 core
+
+// subtracted from the intensity after it is scaled by the fade, so the trails reach 0 despite the 8 bit rounding
+out vec4 fadeStep;
+
+void main(){
+	fadeStep = vec4(0.0, 0.0, 0.0, 1.0 / 255.0);
+}
@@ -0,0 +1,6 @@
+#version 330 core
+
+// one triangle covering the whole viewport, no vertex data needed
+void main(){
+	gl_Position = vec4(float(gl_VertexID & 1) * 4.0 - 1.0, float(gl_VertexID >> 1) * 4.0 - 1.0, 0.0, 1.0);
+}
@@ -0,0 +1,83 @@
+/* lock-free single producer, single consumer handoff of whole frames
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef TRIPLE_BUFFER_HPP
+#define TRIPLE_BUFFER_HPP
+
+#include <stdint.h>
+#include <atomic>
+
+/**
+ * @brief three buffers: the writer fills the back one, the reader holds the front one, the middle one is the
+ * newest finished frame.
+ *
+ * publishing swaps the back buffer with the middle one, acquiring swaps the front buffer with the middle one, each
+ * with one atomic exchange. neither side ever waits for the other: a slow writer leaves the reader on its frame, a
+ * slow reader skips the frames published meanwhile. the state packs the middle index, a fresh bit and the
+ * generation of the middle frame, the generations tell the reader how many frames it skipped.
+ */
+template <typename T>
+class TripleBuffer {
+public:
+    TripleBuffer() : _state(1), _back(0), _written(0), _front(2), _frontGeneration(0) {}
+
+    // writer side, the buffer to fill
+    T& getBack() { return _buffers[_back]; }
+
+    // writer side, 0, 1 or 2, for buffers kept apart from the triple buffer
+    int getBackIndex() const { return _back; }
+
+    // writer side, hand the back buffer over as the newest frame and take the previous middle one to fill next
+    void publish() {
+        uint64_t state = ++_written << GENERATION_SHIFT | FRESH_BIT | _back;
+        _back = int(_state.exchange(state, std::memory_order_acq_rel) & INDEX_MASK);
+    }
+
+    // reader side, take the newest frame if one was published since the last call, false otherwise
+    bool acquire() {
+        if ((_state.load(std::memory_order_relaxed) & FRESH_BIT) == 0) {
+            return false;
+        }
+        uint64_t state = _state.exchange(uint64_t(_front), std::memory_order_acq_rel);
+        _front = int(state & INDEX_MASK);
+        _frontGeneration = state >> GENERATION_SHIFT;
+        return true;
+    }
+
+    // reader side, the frame taken by the last acquire
+    const T& getFront() const { return _buffers[_front]; }
+
+    // reader side, 0, 1 or 2. the front buffer is handed back to the writer by the next successful acquire
+    int getFrontIndex() const { return _front; }
+
+    // reader side, 1 for the first frame published, 0 before any
+    uint64_t getFrontGeneration() const { return _frontGeneration; }
+
+    // every buffer, only to set them up before the two sides start
+    T& getBuffer(int index) { return _buffers[index]; }
+
+private:
+    static const uint64_t INDEX_MASK = 3;
+    static const uint64_t FRESH_BIT = 4;
+    static const int GENERATION_SHIFT = 3;
+
+    T _buffers[3];
+
+    std::atomic<uint64_t> _state;
+
+    // owned by the writer
+    int _back;
+    uint64_t _written;
+
+    // owned by the reader
+    int _front;
+    uint64_t _frontGeneration;
+
+    // forbid copying
+    TripleBuffer(const TripleBuffer&);
+    TripleBuffer& operator=(const TripleBuffer&);
+};
+
+#endif
@@ -0,0 +1,144 @@
+/* packed mask of the grid cells with data, so the hot loops test a bit instead of comparing the currents against
+ * the fill values
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "validMask.hpp"
+#include <algorithm>
+#include <atomic>
+#include <bitset>
+
+#include "jobSystem.hpp"
+
+static inline int popCount(uint64_t word) {
+    // a single instruction where the compiler has one, portable otherwise
+    return int(std::bitset<64>(word).count());
+}
+
+// the bits from bit first to bit last of a word, inclusive
+static inline uint64_t bitRange(int first, int last) {
+    uint64_t upTo = last >= 63 ? ~uint64_t(0) : (uint64_t(1) << (last + 1)) - 1;
+    return upTo & ~((uint64_t(1) << first) - 1);
+}
+
+ValidMask::ValidMask(const GeoArray<float>& u, const GeoArray<float>& v)
+    : _rows(u.latitude_num_), _columns(u.longitude_num_), _validCount(0) {
+    assert(isSameGeoInfo(u, v));
+    build(u.array_p_, v.array_p_, [&](float east, float north) {
+        return u.isValidValue(east) && v.isValidValue(north);
+    });
+}
+
+ValidMask::ValidMask(int rows, int columns, const float* u, const float* v)
+    : _rows(rows), _columns(columns), _validCount(0) {
+    build(u, v, [](float east, float north) { return isValidValue(east) && isValidValue(north); });
+}
+
+template <typename IsValid>
+void ValidMask::build(const float* u, const float* v, const IsValid& isValid) {
+    _wordsPerRow = (_columns + 63) / 64;
+    _blockRows = (_rows + BLOCK_CELLS - 1) / BLOCK_CELLS;
+    _blockColumns = (_columns + BLOCK_CELLS - 1) / BLOCK_CELLS;
+    _bits.assign(size_t(_rows) * _wordsPerRow, 0);
+    _blocks.assign(size_t(_blockRows) * _blockColumns, BLOCK_EMPTY);
+    auto& jobs = JobSystem::init();
+
+    // a row owns its words
+    std::atomic<size_t> validCount(0);
+    jobs.parallelFor(0, _rows, JobSystem::rowGrain(_columns), [&](int first, int last) {
+        size_t count = 0;
+        for (auto m = first; m < last; m++) {
+            const float* rowU = u + size_t(m) * _columns;
+            const float* rowV = v + size_t(m) * _columns;
+            uint64_t* words = &_bits[size_t(m) * _wordsPerRow];
+            // a word at a time in a register, then stored once
+            for (auto i = 0; i < _wordsPerRow; i++) {
+                int n0 = i * 64;
+                int n1 = std::min(n0 + 64, _columns);
+                uint64_t word = 0;
+                for (auto n = n0; n < n1; n++) {
+                    word |= uint64_t(isValid(rowU[n], rowV[n])) << (n - n0);
+                }
+                words[i] = word;
+                count += popCount(word);
+            }
+        }
+        validCount += count;
+    });
+    _validCount = validCount;
+
+    // a block owns its state
+    jobs.parallelFor(0, _blockRows, 1, [&](int first, int last) {
+        for (auto blockRow = first; blockRow < last; blockRow++) {
+            int m0 = blockRow * BLOCK_CELLS;
+            int m1 = std::min(m0 + BLOCK_CELLS, _rows) - 1;
+            for (auto blockColumn = 0; blockColumn < _blockColumns; blockColumn++) {
+                int n0 = blockColumn * BLOCK_CELLS;
+                int n1 = std::min(n0 + BLOCK_CELLS, _columns) - 1;
+                // a block is within a word, BLOCK_CELLS divides 64
+                uint64_t bits = bitRange(n0 & 63, n1 & 63);
+                int count = 0;
+                for (auto m = m0; m <= m1; m++) {
+                    count += popCount(_bits[size_t(m) * _wordsPerRow + (n0 >> 6)] & bits);
+                }
+                int cells = (m1 - m0 + 1) * (n1 - n0 + 1);
+                _blocks[size_t(blockRow) * _blockColumns + blockColumn] =
+                    uint8_t(count == 0 ? BLOCK_EMPTY : (count == cells ? BLOCK_FULL : BLOCK_MIXED));
+            }
+        }
+    });
+}
+
+bool ValidMask::isRowFull(int m) const {
+    const uint64_t* words = &_bits[size_t(m) * _wordsPerRow];
+    int count = 0;
+    for (auto i = 0; i < _wordsPerRow; i++) {
+        count += popCount(words[i]);
+    }
+    return count == _columns;
+}
+
+bool ValidMask::anyValidInRow(int m, int n0, int n1) const {
+    const uint64_t* words = &_bits[size_t(m) * _wordsPerRow];
+    for (auto word = n0 >> 6; word <= n1 >> 6; word++) {
+        int first = word == n0 >> 6 ? n0 & 63 : 0;
+        int last = word == n1 >> 6 ? n1 & 63 : 63;
+        if ((words[word] & bitRange(first, last)) != 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ValidMask::anyValid(int m0, int n0, int m1, int n1) const {
+    m0 = std::max(m0, 0);
+    n0 = std::max(n0, 0);
+    m1 = std::min(m1, _rows - 1);
+    n1 = std::min(n1, _columns - 1);
+    if (m0 > m1 || n0 > n1) {
+        return false;
+    }
+    // whole blocks first, only the mixed ones are read cell by cell
+    for (auto blockRow = m0 / BLOCK_CELLS; blockRow <= m1 / BLOCK_CELLS; blockRow++) {
+        int rowFirst = std::max(m0, blockRow * BLOCK_CELLS);
+        int rowLast = std::min(m1, blockRow * BLOCK_CELLS + BLOCK_CELLS - 1);
+        for (auto blockColumn = n0 / BLOCK_CELLS; blockColumn <= n1 / BLOCK_CELLS; blockColumn++) {
+            BlockState state = getBlockState(blockRow, blockColumn);
+            if (state == BLOCK_FULL) {
+                return true;
+            }
+            if (state == BLOCK_EMPTY) {
+                continue;
+            }
+            int columnFirst = std::max(n0, blockColumn * BLOCK_CELLS);
+            int columnLast = std::min(n1, blockColumn * BLOCK_CELLS + BLOCK_CELLS - 1);
+            for (auto m = rowFirst; m <= rowLast; m++) {
+                if (anyValidInRow(m, columnFirst, columnLast)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
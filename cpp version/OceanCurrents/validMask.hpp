@@ -0,0 +1,85 @@
+/* packed mask of the grid cells with data, so the hot loops test a bit instead of comparing the currents against
+ * the fill values
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef VALID_MASK_HPP
+#define VALID_MASK_HPP
+
+#include <stdint.h>
+#include <vector>
+
+#include "GeoArray.h"
+
+/**
+ * @brief a bit per cell, set where u and v have data, and a state per block of BLOCK_CELLS x BLOCK_CELLS cells.
+ *
+ * a cell has no data if u or v is NaN or the invalid value of its array, which is land for the currents. the
+ * blocks tell at once whether a whole part of the grid is land, water or both, so an area over land is skipped
+ * without reading its cells.
+ */
+class ValidMask {
+public:
+    // cells along each side of a block
+    static const int BLOCK_CELLS = 8;
+
+    enum BlockState {
+        // no cell of the block has data
+        BLOCK_EMPTY = 0,
+        BLOCK_MIXED = 1,
+        // every cell of the block has data
+        BLOCK_FULL = 2
+    };
+
+    ValidMask() : _rows(0), _columns(0), _wordsPerRow(0), _blockRows(0), _blockColumns(0), _validCount(0) {}
+
+    // build the mask of a grid, the rows in parallel on the workers of the JobSystem
+    ValidMask(const GeoArray<float>& u, const GeoArray<float>& v);
+
+    // the same over rows x columns values with NaN as their only fill, e.g. the levels of a volume one after another
+    ValidMask(int rows, int columns, const float* u, const float* v);
+
+    bool isValid(int m, int n) const {
+        return ((_bits[size_t(m) * _wordsPerRow + (n >> 6)] >> (n & 63)) & 1) != 0;
+    }
+
+    // every cell of row m has data
+    bool isRowFull(int m) const;
+
+    BlockState getBlockState(int blockRow, int blockColumn) const {
+        return BlockState(_blocks[size_t(blockRow) * _blockColumns + blockColumn]);
+    }
+
+    /**
+     * @brief true if a cell of rows m0 to m1 and columns n0 to n1, inclusive, has data. the range is clamped to the
+     *        grid.
+     */
+    bool anyValid(int m0, int n0, int m1, int n1) const;
+
+    int getRows() const { return _rows; }
+
+    int getColumns() const { return _columns; }
+
+    size_t getValidCount() const { return _validCount; }
+
+private:
+    int _rows;
+    int _columns;
+    int _wordsPerRow;
+    int _blockRows;
+    int _blockColumns;
+    size_t _validCount;
+    // row after row, each row starts a new word
+    std::vector<uint64_t> _bits;
+    std::vector<uint8_t> _blocks;
+
+    // set the bits of the rows u, v with isValid(u value, v value), then the blocks
+    template <typename IsValid>
+    void build(const float* u, const float* v, const IsValid& isValid);
+
+    // true if a cell of row m from column n0 to n1, inclusive, has data
+    bool anyValidInRow(int m, int n0, int n1) const;
+};
+
+#endif
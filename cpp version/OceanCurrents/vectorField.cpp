@@ -4,30 +4,154 @@
  */
 
 #include "vectorField.hpp"
+#include <algorithm>
+#include <math.h>
+#include <glm/glm.hpp>
 
-glm::vec2 VectorField::RKIntergral(glm::vec2 originPoint, float step) {
-    glm::vec2 vector = getVector(originPoint);
-    glm::vec2 k1 = (vector *= step);
-    vector = getVector(originPoint + glm::vec2(k1.x * 0.5, k1.y * 0.5));
-    glm::vec2 k2 = (vector *= step);
-    vector = getVector(originPoint + glm::vec2(k2.x * 0.5, k2.y * 0.5));
-    glm::vec2 k3 = (vector *= step);
-    vector = getVector(originPoint + glm::vec2(k3.x, k3.y));
-    glm::vec2 k4 = (vector *= step);
+#include "rk4.hpp"
+
+// cos(85 degrees), the longitude stretch of a globe canvas is clamped to it near the poles
+static const double MIN_COS_LATITUDE = 0.0872;
 
-    glm::vec2 finalPoint = originPoint + (k1 *= 1 / 6) + (k2 *= 1 / 3) + (k3 *= 1 / 3) + (k4 *= 1 / 6);
-    
-    return finalPoint;
+glm::vec2 VectorField::RKIntergral(glm::vec2 originPoint, float step) {
+    return rk4Step(originPoint, 0.0, step, [this](double, glm::vec2 point) { return getVector(point); });
 }
 
+/**
+ * @brief nearest grid cell lookup, the canvas is stretched over the whole grid and points out of it are clamped.
+ * the cells without data have no current, the mask tells them apart rather than their fill values.
+ *
+ * on a globe canvas the pixel is converted to longitude and latitude first, points out of the grid have no
+ * current. a pixel of x spans cos(latitude) times less distance on the sphere than a pixel of y, so u is scaled
+ * by 1 / cos(latitude) to keep streamlines the same length on the globe; the scale is clamped near the poles.
+ */
 glm::vec2 VectorField::getVector(std::pair<int, int> point) {
+    int m, n;
+    if (!lookupCell(point, m, n) || !_mask.isValid(m, n)) {
+        return glm::vec2(0.0f, 0.0f);
+    }
+    glm::vec2 vector(_u(m, n), _v(m, n));
+    if (_globe) {
+        double latitude = glm::radians(-90.0 + (point.second + 0.5) * 180.0 / _height);
+        // degrees per pixel of x over degrees per pixel of y, 1 for the usual 2:1 texture
+        double aspect = (360.0 / _width) / (180.0 / _height);
+        vector.x = float(vector.x / (std::max(cos(latitude), MIN_COS_LATITUDE) * aspect));
+    }
+    return vector;
+}
+
+bool VectorField::lookupCell(std::pair<int, int> point, int& m, int& n) const {
+    if (!_globe) {
+        n = _width > 1 ? int(point.first * (_u.longitude_num_ - 1) / float(_width - 1) + 0.5f) : 0;
+        m = _height > 1 ? int(point.second * (_u.latitude_num_ - 1) / float(_height - 1) + 0.5f) : 0;
+        n = std::min(std::max(n, 0), _u.longitude_num_ - 1);
+        m = std::min(std::max(m, 0), _u.latitude_num_ - 1);
+        return true;
+    }
+    double longitude = -180.0 + (point.first + 0.5) * 360.0 / _width;
+    double latitude = -90.0 + (point.second + 0.5) * 180.0 / _height;
+    // eastward distance from the first column, works for both [-180, 180) and [0, 360) grids
+    double distance = fmod(longitude - _u.longitude_start_, 360.0);
+    if (distance < 0) {
+        distance += 360.0;
+    }
+    n = int(floor(distance / _u.longitude_interval_ + 0.5));
+    m = int(floor((latitude - _u.latitude_start_) / _u.latitude_interval_ + 0.5));
+    if (_wrapLongitude) {
+        n %= _u.longitude_num_;
+    }
+    return n >= 0 && n < _u.longitude_num_ && m >= 0 && m < _u.latitude_num_;
+}
 
+bool VectorField::isValid(glm::vec2 point) const {
+    int m, n;
+    return lookupCell(std::pair<int, int>(round(point.x), round(point.y)), m, n) && _mask.isValid(m, n);
+}
+
+/**
+ * the nearest cell lookup only goes one way along each axis, so the cells under the corner pixels bound the cells of
+ * the whole rectangle. on a globe canvas the columns are counted eastward from the first one without wrapping, a
+ * rectangle crossing the first column goes on with the same cells a turn further east.
+ */
+bool VectorField::hasValidCells(int x0, int y0, int x1, int y1) const {
+    if (x0 >= x1 || y0 >= y1) {
+        return false;
+    }
+    if (!_globe) {
+        int m0, n0, m1, n1;
+        lookupCell(std::pair<int, int>(x0, y0), m0, n0);
+        lookupCell(std::pair<int, int>(x1 - 1, y1 - 1), m1, n1);
+        return _mask.anyValid(std::min(m0, m1), std::min(n0, n1), std::max(m0, m1), std::max(n0, n1));
+    }
+    double firstLatitude = -90.0 + (y0 + 0.5) * 180.0 / _height;
+    double lastLatitude = -90.0 + (y1 - 0.5) * 180.0 / _height;
+    int m0 = int(floor((firstLatitude - _u.latitude_start_) / _u.latitude_interval_ + 0.5));
+    int m1 = int(floor((lastLatitude - _u.latitude_start_) / _u.latitude_interval_ + 0.5));
+    double distance = fmod(-180.0 + (x0 + 0.5) * 360.0 / _width - _u.longitude_start_, 360.0);
+    if (distance < 0) {
+        distance += 360.0;
+    }
+    int n0 = int(floor(distance / _u.longitude_interval_ + 0.5));
+    int n1 = int(floor((distance + (x1 - 1 - x0) * 360.0 / _width) / _u.longitude_interval_ + 0.5));
+    int turn = _wrapLongitude ? _u.longitude_num_ : int(floor(360.0 / _u.longitude_interval_ + 0.5));
+    int firstRow = std::min(m0, m1);
+    int lastRow = std::max(m0, m1);
+    return _mask.anyValid(firstRow, n0, lastRow, n1) ||
+           (n1 >= turn && _mask.anyValid(firstRow, n0 - turn, lastRow, n1 - turn));
 }
 
 glm::vec2 VectorField::getVector(glm::vec2 point) {
     return getVector(std::pair<int, int>(round(point.x), round(point.y)));
 }
 
-VectorField::VectorField(GeoArray<float> &field) {
+float VectorField::getNormalizedMagnitude(glm::vec2 point) {
+    int m, n;
+    if (_maxMagnitude <= 0.0f || !lookupCell(std::pair<int, int>(round(point.x), round(point.y)), m, n) ||
+        !_mask.isValid(m, n)) {
+        return 0.0f;
+    }
+    // the raw cell, the globe canvas scaling of getVector is not a real speed
+    return std::min(glm::length(glm::vec2(_u(m, n), _v(m, n))) / _maxMagnitude, 1.0f);
+}
+
+VectorField::VectorField(GeoArray<float> &u, GeoArray<float> &v, int width, int height, bool globe)
+    : _u(u), _v(v), _width(width), _height(height), _globe(globe), _maxMagnitude(0.0f), _level(0), _mask(u, v) {
+    assert(isSameGeoInfo(u, v));
+    init();
+}
+
+/**
+ * the footprint is the cells of level 0 between two canvas pixels along the axis where they are the fewest, so
+ * the level picked is never coarser than a pixel in either direction.
+ */
+static int selectFieldLevel(const FieldPyramid& pyramid, int width, int height, bool globe) {
+    const GeoArray<float>& u = pyramid.getU(0);
+    float cellsPerPixel;
+    if (globe) {
+        cellsPerPixel = float(std::min((360.0 / width) / fabs(u.longitude_interval_),
+                                       (180.0 / height) / fabs(u.latitude_interval_)));
+    } else {
+        cellsPerPixel = std::min(float(u.longitude_num_) / width, float(u.latitude_num_) / height);
+    }
+    return pyramid.selectLevel(cellsPerPixel);
+}
+
+VectorField::VectorField(const FieldPyramid& pyramid, int width, int height, bool globe)
+    : _width(width), _height(height), _globe(globe), _maxMagnitude(0.0f),
+      _level(selectFieldLevel(pyramid, width, height, globe)), _mask(pyramid.getMask(_level)) {
+    _u = pyramid.getU(_level);
+    _v = pyramid.getV(_level);
+    init();
+}
 
+void VectorField::init() {
+    _wrapLongitude = fabs(_u.longitude_interval_) * _u.longitude_num_ >= 360.0 - 1e-6;
+    for (auto m = 0; m < _u.latitude_num_; m++) {
+        for (auto n = 0; n < _u.longitude_num_; n++) {
+            // the fill values are no currents
+            if (_mask.isValid(m, n)) {
+                _maxMagnitude = std::max(_maxMagnitude, glm::length(glm::vec2(_u(m, n), _v(m, n))));
+            }
+        }
+    }
 }
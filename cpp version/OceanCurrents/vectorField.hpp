@@ -10,25 +10,73 @@
 #include <utility>
 #include <glm/detail/type_vec2.hpp>
 #include "GeoArray.h"
+#include "fieldPyramid.hpp"
+#include "validMask.hpp"
 
 class VectorField {
 public:
     /**
      * @brief using RK intergral method to calculate next point upon the vector field
-     * 
+     *
      * @param originPoint the point that preceed the point to calculate
      * @param step the integral step
      * @return the next point for given point and step in this vector field
      */
     glm::vec2 RKIntergral(glm::vec2 originPoint, float step);
-    
+
     glm::vec2 getVector(std::pair<int, int> point);
 
     glm::vec2 getVector(glm::vec2 point);
 
-    explicit VectorField(GeoArray<float>& field);
+    // velocity magnitude of the given point scaled into [0, 1] by the max magnitude of the whole field
+    float getNormalizedMagnitude(glm::vec2 point);
+
+    float getMaxMagnitude() const { return _maxMagnitude; }
+
+    // the point is on a grid cell with data, getVector gives no current anywhere else
+    bool isValid(glm::vec2 point) const;
+
+    // a pixel of [x0, x1) x [y0, y1) is on a grid cell with data, from the blocks of the mask where they are all land
+    bool hasValidCells(int x0, int y0, int x1, int y1) const;
+
+    const ValidMask& getMask() const { return _mask; }
+
+    /**
+     * @param u eastward component of the field
+     * @param v northward component of the field, must share the geo info with u
+     * @param width width of the canvas the field is stretched over
+     * @param height height of the canvas the field is stretched over
+     * @param globe if true, the canvas is the equirectangular texture of the whole globe (x from -180 to 180
+     *        degrees, y from -90 to 90) instead of the grid's own extent, see getVector
+     */
+    explicit VectorField(GeoArray<float>& u, GeoArray<float>& v, int width, int height, bool globe = false);
+
+    /**
+     * @brief the same on the level of the pyramid that matches the footprint of a canvas pixel, so a smaller canvas
+     *        reads a smaller grid and the streamlines do not alias over cells much smaller than a pixel.
+     */
+    explicit VectorField(const FieldPyramid& pyramid, int width, int height, bool globe = false);
+
+    // level of the pyramid sampled, 0 for a field built on a grid
+    int getLevel() const { return _level; }
 private:
-    GeoArray<float> _field;
+    GeoArray<float> _u;
+    GeoArray<float> _v;
+    // canvas size, points passed in are canvas pixels rather than grid indices
+    int _width;
+    int _height;
+    bool _globe;
+    // the grid covers all longitudes, so its columns wrap around
+    bool _wrapLongitude;
+    float _maxMagnitude;
+    int _level;
+    // the cells with data, built once per grid or shared by the level of the pyramid
+    ValidMask _mask;
+
+    void init();
+
+    // find the grid cell of a canvas pixel, false if the pixel is out of the grid
+    bool lookupCell(std::pair<int, int> point, int& m, int& n) const;
 };
 
 #endif
@@ -0,0 +1,588 @@
+/**
+ * virtual texturing of the globe imagery: images of any size shown with a fixed amount of GPU memory.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "virtualTexture.hpp"
+#include "utils/imageLoader.hpp"
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
+
+#include "jobSystem.hpp"
+
+// the page file header, the source size and time tell whether the image changed since
+struct PageFileHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t pageSize;
+    uint32_t pageBorder;
+    uint32_t width;
+    uint32_t height;
+    uint32_t levelNum;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+};
+
+static const char PAGE_FILE_MAGIC[8] = {'O', 'C', 'V', 'T', 'E', 'X', '\0', '\0'};
+static const uint32_t PAGE_FILE_VERSION = 1;
+
+static const size_t SLOT_BYTES = size_t(VirtualTexture::SLOT_SIZE) * VirtualTexture::SLOT_SIZE * 4;
+
+static uint32_t nextPowerOfTwo(uint32_t value) {
+    uint32_t power = 1;
+    while (power < value) {
+        power *= 2;
+    }
+    return power;
+}
+
+// texels and pages of every level, each level halves the previous one, rounding up
+static void levelLayout(uint32_t width, uint32_t height, std::vector<uint32_t>& levelWidths,
+                        std::vector<uint32_t>& levelHeights, int& levelNum) {
+    uint32_t tableSize = std::max(nextPowerOfTwo((width + VirtualTexture::PAGE_SIZE - 1) / VirtualTexture::PAGE_SIZE),
+                                  nextPowerOfTwo((height + VirtualTexture::PAGE_SIZE - 1) / VirtualTexture::PAGE_SIZE));
+    levelNum = 1;
+    while ((1u << (levelNum - 1)) < tableSize) {
+        levelNum++;
+    }
+    levelWidths.clear();
+    levelHeights.clear();
+    for (auto level = 0; level < levelNum; level++) {
+        levelWidths.push_back(std::max((width + (1u << level) - 1) >> level, 1u));
+        levelHeights.push_back(std::max((height + (1u << level) - 1) >> level, 1u));
+    }
+}
+
+// the point of the unit globe at a uv of SphereGenerator
+static glm::vec3 spherePoint(float u, float v) {
+    float longitude = (u - 0.5f) * 2.0f * float(M_PI);
+    float latitude = (v - 0.5f) * float(M_PI);
+    return glm::vec3(cosf(latitude) * sinf(longitude), sinf(latitude), cosf(latitude) * cosf(longitude));
+}
+
+VirtualTexture::VirtualTexture(const std::string& imgPath, int atlasSlots)
+    : _ready(false), _atlasSlots(atlasSlots), _frame(0), _lastViewProjection(0.0f), _lastModel(0.0f) {
+    std::string pagePath = imgPath + ".vt";
+    bool opened = openPageFile(imgPath, pagePath);
+    if (!opened) {
+        // the layout follows from the image size alone, the GL objects need not wait for the pages
+        MappedFile source(imgPath);
+        if (!source.isOpen()) {
+            throw std::runtime_error("VirtualTexture - VirtualTexture, no image file found for " + imgPath);
+        }
+        BmpLayout bmp = ImageLoader::parseBmp(source.getData(), source.getSize());
+        setLayout(bmp.width, bmp.height);
+    }
+
+    // page table: one texel per page, one mip level per pyramid level
+    _tableWidth = nextPowerOfTwo(_pagesX[0]);
+    _tableHeight = nextPowerOfTwo(_pagesY[0]);
+    glGenTextures(1, &_pageTable);
+    glBindTexture(GL_TEXTURE_2D, _pageTable);
+    for (auto level = 0; level < _levelNum; level++) {
+        uint32_t width = std::max(_tableWidth >> level, 1u), height = std::max(_tableHeight >> level, 1u);
+        _tableLevels.push_back(std::vector<unsigned char>(size_t(width) * height * 4, 0));
+        glTexImage2D(GL_TEXTURE_2D, level, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    }
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, _levelNum - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    // the atlas, allocated once
+    GLsizei atlasSize = _atlasSlots * SLOT_SIZE;
+    glGenTextures(1, &_atlas);
+    glBindTexture(GL_TEXTURE_2D, _atlas);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, atlasSize, atlasSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, nullptr);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    Slot freeSlot = {NO_PAGE, 0, false};
+    _slots.assign(size_t(_atlasSlots) * _atlasSlots, freeSlot);
+
+    if (opened) {
+        uploadPinnedPages();
+        return;
+    }
+    // cut on the workers, possibly GBs for a large image, the pinned pages are uploaded on the GL thread after
+    printf("building the virtual texture pages of %s in the background\n", imgPath.c_str());
+    auto& jobs = JobSystem::init();
+    JobSystem::JobHandle build = jobs.submit([imgPath, pagePath]() { buildPageFile(imgPath, pagePath); });
+    _build = jobs.submitMain([this, imgPath, pagePath, build]() {
+        // rethrows the error of the build
+        JobSystem::init().wait(build);
+        uint32_t width = _width, height = _height;
+        if (!openPageFile(imgPath, pagePath) || _width != width || _height != height) {
+            throw std::runtime_error("VirtualTexture - VirtualTexture, cannot open " + pagePath);
+        }
+        uploadPinnedPages();
+    }, {build});
+}
+
+void VirtualTexture::uploadPinnedPages() {
+    // the two coarsest levels stay resident, a handful of pages
+    for (auto level = std::max(_levelNum - 2, 0); level < _levelNum; level++) {
+        for (uint32_t y = 0; y < _pagesY[level]; y++) {
+            for (uint32_t x = 0; x < _pagesX[level]; x++) {
+                int slot = allocateSlot();
+                if (slot < 0) {
+                    throw std::runtime_error("VirtualTexture - uploadPinnedPages, atlas too small");
+                }
+                uploadPage(pageKey(level, x, y), slot);
+                _slots[slot].pinned = true;
+            }
+        }
+    }
+    updatePageTable();
+    _ready = true;
+}
+
+VirtualTexture::~VirtualTexture() {
+    // a build in progress still refers to the texture, it can not be cancelled
+    if (_build) {
+        try {
+            JobSystem::init().wait(_build);
+        } catch (std::exception& e) {
+            printf("[VT] %s\n", e.what());
+        }
+    }
+    glDeleteTextures(1, &_pageTable);
+    glDeleteTextures(1, &_atlas);
+}
+
+size_t VirtualTexture::getGpuBytes() const {
+    size_t bytes = _slots.size() * SLOT_BYTES;
+    for (const std::vector<unsigned char>& level : _tableLevels) {
+        bytes += level.size();
+    }
+    return bytes;
+}
+
+bool VirtualTexture::openPageFile(const std::string& imgPath, const std::string& pagePath) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!statFile(imgPath, sourceSize, sourceTime)) {
+        throw std::runtime_error("VirtualTexture - openPageFile, no image file found for " + imgPath);
+    }
+    std::unique_ptr<MappedFile> file(new MappedFile(pagePath));
+    if (!file->isOpen() || file->getSize() < sizeof(PageFileHeader)) {
+        return false;
+    }
+    PageFileHeader header;
+    memcpy(&header, file->getData(), sizeof(header));
+    if (memcmp(header.magic, PAGE_FILE_MAGIC, sizeof(PAGE_FILE_MAGIC)) != 0 || header.version != PAGE_FILE_VERSION ||
+        header.pageSize != uint32_t(PAGE_SIZE) || header.pageBorder != uint32_t(PAGE_BORDER) ||
+        header.sourceSize != sourceSize || header.sourceTime != sourceTime) {
+        return false;
+    }
+
+    uint64_t size = setLayout(header.width, header.height);
+    if (uint32_t(_levelNum) != header.levelNum || size != file->getSize()) {
+        return false;
+    }
+    _file = std::move(file);
+    return true;
+}
+
+uint64_t VirtualTexture::setLayout(uint32_t width, uint32_t height) {
+    std::vector<uint32_t> levelWidths, levelHeights;
+    levelLayout(width, height, levelWidths, levelHeights, _levelNum);
+    _width = width;
+    _height = height;
+    _pagesX.clear();
+    _pagesY.clear();
+    _levelOffsets.clear();
+    uint64_t offset = sizeof(PageFileHeader);
+    for (auto level = 0; level < _levelNum; level++) {
+        _pagesX.push_back((levelWidths[level] + PAGE_SIZE - 1) / PAGE_SIZE);
+        _pagesY.push_back((levelHeights[level] + PAGE_SIZE - 1) / PAGE_SIZE);
+        _levelOffsets.push_back(offset);
+        offset += uint64_t(_pagesX[level]) * _pagesY[level] * SLOT_BYTES;
+    }
+    return offset;
+}
+
+void VirtualTexture::buildPageFile(const std::string& imgPath, const std::string& pagePath) {
+    MappedFile source(imgPath);
+    if (!source.isOpen()) {
+        throw std::runtime_error("VirtualTexture - buildPageFile, no image file found for " + imgPath);
+    }
+    source.adviseSequential();
+    BmpLayout bmp = ImageLoader::parseBmp(source.getData(), source.getSize());
+
+    PageFileHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, PAGE_FILE_MAGIC, sizeof(PAGE_FILE_MAGIC));
+    header.version = PAGE_FILE_VERSION;
+    header.pageSize = PAGE_SIZE;
+    header.pageBorder = PAGE_BORDER;
+    header.width = bmp.width;
+    header.height = bmp.height;
+    statFile(imgPath, header.sourceSize, header.sourceTime);
+    std::vector<uint32_t> levelWidths, levelHeights;
+    int levelNum;
+    levelLayout(bmp.width, bmp.height, levelWidths, levelHeights, levelNum);
+    header.levelNum = uint32_t(levelNum);
+
+    // built under another name, an interrupted build is never taken for a complete one
+    std::string buildPath = pagePath + ".part";
+    FILE* file = fopen(buildPath.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("VirtualTexture - buildPageFile, cannot write " + buildPath);
+    }
+    fwrite(&header, sizeof(header), 1, file);
+    uint64_t previousOffset = sizeof(header);
+    uint64_t offset = sizeof(header);
+
+    // one row of pages at a time, longitude wraps around and latitude is clamped
+    for (auto level = 0; level < levelNum; level++) {
+        uint32_t width = levelWidths[level], height = levelHeights[level];
+        uint32_t pagesX = (width + PAGE_SIZE - 1) / PAGE_SIZE, pagesY = (height + PAGE_SIZE - 1) / PAGE_SIZE;
+        std::vector<unsigned char> strip(pagesX * SLOT_BYTES);
+
+        // the previous level is read back from the file written so far
+        std::unique_ptr<MappedFile> previous;
+        uint32_t previousWidth = 0, previousHeight = 0, previousPagesX = 0;
+        if (level > 0) {
+            fclose(file);
+            previous.reset(new MappedFile(buildPath));
+            file = fopen(buildPath.c_str(), "ab");
+            if (!previous->isOpen() || !file) {
+                throw std::runtime_error("VirtualTexture - buildPageFile, cannot read back " + buildPath);
+            }
+            previousWidth = levelWidths[level - 1];
+            previousHeight = levelHeights[level - 1];
+            previousPagesX = (previousWidth + PAGE_SIZE - 1) / PAGE_SIZE;
+        }
+        auto previousTexel = [&](uint32_t x, uint32_t y) {
+            x %= previousWidth;
+            y = std::min(y, previousHeight - 1);
+            uint64_t page = previousOffset + (uint64_t(y / PAGE_SIZE) * previousPagesX + x / PAGE_SIZE) * SLOT_BYTES;
+            return previous->getData() + page +
+                   ((size_t(y % PAGE_SIZE) + PAGE_BORDER) * SLOT_SIZE + x % PAGE_SIZE + PAGE_BORDER) * 4;
+        };
+
+        for (uint32_t pageY = 0; pageY < pagesY; pageY++) {
+            // the pages of a strip on the workers, each writes its own slot
+            JobSystem::init().parallelFor(0, int(pagesX), 1, [&](int first, int last) {
+                for (auto pageX = uint32_t(first); pageX < uint32_t(last); pageX++) {
+                    unsigned char* slot = &strip[pageX * SLOT_BYTES];
+                    for (auto j = 0; j < SLOT_SIZE; j++) {
+                        int64_t rowY = int64_t(pageY) * PAGE_SIZE + j - PAGE_BORDER;
+                        uint32_t y = uint32_t(std::min<int64_t>(std::max<int64_t>(rowY, 0), height - 1));
+                        const unsigned char* sourceRow = level == 0 ? bmp.getRow(source.getData(), y) : nullptr;
+                        for (auto i = 0; i < SLOT_SIZE; i++) {
+                            int64_t columnX = int64_t(pageX) * PAGE_SIZE + i - PAGE_BORDER;
+                            uint32_t x = uint32_t((columnX % width + width) % width);
+                            unsigned char* output = slot + (size_t(j) * SLOT_SIZE + i) * 4;
+                            if (level == 0) {
+                                // BGR(A) to RGBA
+                                const unsigned char* input = sourceRow + bmp.bytesPerPixel * x;
+                                output[0] = input[2];
+                                output[1] = input[1];
+                                output[2] = input[0];
+                                output[3] = 255;
+                            } else {
+                                // box filter of the 2x2 texels below
+                                const unsigned char* a = previousTexel(2 * x, 2 * y);
+                                const unsigned char* b = previousTexel(2 * x + 1, 2 * y);
+                                const unsigned char* c = previousTexel(2 * x, 2 * y + 1);
+                                const unsigned char* d = previousTexel(2 * x + 1, 2 * y + 1);
+                                for (auto k = 0; k < 4; k++) {
+                                    output[k] = (unsigned char)((a[k] + b[k] + c[k] + d[k] + 2) / 4);
+                                }
+                            }
+                        }
+                    }
+                }
+            });
+            if (fwrite(strip.data(), 1, strip.size(), file) != strip.size()) {
+                fclose(file);
+                remove(buildPath.c_str());
+                throw std::runtime_error("VirtualTexture - buildPageFile, cannot write " + buildPath);
+            }
+        }
+        previousOffset = offset;
+        offset += uint64_t(pagesX) * pagesY * SLOT_BYTES;
+    }
+    fclose(file);
+    remove(pagePath.c_str());
+    if (rename(buildPath.c_str(), pagePath.c_str()) != 0) {
+        throw std::runtime_error("VirtualTexture - buildPageFile, cannot rename " + buildPath);
+    }
+}
+
+int VirtualTexture::update(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection,
+                            int viewportWidth, int viewportHeight) {
+    if (!_ready) {
+        return 0;
+    }
+    _frame++;
+    glm::mat4 viewProjection = projection * view;
+    if (viewProjection != _lastViewProjection || model != _lastModel) {
+        _lastViewProjection = viewProjection;
+        _lastModel = model;
+
+        // frustum planes, pointing inwards
+        glm::vec4 planes[6];
+        glm::mat4 m = glm::transpose(viewProjection);
+        for (auto i = 0; i < 3; i++) {
+            planes[2 * i] = m[3] + m[i];
+            planes[2 * i + 1] = m[3] - m[i];
+        }
+        for (glm::vec4& plane : planes) {
+            plane /= glm::length(glm::vec3(plane));
+        }
+        glm::vec3 camera = glm::vec3(glm::inverse(view)[3]);
+
+        _requests.clear();
+        requestPages(_levelNum - 1, 0, 0, model, viewProjection, planes, camera,
+                     glm::vec2(viewportWidth, viewportHeight));
+        fitRequests();
+
+        _missing.clear();
+        for (uint32_t key : _requests) {
+            if (_resident.find(key) == _resident.end()) {
+                _missing.push_back(key);
+            }
+        }
+        // coarse pages first, they cover the most screen
+        std::stable_sort(_missing.begin(), _missing.end(), [](uint32_t a, uint32_t b) {
+            return keyLevel(a) > keyLevel(b);
+        });
+    }
+    for (uint32_t key : _requests) {
+        auto found = _resident.find(key);
+        if (found != _resident.end()) {
+            _slots[found->second].lastUsed = _frame;
+        }
+    }
+
+    size_t uploads = 0;
+    while (uploads < _missing.size() && uploads < size_t(MAX_UPLOADS)) {
+        int slot = allocateSlot();
+        if (slot < 0) {
+            // every slot is in use this frame, the coarser pages stand in
+            break;
+        }
+        uploadPage(_missing[uploads], slot);
+        uploads++;
+    }
+    _missing.erase(_missing.begin(), _missing.begin() + uploads);
+    // read the next pages from disk while this frame renders
+    for (size_t i = 0; i < _missing.size() && i < size_t(MAX_UPLOADS); i++) {
+        uint32_t key = _missing[i];
+        int level = keyLevel(key);
+        _file->prefetch(size_t(_levelOffsets[level] + (uint64_t(keyY(key)) * _pagesX[level] + keyX(key)) * SLOT_BYTES),
+                        SLOT_BYTES);
+    }
+    if (uploads > 0) {
+        updatePageTable();
+    }
+    return int(uploads);
+}
+
+void VirtualTexture::requestPages(int level, uint32_t x, uint32_t y, const glm::mat4& model,
+                                  const glm::mat4& viewProjection, const glm::vec4 planes[6], const glm::vec3& camera,
+                                  const glm::vec2& viewport) {
+    // the uv rectangle of the page, the last pages run past the image
+    float pageTexels = float(PAGE_SIZE) * float(1u << level);
+    float u0 = std::min(x * pageTexels / _width, 1.0f), u1 = std::min((x + 1) * pageTexels / _width, 1.0f);
+    float v0 = std::min(y * pageTexels / _height, 1.0f), v1 = std::min((y + 1) * pageTexels / _height, 1.0f);
+
+    // a 3x3 grid over the patch
+    glm::vec3 points[9];
+    glm::vec4 clips[9];
+    bool facing[9];
+    bool anyFacing = false;
+    for (auto j = 0; j < 3; j++) {
+        for (auto i = 0; i < 3; i++) {
+            int k = 3 * j + i;
+            points[k] = glm::vec3(model * glm::vec4(spherePoint(u0 + (u1 - u0) * 0.5f * i,
+                                                                v0 + (v1 - v0) * 0.5f * j), 1.0f));
+            clips[k] = viewProjection * glm::vec4(points[k], 1.0f);
+            // on the unit globe the point is its own normal
+            facing[k] = glm::dot(points[k], camera - points[k]) > 0.0f;
+            anyFacing = anyFacing || facing[k];
+        }
+    }
+
+    // bounding sphere of the patch, with some room for the bulge of the surface between the samples
+    float radius = 0.0f;
+    for (const glm::vec3& point : points) {
+        radius = std::max(radius, glm::length(point - points[4]));
+    }
+    radius *= 1.25f;
+    for (auto i = 0; i < 6; i++) {
+        if (glm::dot(glm::vec3(planes[i]), points[4]) + planes[i].w < -radius) {
+            return;
+        }
+    }
+    // a large patch can face the camera between its samples
+    if (!anyFacing && radius < 0.5f) {
+        return;
+    }
+
+    // the finest level the samples need: texels per pixel along u and v, measured over a small step around each
+    // sample, the worse direction decides as in the shader
+    const float step = 1e-3f;
+    int needed = level;
+    bool measured = false;
+    for (auto j = 0; j < 3; j++) {
+        for (auto i = 0; i < 3; i++) {
+            int k = 3 * j + i;
+            if (!facing[k] || clips[k].w <= 0.0f) {
+                continue;
+            }
+            float u = u0 + (u1 - u0) * 0.5f * i, v = v0 + (v1 - v0) * 0.5f * j;
+            // step towards the inside of the uv range
+            float stepU = u < 0.5f ? step : -step, stepV = v < 0.5f ? step : -step;
+            glm::vec4 clipU = viewProjection * model * glm::vec4(spherePoint(u + stepU, v), 1.0f);
+            glm::vec4 clipV = viewProjection * model * glm::vec4(spherePoint(u, v + stepV), 1.0f);
+            if (clipU.w <= 0.0f || clipV.w <= 0.0f) {
+                continue;
+            }
+            glm::vec2 screen = glm::vec2(clips[k]) / clips[k].w * 0.5f * viewport;
+            float pixelsU = glm::length(glm::vec2(clipU) / clipU.w * 0.5f * viewport - screen);
+            float pixelsV = glm::length(glm::vec2(clipV) / clipV.w * 0.5f * viewport - screen);
+            float texelsPerPixel = std::max(step * _width / std::max(pixelsU, 1e-6f),
+                                            step * _height / std::max(pixelsV, 1e-6f));
+            int sampleLevel = texelsPerPixel > 1.0f ? int(floorf(log2f(texelsPerPixel))) : 0;
+            needed = std::min(needed, sampleLevel);
+            measured = true;
+        }
+    }
+
+    // a large patch whose visible part falls between the samples is split until the samples catch it
+    if (level == 0 || (measured && needed >= level)) {
+        _requests.push_back(pageKey(level, x, y));
+        return;
+    }
+    for (uint32_t childY = 2 * y; childY < std::min(2 * y + 2, _pagesY[level - 1]); childY++) {
+        for (uint32_t childX = 2 * x; childX < std::min(2 * x + 2, _pagesX[level - 1]); childX++) {
+            requestPages(level - 1, childX, childY, model, viewProjection, planes, camera, viewport);
+        }
+    }
+}
+
+void VirtualTexture::fitRequests() {
+    size_t capacity = 0;
+    for (const Slot& slot : _slots) {
+        capacity += slot.pinned ? 0 : 1;
+    }
+    while (_requests.size() > capacity) {
+        int finest = _levelNum;
+        for (uint32_t key : _requests) {
+            finest = std::min(finest, keyLevel(key));
+        }
+        if (finest >= _levelNum - 1) {
+            break;
+        }
+        for (uint32_t& key : _requests) {
+            if (keyLevel(key) == finest) {
+                key = pageKey(finest + 1, keyX(key) / 2, keyY(key) / 2);
+            }
+        }
+        std::sort(_requests.begin(), _requests.end());
+        _requests.erase(std::unique(_requests.begin(), _requests.end()), _requests.end());
+    }
+}
+
+int VirtualTexture::allocateSlot() {
+    int best = -1;
+    for (size_t i = 0; i < _slots.size(); i++) {
+        const Slot& slot = _slots[i];
+        if (slot.page == NO_PAGE) {
+            return int(i);
+        }
+        if (!slot.pinned && slot.lastUsed < _frame && (best < 0 || slot.lastUsed < _slots[best].lastUsed)) {
+            best = int(i);
+        }
+    }
+    if (best >= 0) {
+        _resident.erase(_slots[best].page);
+        _changedPages.push_back(_slots[best].page);
+        _slots[best].page = NO_PAGE;
+    }
+    return best;
+}
+
+void VirtualTexture::uploadPage(uint32_t key, int slot) {
+    int level = keyLevel(key);
+    uint64_t offset = _levelOffsets[level] + (uint64_t(keyY(key)) * _pagesX[level] + keyX(key)) * SLOT_BYTES;
+    glBindTexture(GL_TEXTURE_2D, _atlas);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, (slot % _atlasSlots) * SLOT_SIZE, (slot / _atlasSlots) * SLOT_SIZE, SLOT_SIZE,
+                    SLOT_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, _file->getData() + offset);
+    _slots[slot].page = key;
+    _slots[slot].lastUsed = _frame;
+    _resident[key] = slot;
+    _changedPages.push_back(key);
+}
+
+void VirtualTexture::updatePageTable() {
+    glBindTexture(GL_TEXTURE_2D, _pageTable);
+    for (uint32_t key : _changedPages) {
+        // the entry of the page, then the ones of the finer pages under it, which may show it in their place
+        uint32_t x0 = keyX(key), y0 = keyY(key), x1 = x0 + 1, y1 = y0 + 1;
+        for (auto level = keyLevel(key); level >= 0; level--) {
+            uint32_t width = std::max(_tableWidth >> level, 1u), height = std::max(_tableHeight >> level, 1u);
+            x1 = std::min(x1, width);
+            y1 = std::min(y1, height);
+            for (uint32_t y = y0; y < y1; y++) {
+                for (uint32_t x = x0; x < x1; x++) {
+                    writeTableEntry(level, x, y);
+                }
+            }
+            glPixelStorei(GL_UNPACK_ROW_LENGTH, width);
+            glTexSubImage2D(GL_TEXTURE_2D, level, x0, y0, x1 - x0, y1 - y0, GL_RGBA, GL_UNSIGNED_BYTE,
+                            &_tableLevels[level][(size_t(y0) * width + x0) * 4]);
+            x0 *= 2;
+            y0 *= 2;
+            x1 *= 2;
+            y1 *= 2;
+        }
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    _changedPages.clear();
+}
+
+void VirtualTexture::writeTableEntry(int level, uint32_t x, uint32_t y) {
+    uint32_t width = std::max(_tableWidth >> level, 1u);
+    unsigned char* entry = &_tableLevels[level][(size_t(y) * width + x) * 4];
+    auto found = _resident.find(pageKey(level, x, y));
+    if (found != _resident.end()) {
+        entry[0] = (unsigned char)(found->second % _atlasSlots);
+        entry[1] = (unsigned char)(found->second / _atlasSlots);
+        entry[2] = (unsigned char)level;
+        entry[3] = 255;
+    } else if (level + 1 < _levelNum) {
+        // a page that is not resident shows the entry of its parent
+        uint32_t parentWidth = std::max(_tableWidth >> (level + 1), 1u);
+        uint32_t parentHeight = std::max(_tableHeight >> (level + 1), 1u);
+        uint32_t parentX = std::min(x / 2, parentWidth - 1), parentY = std::min(y / 2, parentHeight - 1);
+        memcpy(entry, &_tableLevels[level + 1][(size_t(parentY) * parentWidth + parentX) * 4], 4);
+    } else {
+        memset(entry, 0, 4);
+    }
+}
+
+void VirtualTexture::setUniforms(ShaderProgram* program) const {
+    // the plain globe texture stands in until the pages are built
+    glUniform1i(program->getUniform("virtualTextureEnabled"), _ready ? 1 : 0);
+    glUniform1i(program->getUniform("pageTableSampler"), TABLE_UNIT);
+    glUniform1i(program->getUniform("pageAtlasSampler"), ATLAS_UNIT);
+    glUniform2f(program->getUniform("vtImageSize"), float(_width), float(_height));
+    glUniform2f(program->getUniform("vtTableScale"), float(_width) / (float(_tableWidth) * PAGE_SIZE),
+                float(_height) / (float(_tableHeight) * PAGE_SIZE));
+    glUniform4f(program->getUniform("vtPage"), float(PAGE_SIZE), float(PAGE_BORDER), float(SLOT_SIZE),
+                float(_atlasSlots * SLOT_SIZE));
+    glUniform1f(program->getUniform("vtMaxLevel"), float(_levelNum - 1));
+}
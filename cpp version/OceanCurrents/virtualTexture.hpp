@@ -0,0 +1,185 @@
+/**
+ * virtual texturing of the globe imagery: images of any size shown with a fixed amount of GPU memory.
+ *
+ * the image is cut once into a pyramid of pages on the workers, stored next to it as '<imgPath>.vt'. every camera
+ * change the globe is walked as a quadtree of pages, from the coarsest level down to the level the screen needs,
+ * skipping the patches outside the frustum or facing away. the pages found are streamed from the mapped page file
+ * into the slots of a physical atlas, the least recently used slots being reused first. a page table texture, one
+ * texel per page and one mip level per pyramid level, tells the shader which slot holds each page, or the nearest
+ * coarser page that is resident. only the entries under the pages that came or went are rewritten.
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef VIRTUAL_TEXTURE_HPP
+#define VIRTUAL_TEXTURE_HPP
+
+#include <stdint.h>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include <GL/glew.h>
+#include <glm/glm.hpp>
+
+#include "jobSystem.hpp"
+#include "utils/mappedFile.hpp"
+#include "utils/shaderProgram.hpp"
+
+class VirtualTexture {
+public:
+    // texels of a page, without the border
+    static const int PAGE_SIZE = 128;
+
+    // texels copied from the neighbour pages on each side, so bilinear filtering never reads past its slot
+    static const int PAGE_BORDER = 4;
+
+    static const int SLOT_SIZE = PAGE_SIZE + 2 * PAGE_BORDER;
+
+    // pages uploaded per update at most, the others are prefetched and wait for the next updates
+    static const int MAX_UPLOADS = 16;
+
+    // texture units of the page table and of the atlas, after the ones of the globe textures
+    static const int TABLE_UNIT = 2;
+    static const int ATLAS_UNIT = 3;
+
+    /**
+     * @brief open the page file of an uncompressed BMP image, building it first if it is missing or stale.
+     *
+     * a build runs on the workers of the JobSystem and the constructor returns right away, the texture is ready
+     * once JobSystem::runMainJobs ran the job that opens the file. the coarsest levels are uploaded then and never
+     * evicted, so there is always a page to fall back to.
+     *
+     * @param atlasSlots slots per side of the atlas, the GPU memory is (atlasSlots * SLOT_SIZE)^2 * 4 bytes
+     */
+    VirtualTexture(const std::string& imgPath, int atlasSlots = 16);
+
+    ~VirtualTexture();
+
+    /**
+     * @brief find the pages visible with these matrices and upload the missing ones, call it every frame.
+     *
+     * the visible pages are only searched again when a matrix changed, the uploads go on until they are all in.
+     *
+     * @return the number of pages uploaded, the picture changed if not 0
+     */
+    int update(const glm::mat4& model, const glm::mat4& view, const glm::mat4& projection, int viewportWidth,
+                int viewportHeight);
+
+    // set the sampling uniforms of the program, which must be in use, again once the texture is ready
+    void setUniforms(ShaderProgram* program) const;
+
+    // the pages are built and the coarsest ones resident, update and the shader do nothing before
+    bool isReady() const { return _ready; }
+
+    GLuint getPageTable() const { return _pageTable; }
+
+    GLuint getAtlas() const { return _atlas; }
+
+    int getLevelNum() const { return _levelNum; }
+
+    // pages the last search asked for, and how many of them are resident
+    size_t getRequestedCount() const { return _requests.size(); }
+
+    size_t getMissingCount() const { return _missing.size(); }
+
+    // atlas and page table, fixed whatever the image size
+    size_t getGpuBytes() const;
+
+    // cut an image into the page pyramid, on the CPU
+    static void buildPageFile(const std::string& imgPath, const std::string& pagePath);
+
+private:
+    struct Slot {
+        // the page in the slot, NO_PAGE if free
+        uint32_t page;
+        uint64_t lastUsed;
+        bool pinned;
+    };
+
+    static const uint32_t NO_PAGE = 0xFFFFFFFFu;
+
+    std::unique_ptr<MappedFile> _file;
+
+    bool _ready;
+
+    // opens the page file once it is built, null if it was found
+    JobSystem::JobHandle _build;
+
+    // image size in texels
+    uint32_t _width;
+    uint32_t _height;
+
+    int _levelNum;
+
+    // existing pages of each level and where they start in the file
+    std::vector<uint32_t> _pagesX;
+    std::vector<uint32_t> _pagesY;
+    std::vector<uint64_t> _levelOffsets;
+
+    // page table size at level 0, the page counts rounded up to powers of two so that its mip levels match
+    uint32_t _tableWidth;
+    uint32_t _tableHeight;
+
+    // CPU copy of every level of the page table, RGBA8: slot x, slot y, level, valid
+    std::vector<std::vector<unsigned char>> _tableLevels;
+
+    GLuint _pageTable;
+
+    GLuint _atlas;
+
+    int _atlasSlots;
+
+    std::vector<Slot> _slots;
+
+    // page key to slot index
+    std::unordered_map<uint32_t, int> _resident;
+
+    // pages uploaded or evicted since the last updatePageTable
+    std::vector<uint32_t> _changedPages;
+
+    std::vector<uint32_t> _requests;
+
+    // requested pages not resident yet, coarse ones first
+    std::vector<uint32_t> _missing;
+
+    uint64_t _frame;
+
+    // the matrices of the last search
+    glm::mat4 _lastViewProjection;
+    glm::mat4 _lastModel;
+
+    static uint32_t pageKey(int level, uint32_t x, uint32_t y) { return uint32_t(level) << 24 | y << 12 | x; }
+
+    static int keyLevel(uint32_t key) { return int(key >> 24); }
+
+    static uint32_t keyX(uint32_t key) { return key & 0xFFF; }
+
+    static uint32_t keyY(uint32_t key) { return (key >> 12) & 0xFFF; }
+
+    bool openPageFile(const std::string& imgPath, const std::string& pagePath);
+
+    // the size and the pages of every level, returns the size of the page file
+    uint64_t setLayout(uint32_t width, uint32_t height);
+
+    // upload the coarsest levels, pinned, and mark the texture ready
+    void uploadPinnedPages();
+
+    // walk the page quadtree below a page, adding the pages to draw to _requests
+    void requestPages(int level, uint32_t x, uint32_t y, const glm::mat4& model, const glm::mat4& viewProjection,
+                      const glm::vec4 planes[6], const glm::vec3& camera, const glm::vec2& viewport);
+
+    // replace the finest requests by their parents until they fit the atlas
+    void fitRequests();
+
+    // a free slot, or the least recently used one not needed this frame, -1 if there is none
+    int allocateSlot();
+
+    void uploadPage(uint32_t key, int slot);
+
+    // rewrite the entries of the changed pages and of the finer pages showing them
+    void updatePageTable();
+
+    void writeTableEntry(int level, uint32_t x, uint32_t y);
+};
+
+#endif
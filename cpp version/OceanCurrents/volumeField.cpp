@@ -0,0 +1,283 @@
+/* 3D currents over the levels of a GeoVolume, for pathlines through the depths such as upwelling and downwelling
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#include "volumeField.hpp"
+#include <math.h>
+#include <algorithm>
+
+#include "derivedFields.hpp"
+#include "jobSystem.hpp"
+#include "rk4.hpp"
+
+// pathlines integrated together, a multiple of the SIMD width
+static const int LANES = 8;
+
+// samples along each axis of a brick, the far faces included
+static const int BRICK_SIDE = VolumeField::BRICK_CELLS + 1;
+static const int BRICK_SAMPLES = BRICK_SIDE * BRICK_SIDE * BRICK_SIDE;
+
+// the axes of a PathBatch, in grid coordinates
+static const int COLUMN = 0;
+static const int ROW = 1;
+static const int LEVEL = 2;
+
+typedef LaneBatch<3, LANES> PathBatch;
+
+VolumeField::VolumeField(const GeoVolume<float>& u, const GeoVolume<float>& v, const GeoVolume<float>& w,
+                         bool depthLevels)
+    : _lonNum(u.longitudeNum_), _latNum(u.latitudeNum_), _levelNum(int(u.heightOfLevels_.size())),
+      _lonStart(u.longitudeStart_), _lonInterval(u.longitudeStep_), _latStart(u.latitudeStart_),
+      _latInterval(u.latitudeStep_), _wrap(false), _heights(u.heightOfLevels_), _brickColumns(0), _brickRows(0),
+      _brickLevels(0), _steps(0) {
+    size_t levelSize = size_t(_latNum) * _lonNum;
+    if (!isSameGeoInfo(u, v) || !isSameGeoInfo(u, w) || _lonNum < 2 || _latNum < 2 || _levelNum < 1 ||
+        u.volData_.size() != levelSize * _levelNum || v.volData_.size() != u.volData_.size() ||
+        w.volData_.size() != u.volData_.size()) {
+        return;
+    }
+    for (auto k = 0; k + 1 < _levelNum; k++) {
+        if (!(_heights[k + 1] > _heights[k])) {
+            // the reader sorts the levels, anything else is not a volume we can place points in
+            return;
+        }
+    }
+    _wrap = fabs(_lonInterval) * _lonNum >= 360.0 - 1e-6;
+    _levelScales.assign(std::max(_levelNum - 1, 1), 0.0f);
+    for (auto k = 0; k + 1 < _levelNum; k++) {
+        _levelScales[k] = float((depthLevels ? -1.0 : 1.0) / (_heights[k + 1] - _heights[k]));
+    }
+
+    // a wrapping grid has a cell between its last column and the first one
+    int columnCells = _wrap ? _lonNum : _lonNum - 1;
+    int layerNum = std::max(_levelNum - 1, 1);
+    _brickColumns = (columnCells + BRICK_CELLS - 1) / BRICK_CELLS;
+    _brickRows = (_latNum - 1 + BRICK_CELLS - 1) / BRICK_CELLS;
+    _brickLevels = (layerNum + BRICK_CELLS - 1) / BRICK_CELLS;
+    _bricks.resize(size_t(_brickColumns) * _brickRows * _brickLevels * BRICK_SAMPLES);
+
+    double latRadians = _latInterval * M_PI / 180.0;
+    double lonRadians = _lonInterval * M_PI / 180.0;
+    float rowScale = float(1.0 / (EARTH_RADIUS * latRadians));
+    std::vector<float> columnScales(_latNum);
+    for (auto m = 0; m < _latNum; m++) {
+        double cosLatitude = cos((_latStart + m * _latInterval) * M_PI / 180.0);
+        columnScales[m] = cosLatitude < MIN_COS_LATITUDE ? NAN :
+                          float(1.0 / (EARTH_RADIUS * cosLatitude * lonRadians));
+    }
+
+    // brick by brick, the samples past the edges of the grid repeat its last ones and are never interpolated
+    int brickNum = _brickColumns * _brickRows * _brickLevels;
+    JobSystem::init().parallelFor(0, brickNum, 1, [&](int first, int last) {
+        for (auto brick = first; brick < last; brick++) {
+            int bx = brick % _brickColumns;
+            int by = brick / _brickColumns % _brickRows;
+            int bz = brick / (_brickColumns * _brickRows);
+            BrickSample* out = &_bricks[size_t(brick) * BRICK_SAMPLES];
+            for (auto z = 0; z < BRICK_SIDE; z++) {
+                int k = std::min(bz * BRICK_CELLS + z, _levelNum - 1);
+                for (auto y = 0; y < BRICK_SIDE; y++) {
+                    int m = std::min(by * BRICK_CELLS + y, _latNum - 1);
+                    for (auto x = 0; x < BRICK_SIDE; x++, out++) {
+                        int n = bx * BRICK_CELLS + x;
+                        n = _wrap ? n % _lonNum : std::min(n, _lonNum - 1);
+                        size_t i = k * levelSize + size_t(m) * _lonNum + n;
+                        float east = u.volData_[i];
+                        float north = v.volData_[i];
+                        float up = w.volData_[i];
+                        bool masked = !isValidValue(east) || !isValidValue(north) || !isValidValue(up);
+                        out->columns = masked ? NAN : east * columnScales[m];
+                        out->rows = masked ? NAN : north * rowScale;
+                        out->up = masked ? NAN : up;
+                    }
+                }
+            }
+        }
+    });
+}
+
+float VolumeField::toLevel(float height) const {
+    if (_levelNum < 2 || height <= _heights.front()) {
+        return 0.0f;
+    }
+    if (height >= _heights.back()) {
+        return float(_levelNum - 1);
+    }
+    int k = int(std::upper_bound(_heights.begin(), _heights.end(), double(height)) - _heights.begin()) - 1;
+    return float(k + (height - _heights[k]) / (_heights[k + 1] - _heights[k]));
+}
+
+float VolumeField::toHeight(float level) const {
+    int k = std::min(std::max(int(level), 0), std::max(_levelNum - 2, 0));
+    if (_levelNum < 2) {
+        return float(_heights[0]);
+    }
+    return float(_heights[k] + (level - k) * (_heights[k + 1] - _heights[k]));
+}
+
+bool VolumeField::interpolate(float column, float row, float level, BrickSample& result, int& layer) const {
+    if (!(row >= 0.0f && row <= _latNum - 1) || (!_wrap && !(column >= 0.0f && column <= _lonNum - 1))) {
+        return false;
+    }
+    int columnCells = _wrap ? _lonNum : _lonNum - 1;
+    if (_wrap) {
+        column -= floorf(column / _lonNum) * _lonNum;
+    }
+    level = std::min(std::max(level, 0.0f), float(_levelNum - 1));
+    int cx = std::min(int(column), columnCells - 1);
+    int cy = std::min(int(row), _latNum - 2);
+    int cz = std::min(int(level), std::max(_levelNum - 2, 0));
+    float fx = column - cx;
+    float fy = row - cy;
+    float fz = level - cz;
+    int bx = cx / BRICK_CELLS;
+    int by = cy / BRICK_CELLS;
+    int bz = cz / BRICK_CELLS;
+    size_t brick = (size_t(bz) * _brickRows + by) * _brickColumns + bx;
+    int local = ((cz - bz * BRICK_CELLS) * BRICK_SIDE + cy - by * BRICK_CELLS) * BRICK_SIDE + cx - bx * BRICK_CELLS;
+    const BrickSample* s = &_bricks[brick * BRICK_SAMPLES + local];
+    // a single level repeats itself as the level below
+    const int up = _levelNum > 1 ? BRICK_SIDE * BRICK_SIDE : 0;
+    const BrickSample* corners[8] = {s, s + 1, s + BRICK_SIDE, s + BRICK_SIDE + 1,
+                                     s + up, s + up + 1, s + up + BRICK_SIDE, s + up + BRICK_SIDE + 1};
+    float weights[8] = {(1 - fx) * (1 - fy) * (1 - fz), fx * (1 - fy) * (1 - fz),
+                        (1 - fx) * fy * (1 - fz), fx * fy * (1 - fz),
+                        (1 - fx) * (1 - fy) * fz, fx * (1 - fy) * fz,
+                        (1 - fx) * fy * fz, fx * fy * fz};
+    // masked corners are NaN, which goes through the sums
+    result.columns = 0.0f;
+    result.rows = 0.0f;
+    result.up = 0.0f;
+    for (auto i = 0; i < 8; i++) {
+        result.columns += corners[i]->columns * weights[i];
+        result.rows += corners[i]->rows * weights[i];
+        result.up += corners[i]->up * weights[i];
+    }
+    layer = cz;
+    return result.columns == result.columns && result.rows == result.rows && result.up == result.up;
+}
+
+bool VolumeField::sample(const glm::vec3& point, glm::vec3& velocity) const {
+    if (!isValid()) {
+        return false;
+    }
+    float column = float((point.x - _lonStart) / _lonInterval);
+    float row = float((point.y - _latStart) / _latInterval);
+    BrickSample rates;
+    int layer;
+    if (!interpolate(column, row, toLevel(point.z), rates, layer)) {
+        return false;
+    }
+    // back from cells per second to m/s at the latitude of the point
+    double latitude = (_latStart + row * _latInterval) * M_PI / 180.0;
+    velocity.x = float(rates.columns * EARTH_RADIUS * cos(latitude) * _lonInterval * M_PI / 180.0);
+    velocity.y = float(rates.rows * EARTH_RADIUS * _latInterval * M_PI / 180.0);
+    velocity.z = rates.up;
+    return true;
+}
+
+void VolumeField::trace(const std::vector<glm::vec3>& seeds, const PathlineParam& param,
+                        Pathlines& pathlines) const {
+    int steps = std::max(param.steps, 0);
+    int recordInterval = std::max(param.recordInterval, 1);
+    int seedNum = int(seeds.size());
+    pathlines.pointNum = steps / recordInterval + 1 + (steps % recordInterval != 0 ? 1 : 0);
+    pathlines.points.resize(size_t(seedNum) * pathlines.pointNum);
+    pathlines.steps.assign(seedNum, 0);
+    if (seedNum == 0) {
+        return;
+    }
+    if (!isValid()) {
+        // nothing to follow, and no levels to place the seeds in, every pathline stays at its seed
+        for (auto i = 0; i < seedNum; i++) {
+            std::fill_n(pathlines.points.begin() + size_t(i) * pathlines.pointNum, pathlines.pointNum, seeds[i]);
+        }
+        return;
+    }
+    float step = param.stepSeconds;
+    int batchNum = (seedNum + LANES - 1) / LANES;
+
+    JobSystem::init().parallelFor(0, batchNum, 1, [&](int first, int last) {
+        for (auto batch = first; batch < last; batch++) {
+            int base = batch * LANES;
+            int laneNum = std::min(LANES, seedNum - base);
+            PathBatch points;
+            bool moving[LANES];
+            for (auto lane = 0; lane < LANES; lane++) {
+                // the lanes past the last seed repeat it
+                const glm::vec3& seed = seeds[base + std::min(lane, laneNum - 1)];
+                points.axes[COLUMN][lane] = float((seed.x - _lonStart) / _lonInterval);
+                points.axes[ROW][lane] = float((seed.y - _latStart) / _latInterval);
+                points.axes[LEVEL][lane] = toLevel(seed.z);
+                BrickSample rates;
+                int layer;
+                moving[lane] = interpolate(points.axes[COLUMN][lane], points.axes[ROW][lane],
+                                           points.axes[LEVEL][lane], rates, layer);
+            }
+
+            // a lane with a stage out of the grid or next to a masked sample stops before that step
+            bool valid[LANES];
+            auto velocity = [&](double, const PathBatch& at) {
+                PathBatch result;
+                for (auto lane = 0; lane < LANES; lane++) {
+                    BrickSample rates;
+                    int layer;
+                    bool inside = interpolate(at.axes[COLUMN][lane], at.axes[ROW][lane], at.axes[LEVEL][lane],
+                                              rates, layer);
+                    valid[lane] = valid[lane] && inside;
+                    result.axes[COLUMN][lane] = inside ? rates.columns : 0.0f;
+                    result.axes[ROW][lane] = inside ? rates.rows : 0.0f;
+                    result.axes[LEVEL][lane] = inside ? rates.up * _levelScales[layer] : 0.0f;
+                }
+                return result;
+            };
+
+            auto record = [&](int point) {
+                for (auto lane = 0; lane < laneNum; lane++) {
+                    glm::vec3& out = pathlines.points[size_t(base + lane) * pathlines.pointNum + point];
+                    double longitude = _lonStart + points.axes[COLUMN][lane] * _lonInterval;
+                    if (_wrap) {
+                        double span = _lonInterval * _lonNum;
+                        longitude -= floor((longitude - _lonStart) / span) * span;
+                    }
+                    out.x = float(longitude);
+                    out.y = float(_latStart + points.axes[ROW][lane] * _latInterval);
+                    out.z = toHeight(points.axes[LEVEL][lane]);
+                }
+            };
+
+            record(0);
+            int point = 1;
+            int stepsDone = 0;
+            for (auto s = 1; s <= steps; s++) {
+                if (std::find(moving, moving + laneNum, true) == moving + laneNum) {
+                    // all stopped, the points left repeat the last ones
+                    for (; point < pathlines.pointNum; point++) {
+                        record(point);
+                    }
+                    break;
+                }
+                std::fill(valid, valid + LANES, true);
+                PathBatch next = rk4Step(points, 0.0, step, velocity);
+                for (auto lane = 0; lane < LANES; lane++) {
+                    if (!moving[lane] || !valid[lane]) {
+                        moving[lane] = false;
+                        continue;
+                    }
+                    points.axes[COLUMN][lane] = next.axes[COLUMN][lane];
+                    points.axes[ROW][lane] = next.axes[ROW][lane];
+                    points.axes[LEVEL][lane] = std::min(std::max(next.axes[LEVEL][lane], 0.0f), float(_levelNum - 1));
+                    if (lane < laneNum) {
+                        pathlines.steps[base + lane]++;
+                    }
+                }
+                stepsDone++;
+                if (s % recordInterval == 0 || s == steps) {
+                    record(point++);
+                }
+            }
+            _steps += uint64_t(stepsDone) * LANES;
+        }
+    });
+}
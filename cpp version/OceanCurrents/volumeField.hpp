@@ -0,0 +1,131 @@
+/* 3D currents over the levels of a GeoVolume, for pathlines through the depths such as upwelling and downwelling
+ *
+ * author: alei  mailto:rayingecho@hotmail.com
+ */
+
+#ifndef VOLUME_FIELD_HPP
+#define VOLUME_FIELD_HPP
+
+#include <stdint.h>
+#include <atomic>
+#include <vector>
+#include <glm/glm.hpp>
+
+#include "GeoVolume.h"
+
+struct PathlineParam {
+    // seconds of a RK4 step, negative traces backward in time
+    float stepSeconds = 900.0f;
+    // RK4 steps per pathline
+    int steps = 96;
+    // steps between two points kept, the first and the last point are always kept
+    int recordInterval = 1;
+};
+
+// the pathlines of a trace, seed after seed
+struct Pathlines {
+    // points kept per pathline
+    int pointNum = 0;
+    // longitude and latitude in degrees and the vertical position in the units of heightOfLevels_
+    std::vector<glm::vec3> points;
+    // steps done by each pathline before it stopped on land, at the edge of a regional grid or through a pole, the
+    // points after that repeat where it stopped
+    std::vector<int> steps;
+};
+
+/**
+ * @brief the currents u, v and w of a volume sampled trilinearly, in bricks.
+ *
+ * the levels may be spaced unevenly, heightOfLevels_ gives them. the samples are kept in bricks of BRICK_CELLS cells
+ * along each axis, with the samples of the far faces repeated in the brick, so the 8 corners of any cell are in a
+ * single brick: a pathline moving through the depths stays in a few KB instead of jumping a whole level of the
+ * volume per cell up or down.
+ *
+ * the horizontal currents are stored in grid cells per second with the metric of the sphere applied. a sample is
+ * masked if a component is NaN, which is how the reader leaves the cells without data; a point next to a masked
+ * sample stops. the longitude wraps around when the grid covers the whole globe, the vertical position is clamped
+ * to the surface and the bottom level.
+ *
+ * the field is steady, a trace follows the currents of a single snapshot.
+ */
+class VolumeField {
+public:
+    // cells along each axis of a brick
+    static const int BRICK_CELLS = 8;
+
+    /**
+     * @param u eastward currents
+     * @param v northward currents, on the grid of u
+     * @param w vertical currents, upward, on the grid of u
+     * @param depthLevels heightOfLevels_ are depths, positive down, so an upward current makes them smaller
+     */
+    VolumeField(const GeoVolume<float>& u, const GeoVolume<float>& v, const GeoVolume<float>& w,
+                bool depthLevels = true);
+
+    // the volumes shared a grid of at least 2 x 2 cells and one level
+    bool isValid() const { return !_bricks.empty(); }
+
+    /**
+     * @brief the currents at a point in m/s, w upward.
+     *
+     * @param point longitude, latitude in degrees and the vertical position in the units of heightOfLevels_
+     * @return false if the point is out of the grid or next to a masked sample
+     */
+    bool sample(const glm::vec3& point, glm::vec3& velocity) const;
+
+    /**
+     * @brief trace a pathline from every seed with RK4, batches of seeds on the workers of the JobSystem.
+     *
+     * @param seeds longitude, latitude in degrees and the vertical position in the units of heightOfLevels_
+     * the pathlines of an invalid field never leave their seeds.
+     */
+    void trace(const std::vector<glm::vec3>& seeds, const PathlineParam& param, Pathlines& pathlines) const;
+
+    // RK4 steps of a batch lane so far, about the number of pathlines times their steps
+    uint64_t getStepCount() const { return _steps; }
+
+    size_t getBytes() const { return _bricks.size() * sizeof(BrickSample); }
+
+private:
+    // the horizontal currents in columns and rows per second, the vertical one as read
+    struct BrickSample {
+        float columns;
+        float rows;
+        float up;
+    };
+
+    int _lonNum;
+    int _latNum;
+    int _levelNum;
+    double _lonStart;
+    double _lonInterval;
+    double _latStart;
+    double _latInterval;
+    // the grid covers all longitudes, so its columns wrap around
+    bool _wrap;
+    std::vector<double> _heights;
+    // levels per unit of height between a level and the next one, with the sign of an upward current
+    std::vector<float> _levelScales;
+
+    // bricks along each axis
+    int _brickColumns;
+    int _brickRows;
+    int _brickLevels;
+    std::vector<BrickSample> _bricks;
+
+    mutable std::atomic<uint64_t> _steps;
+
+    // the vertical position as a fractional level index and back
+    float toLevel(float height) const;
+    float toHeight(float level) const;
+
+    /**
+     * @brief the trilinear sample at a point in grid coordinates: column, row and fractional level.
+     *
+     * @param layer the point is between this level and the next one, the index of its scale in _levelScales
+     * @return false if the point is out of the grid or next to a masked sample
+     */
+    bool interpolate(float column, float row, float level, BrickSample& result, int& layer) const;
+};
+
+#endif
@@ -4,163 +4,518 @@
  * @author alei  mailto:rayingecho@hotmail.com
  */
 #include "imageLoader.hpp"
+#include "mappedFile.hpp"
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include <stdexcept>
 
-GLuint ImageLoader::loadBmpAsTexture(std::string imgPath) {
-    unsigned char header[54];
-    unsigned int dataPos;
-    unsigned int imageSize;
-    unsigned int width, height;
-    // Actual RGB data
-    unsigned char * data;
-
-    // Open the file
-    FILE * file = fopen(imgPath.c_str(), "rb");
-    if (!file) {
-        throw std::runtime_error("loadBMP - no texture file found for" + imgPath);
-    }
-    // Read the header, i.e. the 54 first bytes
-    if (fread(header, 1, 54, file) != 54) {
-        throw std::runtime_error("loadBMP - illegal BMP file!");
-    }
-    // A BMP files always begins with "BM"
-    if (header[0] != 'B' || header[1] != 'M') {
-        throw std::runtime_error("loadBMP - illeagl BMP file!");
-    }
-    // Make sure this is a 24bpp file
-    if (*reinterpret_cast<int*>(&(header[0x1E])) != 0 ||
-        *reinterpret_cast<int*>(&(header[0x1C])) != 24) {
-        throw std::runtime_error("loadBMP - illeagl BMP file!");
-    }
+// the cache header, the source size and time tell whether the image changed since
+struct ImageCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t compress;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint32_t format;
+    uint32_t levelNum;
+    uint64_t pixelSize;
+};
 
-    // Read the information about the image
-    dataPos = *reinterpret_cast<int*>(&(header[0x0A]));
-    imageSize = *reinterpret_cast<int*>(&(header[0x22]));
-    width = *reinterpret_cast<int*>(&(header[0x12]));
-    height = *reinterpret_cast<int*>(&(header[0x16]));
+static const char IMAGE_CACHE_MAGIC[8] = {'O', 'C', 'I', 'M', 'A', 'G', 'E', '\0'};
+// bump when the mipmap filter or the block compression changes
+static const uint32_t IMAGE_CACHE_VERSION = 1;
 
-    // Some BMP files are misformatted, guess missing information
-    if (imageSize == 0) {
-        imageSize = width*height * 3; // 3 : one byte for each Red, Green and Blue component
-    }
-    if (dataPos == 0) {
-        dataPos = 54; // The BMP header is done that way
-    }
-
-    data = new unsigned char[imageSize];
-
-    // Read the actual data from the file into the buffer
-    fread(data, 1, imageSize, file);
+#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
+#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
+#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
 
-    // Everything is in memory now, the file wan be closed
-    fclose(file);
+// DDS pixel format flags
+#define DDPF_ALPHAPIXELS 0x1
+#define DDPF_FOURCC 0x4
+#define DDPF_RGB 0x40
 
-    // Create one OpenGL texture
-    GLuint textureID;
-    glGenTextures(1, &textureID);
+// little endian field of a file header, the headers are not aligned
+static uint32_t readUint32(const unsigned char* bytes) {
+    return uint32_t(bytes[0]) | uint32_t(bytes[1]) << 8 | uint32_t(bytes[2]) << 16 | uint32_t(bytes[3]) << 24;
+}
 
-    // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
+// bytes of a level, 0 for an empty level or an unknown format
+static uint64_t getLevelSize(uint32_t format, uint32_t width, uint32_t height) {
+    uint64_t blocks = ((uint64_t(width) + 3) / 4) * ((uint64_t(height) + 3) / 4);
+    switch (format) {
+    case GL_RGBA8:
+        return uint64_t(width) * height * 4;
+    case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+        return blocks * 8;
+    case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+    case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+        return blocks * 16;
+    default:
+        return 0;
+    }
+}
 
-    // Give the image to OpenGL
-    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, width, height, 0, GL_BGR, GL_UNSIGNED_BYTE, data);
+static uint16_t toRgb565(const unsigned char* rgb) {
+    return uint16_t((rgb[0] >> 3) << 11 | (rgb[1] >> 2) << 5 | (rgb[2] >> 3));
+}
 
-    // OpenGL has now copied the data. Free our own version
-    delete[] data;
+static void fromRgb565(uint16_t color, int* rgb) {
+    rgb[0] = ((color >> 11) & 31) * 255 / 31;
+    rgb[1] = ((color >> 5) & 63) * 255 / 63;
+    rgb[2] = (color & 31) * 255 / 31;
+}
 
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glGenerateMipmap(GL_TEXTURE_2D);
+/**
+ * @brief the 8 bytes of a DXT1 color block, endpoints on the inset bounding box of the 16 texels.
+ *
+ * the diagonal of the box follows the sign of the covariance, so colors that fall along the other diagonals
+ * still end up on the line between the endpoints.
+ */
+static void encodeColorBlock(const unsigned char block[16][4], unsigned char* output) {
+    int low[3] = {255, 255, 255}, high[3] = {0, 0, 0}, mean[3] = {0, 0, 0};
+    for (auto i = 0; i < 16; i++) {
+        for (auto c = 0; c < 3; c++) {
+            low[c] = std::min(low[c], int(block[i][c]));
+            high[c] = std::max(high[c], int(block[i][c]));
+            mean[c] += block[i][c];
+        }
+    }
+    int covarianceG = 0, covarianceB = 0;
+    for (auto i = 0; i < 16; i++) {
+        int r = block[i][0] * 16 - mean[0];
+        covarianceG += r * (block[i][1] * 16 - mean[1]);
+        covarianceB += r * (block[i][2] * 16 - mean[2]);
+    }
+    if (covarianceG < 0) {
+        std::swap(low[1], high[1]);
+    }
+    if (covarianceB < 0) {
+        std::swap(low[2], high[2]);
+    }
+    unsigned char endpoints[2][3];
+    for (auto c = 0; c < 3; c++) {
+        // a sixteenth inside the box, the extremes are rarely worth their precision
+        int inset = (high[c] - low[c]) / 16;
+        endpoints[0][c] = (unsigned char)(high[c] - inset);
+        endpoints[1][c] = (unsigned char)(low[c] + inset);
+    }
+    uint16_t color0 = toRgb565(endpoints[0]);
+    uint16_t color1 = toRgb565(endpoints[1]);
+    uint32_t indices = 0;
+    if (color0 != color1) {
+        // color0 > color1 selects the 4 color mode
+        if (color0 < color1) {
+            std::swap(color0, color1);
+        }
+        int palette[4][3];
+        fromRgb565(color0, palette[0]);
+        fromRgb565(color1, palette[1]);
+        for (auto c = 0; c < 3; c++) {
+            palette[2][c] = (2 * palette[0][c] + palette[1][c]) / 3;
+            palette[3][c] = (palette[0][c] + 2 * palette[1][c]) / 3;
+        }
+        for (auto i = 0; i < 16; i++) {
+            int best = 0, bestDistance = 1 << 30;
+            for (auto p = 0; p < 4; p++) {
+                int distance = 0;
+                for (auto c = 0; c < 3; c++) {
+                    int d = block[i][c] - palette[p][c];
+                    distance += d * d;
+                }
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = p;
+                }
+            }
+            indices |= uint32_t(best) << (2 * i);
+        }
+    }
+    output[0] = (unsigned char)(color0 & 0xFF);
+    output[1] = (unsigned char)(color0 >> 8);
+    output[2] = (unsigned char)(color1 & 0xFF);
+    output[3] = (unsigned char)(color1 >> 8);
+    for (auto k = 0; k < 4; k++) {
+        output[4 + k] = (unsigned char)(indices >> (8 * k));
+    }
+}
 
-    return textureID;
+// the 8 bytes of a DXT5 alpha block, 8 alpha values interpolated between the extremes
+static void encodeAlphaBlock(const unsigned char block[16][4], unsigned char* output) {
+    int low = 255, high = 0;
+    for (auto i = 0; i < 16; i++) {
+        low = std::min(low, int(block[i][3]));
+        high = std::max(high, int(block[i][3]));
+    }
+    uint64_t indices = 0;
+    if (high > low) {
+        for (auto i = 0; i < 16; i++) {
+            // step from the high end, 0 is alpha0 and 7 is alpha1, the steps in between are the codes 2 to 7
+            int step = ((high - block[i][3]) * 7 + (high - low) / 2) / (high - low);
+            uint64_t code = step == 0 ? 0 : step == 7 ? 1 : uint64_t(step + 1);
+            indices |= code << (3 * i);
+        }
+    }
+    output[0] = (unsigned char)high;
+    output[1] = (unsigned char)low;
+    for (auto k = 0; k < 6; k++) {
+        output[2 + k] = (unsigned char)(indices >> (8 * k));
+    }
 }
 
-#define FOURCC_DXT1 0x31545844 // Equivalent to "DXT1" in ASCII
-#define FOURCC_DXT3 0x33545844 // Equivalent to "DXT3" in ASCII
-#define FOURCC_DXT5 0x35545844 // Equivalent to "DXT5" in ASCII
+GLuint ImageLoader::loadBmpAsTexture(std::string imgPath) {
+    return upload(loadImage(imgPath, canCompress()));
+}
 
 GLuint ImageLoader::loadDdsAsTexture(std::string imgPath) {
-    unsigned char header[124];
+    return upload(loadImage(imgPath, canCompress()));
+}
 
-    FILE *fp;
+bool ImageLoader::canCompress() {
+    return GLEW_EXT_texture_compression_s3tc != 0;
+}
 
-    /* try to open the file */
-    fp = fopen(imgPath.c_str(), "rb");
-    if (fp == nullptr) {
-        throw std::runtime_error("loadDDS - no such file" + imgPath);
+ImageData ImageLoader::loadImage(std::string imgPath, bool compress) {
+    std::string cachePath = imgPath + ".tex";
+    ImageData image;
+    if (readCache(cachePath, imgPath, compress, image)) {
+        return image;
+    }
+    image = decodeFile(imgPath);
+    bool changed = buildMipmaps(image);
+    if (compress && !image.isCompressed()) {
+        ImageLoader::compress(image);
+        changed = true;
     }
+    // a DDS that is already complete is as fast to map as its cache
+    if (changed) {
+        writeCache(cachePath, imgPath, compress, image);
+    }
+    return image;
+}
 
-    /* verify the type of file */
-    char filecode[4];
-    fread(filecode, 1, 4, fp);
-    if (strncmp(filecode, "DDS ", 4) != 0) {
-        fclose(fp);
-        return 0;
+ImageData ImageLoader::decodeFile(std::string imgPath) {
+    MappedFile file(imgPath);
+    if (!file.isOpen()) {
+        throw std::runtime_error("ImageLoader - decodeFile, no texture file found for " + imgPath);
     }
+    file.adviseSequential();
+    const unsigned char* bytes = file.getData();
+    if (file.getSize() >= 2 && bytes[0] == 'B' && bytes[1] == 'M') {
+        return decodeBmp(bytes, file.getSize());
+    }
+    if (file.getSize() >= 4 && memcmp(bytes, "DDS ", 4) == 0) {
+        return decodeDds(bytes, file.getSize());
+    }
+    throw std::runtime_error("ImageLoader - decodeFile, neither BMP nor DDS: " + imgPath);
+}
 
-    /* get the surface desc */
-    fread(&header, 124, 1, fp);
-
-    unsigned int height = *(unsigned int*)&(header[8]);
-    unsigned int width = *(unsigned int*)&(header[12]);
-    unsigned int linearSize = *(unsigned int*)&(header[16]);
-    unsigned int mipMapCount = *(unsigned int*)&(header[24]);
-    unsigned int fourCC = *(unsigned int*)&(header[80]);
-
-
-    unsigned char * buffer;
-    unsigned int bufsize;
-    /* how big is it going to be including all mipmaps? */
-    bufsize = mipMapCount > 1 ? linearSize * 2 : linearSize;
-    buffer = (unsigned char*)malloc(bufsize * sizeof(unsigned char));
-    fread(buffer, 1, bufsize, fp);
-    /* close the file pointer */
-    fclose(fp);
-
-    unsigned int components = (fourCC == FOURCC_DXT1) ? 3 : 4;
-    unsigned int format;
-    switch (fourCC) {
-    case FOURCC_DXT1:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-        break;
-    case FOURCC_DXT3:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-        break;
-    case FOURCC_DXT5:
-        format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-        break;
-    default:
-        free(buffer);
-        return 0;
+BmpLayout ImageLoader::parseBmp(const unsigned char* bytes, size_t size) {
+    if (size < 54 || bytes[0] != 'B' || bytes[1] != 'M') {
+        throw std::runtime_error("ImageLoader - parseBmp, illegal BMP file!");
+    }
+    BmpLayout layout;
+    layout.dataPos = readUint32(bytes + 0x0A);
+    int32_t width = int32_t(readUint32(bytes + 0x12));
+    int32_t height = int32_t(readUint32(bytes + 0x16));
+    uint32_t bitCount = readUint32(bytes + 0x1C) & 0xFFFF;
+    uint32_t compression = readUint32(bytes + 0x1E);
+    // only uncompressed 24bpp and 32bpp files
+    if (compression != 0 || (bitCount != 24 && bitCount != 32) || width <= 0 || height == 0) {
+        throw std::runtime_error("ImageLoader - parseBmp, unsupported BMP file!");
     }
+    if (layout.dataPos == 0) {
+        layout.dataPos = 54; // The BMP header is done that way
+    }
+    // a negative height means the rows are stored top row first
+    layout.topDown = height < 0;
+    layout.width = uint32_t(width);
+    layout.height = uint32_t(std::abs(height));
+    layout.bytesPerPixel = bitCount / 8;
+    // rows are padded to 4 bytes
+    layout.pitch = (size_t(width) * layout.bytesPerPixel + 3) & ~size_t(3);
+    if (layout.dataPos + layout.pitch * layout.height > size) {
+        throw std::runtime_error("ImageLoader - parseBmp, truncated BMP file!");
+    }
+    return layout;
+}
 
-    // Create one OpenGL texture
-    GLuint textureID;
-    glGenTextures(1, &textureID);
+ImageData ImageLoader::decodeBmp(const unsigned char* bytes, size_t size) {
+    BmpLayout layout = parseBmp(bytes, size);
+    uint32_t width = layout.width, height = layout.height;
+    size_t bytesPerPixel = layout.bytesPerPixel;
 
-    // "Bind" the newly created texture : all future texture functions will modify this texture
-    glBindTexture(GL_TEXTURE_2D, textureID);
-    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    ImageData image;
+    image.format = GL_RGBA8;
+    ImageLevel level = {width, height, 0, uint64_t(width) * height * 4};
+    image.levels.push_back(level);
+    image.pixels.resize(size_t(level.size));
+    for (uint32_t y = 0; y < height; y++) {
+        const unsigned char* row = layout.getRow(bytes, y);
+        unsigned char* output = &image.pixels[size_t(y) * width * 4];
+        for (uint32_t x = 0; x < width; x++) {
+            // BGR(A) to RGBA, the fourth byte of 32bpp files is unused
+            output[4 * x] = row[bytesPerPixel * x + 2];
+            output[4 * x + 1] = row[bytesPerPixel * x + 1];
+            output[4 * x + 2] = row[bytesPerPixel * x];
+            output[4 * x + 3] = 255;
+        }
+    }
+    return image;
+}
 
-    unsigned int blockSize = (format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT) ? 8 : 16;
-    unsigned int offset = 0;
+ImageData ImageLoader::decodeDds(const unsigned char* bytes, size_t size) {
+    // magic number and surface desc
+    if (size < 128 || readUint32(bytes + 4) != 124) {
+        throw std::runtime_error("ImageLoader - decodeDds, illegal DDS file!");
+    }
+    const unsigned char* header = bytes + 4;
+    uint32_t height = readUint32(header + 8);
+    uint32_t width = readUint32(header + 12);
+    uint32_t mipMapCount = std::max(readUint32(header + 24), 1u);
+    uint32_t pixelFlags = readUint32(header + 76);
+    uint32_t fourCC = readUint32(header + 80);
+    uint32_t bitCount = readUint32(header + 84);
+    uint32_t masks[4] = {readUint32(header + 88), readUint32(header + 92), readUint32(header + 96),
+                         (pixelFlags & DDPF_ALPHAPIXELS) ? readUint32(header + 100) : 0};
 
-    /* load the mipmaps */
-    for (unsigned int level = 0; level < mipMapCount && (width || height); ++level) {
-        unsigned int size = ((width + 3) / 4)*((height + 3) / 4)*blockSize;
-        glCompressedTexImage2D(GL_TEXTURE_2D, level, format, width, height,
-            0, size, buffer + offset);
+    ImageData image;
+    size_t blockSize = 0;
+    size_t bytesPerPixel = 0;
+    if (pixelFlags & DDPF_FOURCC) {
+        switch (fourCC) {
+        case FOURCC_DXT1:
+            image.format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+            blockSize = 8;
+            break;
+        case FOURCC_DXT3:
+            image.format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+            blockSize = 16;
+            break;
+        case FOURCC_DXT5:
+            image.format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+            blockSize = 16;
+            break;
+        default:
+            throw std::runtime_error("ImageLoader - decodeDds, unsupported compression!");
+        }
+    } else if ((pixelFlags & DDPF_RGB) && (bitCount == 24 || bitCount == 32)) {
+        image.format = GL_RGBA8;
+        bytesPerPixel = bitCount / 8;
+    } else {
+        throw std::runtime_error("ImageLoader - decodeDds, unsupported pixel format!");
+    }
 
-        offset += size;
+    // the levels as stored, then converted to RGBA if uncompressed
+    const unsigned char* data = bytes + 128;
+    size_t available = size - 128;
+    size_t offset = 0;
+    for (uint32_t i = 0; i < mipMapCount && (width || height); ++i) {
+        width = std::max(width, 1u);
+        height = std::max(height, 1u);
+        size_t storedSize = blockSize > 0 ? ((width + 3) / 4) * ((height + 3) / 4) * blockSize
+                                          : size_t(width) * height * bytesPerPixel;
+        if (offset + storedSize > available) {
+            throw std::runtime_error("ImageLoader - decodeDds, truncated DDS file!");
+        }
+        ImageLevel level = {width, height, image.pixels.size(), 0};
+        if (blockSize > 0) {
+            level.size = storedSize;
+            image.pixels.insert(image.pixels.end(), data + offset, data + offset + storedSize);
+        } else {
+            level.size = uint64_t(width) * height * 4;
+            image.pixels.resize(image.pixels.size() + size_t(level.size));
+            unsigned char* output = &image.pixels[size_t(level.offset)];
+            for (size_t p = 0; p < size_t(width) * height; p++) {
+                const unsigned char* input = data + offset + p * bytesPerPixel;
+                uint32_t pixel = bytesPerPixel == 4 ? readUint32(input)
+                                                    : uint32_t(input[0]) | input[1] << 8 | input[2] << 16;
+                for (auto c = 0; c < 4; c++) {
+                    if (masks[c] == 0) {
+                        output[4 * p + c] = 255;
+                        continue;
+                    }
+                    uint32_t shift = 0;
+                    while (((masks[c] >> shift) & 1) == 0) {
+                        shift++;
+                    }
+                    uint32_t maximum = masks[c] >> shift;
+                    output[4 * p + c] = (unsigned char)(((pixel & masks[c]) >> shift) * 255 / maximum);
+                }
+            }
+        }
+        image.levels.push_back(level);
+        offset += storedSize;
         width /= 2;
         height /= 2;
+    }
+    return image;
+}
+
+bool ImageLoader::buildMipmaps(ImageData& image) {
+    if (image.isCompressed() || image.levels.size() != 1) {
+        return false;
+    }
+    ImageLevel level = image.levels[0];
+    // the whole chain is 4/3 of the base level
+    image.pixels.reserve(size_t(level.size) * 4 / 3 + 4);
+    while (level.width > 1 || level.height > 1) {
+        ImageLevel next = {std::max(level.width / 2, 1u), std::max(level.height / 2, 1u), image.pixels.size(), 0};
+        next.size = uint64_t(next.width) * next.height * 4;
+        image.pixels.resize(image.pixels.size() + size_t(next.size));
+        const unsigned char* input = &image.pixels[size_t(level.offset)];
+        unsigned char* output = &image.pixels[size_t(next.offset)];
+        for (uint32_t y = 0; y < next.height; y++) {
+            uint32_t y0 = std::min(2 * y, level.height - 1), y1 = std::min(2 * y + 1, level.height - 1);
+            for (uint32_t x = 0; x < next.width; x++) {
+                uint32_t x0 = std::min(2 * x, level.width - 1), x1 = std::min(2 * x + 1, level.width - 1);
+                for (auto c = 0; c < 4; c++) {
+                    int sum = input[(size_t(y0) * level.width + x0) * 4 + c] +
+                              input[(size_t(y0) * level.width + x1) * 4 + c] +
+                              input[(size_t(y1) * level.width + x0) * 4 + c] +
+                              input[(size_t(y1) * level.width + x1) * 4 + c];
+                    output[(size_t(y) * next.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+                }
+            }
+        }
+        image.levels.push_back(next);
+        level = next;
+    }
+    return true;
+}
 
-        if (width < 1) width = 1;
-        if (height < 1) height = 1;
+void ImageLoader::compress(ImageData& image) {
+    bool opaque = true;
+    for (size_t i = 3; i < image.pixels.size() && opaque; i += 4) {
+        opaque = image.pixels[i] == 255;
     }
+    size_t blockSize = opaque ? 8 : 16;
 
-    free(buffer);
+    ImageData compressed;
+    compressed.format = opaque ? GL_COMPRESSED_RGBA_S3TC_DXT1_EXT : GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+    for (const ImageLevel& level : image.levels) {
+        uint32_t blocksX = (level.width + 3) / 4, blocksY = (level.height + 3) / 4;
+        ImageLevel output = {level.width, level.height, compressed.pixels.size(), blocksX * blocksY * blockSize};
+        compressed.pixels.resize(compressed.pixels.size() + size_t(output.size));
+        const unsigned char* input = &image.pixels[size_t(level.offset)];
+        unsigned char* blocks = &compressed.pixels[size_t(output.offset)];
+        unsigned char block[16][4];
+        for (uint32_t by = 0; by < blocksY; by++) {
+            for (uint32_t bx = 0; bx < blocksX; bx++) {
+                // the texels of the block, repeating the border ones past the edges
+                for (auto i = 0; i < 16; i++) {
+                    uint32_t x = std::min(bx * 4 + i % 4, level.width - 1);
+                    uint32_t y = std::min(by * 4 + i / 4, level.height - 1);
+                    memcpy(block[i], input + (size_t(y) * level.width + x) * 4, 4);
+                }
+                if (!opaque) {
+                    encodeAlphaBlock(block, blocks);
+                    blocks += 8;
+                }
+                encodeColorBlock(block, blocks);
+                blocks += 8;
+            }
+        }
+        compressed.levels.push_back(output);
+    }
+    image = std::move(compressed);
+}
+
+GLuint ImageLoader::upload(const ImageData& image, GLuint texture) {
+    if (texture == 0) {
+        glGenTextures(1, &texture);
+    }
+    glBindTexture(GL_TEXTURE_2D, texture);
+    GLint alignment;
+    glGetIntegerv(GL_UNPACK_ALIGNMENT, &alignment);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t i = 0; i < image.levels.size(); i++) {
+        const ImageLevel& level = image.levels[i];
+        const unsigned char* pixels = image.pixels.data() + level.offset;
+        if (image.isCompressed()) {
+            glCompressedTexImage2D(GL_TEXTURE_2D, GLint(i), image.format, level.width, level.height, 0,
+                                   GLsizei(level.size), pixels);
+        } else {
+            glTexImage2D(GL_TEXTURE_2D, GLint(i), GL_RGBA8, level.width, level.height, 0, GL_RGBA, GL_UNSIGNED_BYTE,
+                         pixels);
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, alignment);
+
+    // a DDS may come with only a part of the chain
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, GLint(image.levels.size()) - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    return texture;
+}
 
-    return textureID;
+bool ImageLoader::readCache(const std::string& cachePath, const std::string& imgPath, bool compress,
+                            ImageData& image) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!statFile(imgPath, sourceSize, sourceTime)) {
+        return false;
+    }
+    MappedFile file(cachePath);
+    if (!file.isOpen() || file.getSize() < sizeof(ImageCacheHeader)) {
+        return false;
+    }
+    ImageCacheHeader header;
+    memcpy(&header, file.getData(), sizeof(header));
+    // compared against what is left of the file, so a damaged count cannot overflow the sum
+    size_t available = file.getSize() - sizeof(header);
+    size_t levelBytes = size_t(header.levelNum) * sizeof(ImageLevel);
+    bool valid = memcmp(header.magic, IMAGE_CACHE_MAGIC, sizeof(IMAGE_CACHE_MAGIC)) == 0 &&
+                 header.version == IMAGE_CACHE_VERSION && header.compress == uint32_t(compress) &&
+                 header.sourceSize == sourceSize && header.sourceTime == sourceTime && header.levelNum > 0 &&
+                 header.levelNum <= available / sizeof(ImageLevel) &&
+                 header.pixelSize == available - levelBytes;
+    if (!valid) {
+        return false;
+    }
+    const unsigned char* data = file.getData() + sizeof(header);
+    std::vector<ImageLevel> levels(header.levelNum);
+    memcpy(levels.data(), data, levelBytes);
+    // every level has to be as large as its format and size make it, and lie in the pixels
+    for (const ImageLevel& level : levels) {
+        uint64_t size = getLevelSize(header.format, level.width, level.height);
+        if (size == 0 || level.size != size || level.offset > header.pixelSize ||
+            level.size > header.pixelSize - level.offset) {
+            return false;
+        }
+    }
+    image.format = header.format;
+    image.levels.swap(levels);
+    image.pixels.assign(data + levelBytes, data + levelBytes + header.pixelSize);
+    return true;
+}
+
+void ImageLoader::writeCache(const std::string& cachePath, const std::string& imgPath, bool compress,
+                             const ImageData& image) {
+    ImageCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, IMAGE_CACHE_MAGIC, sizeof(IMAGE_CACHE_MAGIC));
+    header.version = IMAGE_CACHE_VERSION;
+    header.compress = compress;
+    header.format = image.format;
+    header.levelNum = uint32_t(image.levels.size());
+    header.pixelSize = image.pixels.size();
+    if (!statFile(imgPath, header.sourceSize, header.sourceTime)) {
+        return;
+    }
+    // the cache is only an optimization, a read only texture directory just means no cache
+    FILE* file = fopen(cachePath.c_str(), "wb");
+    if (!file) {
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(image.levels.data(), sizeof(ImageLevel), image.levels.size(), file) == image.levels.size() &&
+                   fwrite(image.pixels.data(), 1, image.pixels.size(), file) == image.pixels.size();
+    fclose(file);
+    if (!written) {
+        remove(cachePath.c_str());
+    }
 }
@@ -1,21 +1,109 @@
 /*
  * @brief util that load BMP or DDS as an OpenGL texture.
  *
+ * decoding is split from uploading: loadImage only touches memory and files, so it can run on any thread, and
+ * upload is the only part that needs the GL context. see TextureLoader for loading on worker threads.
+ *
  * @author alei  mailto:rayingecho@hotmail.com
  */
 #ifndef IMAGE_LOADER_HPP
 #define IMAGE_LOADER_HPP
 
 #include <GL/glew.h>
+#include <stdint.h>
 #include <string>
+#include <vector>
+
+struct ImageLevel {
+    uint32_t width;
+    uint32_t height;
+    // bytes into ImageData::pixels
+    uint64_t offset;
+    uint64_t size;
+};
+
+/**
+ * @brief a decoded image and its mipmaps, ready for upload.
+ *
+ * uncompressed images are RGBA8, compressed ones are DXT1/3/5 blocks. rows are in file order: bottom row first
+ * for BMP, top row first for DDS.
+ */
+struct ImageData {
+    // GL_RGBA8 or one of the GL_COMPRESSED_RGBA_S3TC_DXT*_EXT formats
+    GLenum format;
+    std::vector<ImageLevel> levels;
+    std::vector<unsigned char> pixels;
+
+    ImageData() : format(GL_RGBA8) {}
+
+    bool isCompressed() const { return format != GL_RGBA8; }
+};
+
+// where the pixels of an uncompressed BMP are, for reading huge files in place
+struct BmpLayout {
+    uint32_t width;
+    uint32_t height;
+    size_t dataPos;
+    // bytes per row, with the padding
+    size_t pitch;
+    // 3 for BGR, 4 for BGRX
+    size_t bytesPerPixel;
+    bool topDown;
+
+    // row y counted from the bottom, as OpenGL does
+    const unsigned char* getRow(const unsigned char* bytes, uint32_t y) const {
+        return bytes + dataPos + pitch * (topDown ? height - 1 - y : y);
+    }
+};
 
 class ImageLoader {
 public:
     static GLuint loadBmpAsTexture(std::string imgPath);
     static GLuint loadDdsAsTexture(std::string imgPath);
+
+    /**
+     * @brief decode an image with its whole mipmap chain, no GL involved so any thread can call it.
+     *
+     * mipmaps are built on the CPU and, with compress, opaque images become DXT1 and the others DXT5. the result
+     * is cached next to the image as '<imgPath>.tex', later loads map the cache instead, as long as the image
+     * file has not changed.
+     */
+    static ImageData loadImage(std::string imgPath, bool compress);
+
+    // decode a BMP or DDS file as stored, mapped instead of read
+    static ImageData decodeFile(std::string imgPath);
+
+    /**
+     * @brief upload all the levels of an image, into a new texture or over the storage of an existing one.
+     *
+     * the texture is left bound to GL_TEXTURE_2D of the active unit.
+     */
+    static GLuint upload(const ImageData& image, GLuint texture = 0);
+
+    // DXT textures can be uploaded, check on the GL thread
+    static bool canCompress();
+
+    // check the header of an uncompressed 24bpp or 32bpp BMP file and locate its pixels
+    static BmpLayout parseBmp(const unsigned char* bytes, size_t size);
 private:
+    static ImageData decodeBmp(const unsigned char* bytes, size_t size);
+
+    static ImageData decodeDds(const unsigned char* bytes, size_t size);
+
+    // box filter the missing levels of an uncompressed image, false if there are none missing
+    static bool buildMipmaps(ImageData& image);
+
+    // block compress every level of an uncompressed image
+    static void compress(ImageData& image);
+
+    // read the cache, false if it is missing, stale, from another version or damaged
+    static bool readCache(const std::string& cachePath, const std::string& imgPath, bool compress, ImageData& image);
+
+    static void writeCache(const std::string& cachePath, const std::string& imgPath, bool compress,
+                           const ImageData& image);
+
     // util class, forbid instantiating.
     ImageLoader() {}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,121 @@
+/*
+ * @brief util that writes raw pixels to image files.
+ *
+ * @author alei  mailto:rayingecho@hotmail.com
+ */
+#include "imageWriter.hpp"
+#include <stdio.h>
+#include <stdint.h>
+#include <stdexcept>
+#include <vector>
+#include <algorithm>
+
+static std::vector<uint32_t> buildCrcTable() {
+    std::vector<uint32_t> table(256);
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t c = i;
+        for (auto k = 0; k < 8; k++) {
+            c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+static uint32_t crc32(const unsigned char* data, size_t length, uint32_t crc = 0) {
+    // images may be written from several threads, the static initialization is thread safe
+    static const std::vector<uint32_t> table = buildCrcTable();
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void appendBigEndian(std::vector<unsigned char>& out, uint32_t value) {
+    out.push_back((unsigned char)(value >> 24));
+    out.push_back((unsigned char)(value >> 16));
+    out.push_back((unsigned char)(value >> 8));
+    out.push_back((unsigned char)value);
+}
+
+// length, type, data and the crc of type + data
+static void writeChunk(FILE* file, const char* type, const std::vector<unsigned char>& data) {
+    std::vector<unsigned char> chunk;
+    chunk.reserve(data.size() + 12);
+    appendBigEndian(chunk, uint32_t(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    appendBigEndian(chunk, crc32(&chunk[4], data.size() + 4));
+    fwrite(chunk.data(), 1, chunk.size(), file);
+}
+
+void ImageWriter::writePng(std::string imgPath, const unsigned char* pixels, int width, int height, int channels,
+                           bool bottomUp) {
+    static const unsigned char colorTypes[] = {0, 0, 4, 2, 6};
+    if (channels < 1 || channels > 4) {
+        throw std::runtime_error("writePNG - unsupported channel count for " + imgPath);
+    }
+    FILE* file = fopen(imgPath.c_str(), "wb");
+    if (!file) {
+        throw std::runtime_error("writePNG - cannot open " + imgPath);
+    }
+    static const unsigned char signature[] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n'};
+    fwrite(signature, 1, sizeof(signature), file);
+
+    std::vector<unsigned char> header;
+    appendBigEndian(header, width);
+    appendBigEndian(header, height);
+    header.push_back(8);
+    header.push_back(colorTypes[channels]);
+    // compression, filter and interlace methods
+    header.push_back(0);
+    header.push_back(0);
+    header.push_back(0);
+    writeChunk(file, "IHDR", header);
+
+    // scanlines: filter type 0 followed by the row, PNG stores the top row first
+    size_t rowSize = size_t(width) * channels;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowSize + 1) * height);
+    for (auto y = 0; y < height; y++) {
+        const unsigned char* row = pixels + rowSize * (bottomUp ? height - 1 - y : y);
+        raw.push_back(0);
+        raw.insert(raw.end(), row, row + rowSize);
+    }
+
+    // zlib stream made of stored deflate blocks, each block holds at most 65535 bytes
+    std::vector<unsigned char> idat;
+    idat.reserve(raw.size() + raw.size() / 65535 * 5 + 16);
+    idat.push_back(0x78);
+    idat.push_back(0x01);
+    size_t offset = 0;
+    do {
+        size_t length = std::min<size_t>(raw.size() - offset, 65535);
+        idat.push_back(offset + length == raw.size() ? 1 : 0);
+        idat.push_back((unsigned char)length);
+        idat.push_back((unsigned char)(length >> 8));
+        idat.push_back((unsigned char)~length);
+        idat.push_back((unsigned char)(~length >> 8));
+        idat.insert(idat.end(), raw.begin() + offset, raw.begin() + offset + length);
+        offset += length;
+    } while (offset < raw.size());
+    // adler32, reduced every 5552 bytes which is the most that can not overflow 32 bits
+    uint32_t a = 1, b = 0;
+    for (size_t begin = 0; begin < raw.size(); begin += 5552) {
+        size_t end = std::min<size_t>(begin + 5552, raw.size());
+        for (size_t i = begin; i < end; i++) {
+            a += raw[i];
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    appendBigEndian(idat, (b << 16) | a);
+    writeChunk(file, "IDAT", idat);
+
+    writeChunk(file, "IEND", std::vector<unsigned char>());
+    if (fclose(file) != 0) {
+        throw std::runtime_error("writePNG - failed writing " + imgPath);
+    }
+}
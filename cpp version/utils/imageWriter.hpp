@@ -0,0 +1,28 @@
+/*
+ * @brief util that writes raw pixels to image files.
+ *
+ * @author alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef IMAGE_WRITER_HPP
+#define IMAGE_WRITER_HPP
+
+#include <string>
+
+class ImageWriter {
+public:
+    /**
+     * @brief write 8 bits per channel pixels as a PNG file.
+     *
+     * the data is stored without compression, so there is no dependency on zlib and writing costs about a memcpy.
+     *
+     * @param channels 1 (gray), 2 (gray, alpha), 3 (RGB) or 4 (RGBA)
+     * @param bottomUp the first row of pixels is the bottom of the image, as in OpenGL textures
+     */
+    static void writePng(std::string imgPath, const unsigned char* pixels, int width, int height, int channels,
+                         bool bottomUp = true);
+private:
+    // util class, forbid instantiating.
+    ImageWriter() {}
+};
+
+#endif
@@ -0,0 +1,93 @@
+/*
+ * @brief a whole file mapped read only, the pages are only read from disk when touched.
+ *
+ * @author alei  mailto:rayingecho@hotmail.com
+ */
+#include "mappedFile.hpp"
+#include <sys/stat.h>
+#ifdef _WIN32
+#define NOMINMAX
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile(const std::string& path) : _data(nullptr), _size(0), _mapping(nullptr) {
+#ifdef _WIN32
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING,
+                              FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (file == INVALID_HANDLE_VALUE) {
+        return;
+    }
+    LARGE_INTEGER size;
+    if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+        _mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (_mapping != nullptr) {
+            _data = (const unsigned char*)MapViewOfFile(_mapping, FILE_MAP_READ, 0, 0, 0);
+            _size = _data != nullptr ? size_t(size.QuadPart) : 0;
+        }
+    }
+    CloseHandle(file);
+#else
+    int file = open(path.c_str(), O_RDONLY);
+    if (file < 0) {
+        return;
+    }
+    struct stat info;
+    if (fstat(file, &info) == 0 && info.st_size > 0) {
+        void* data = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+        if (data != MAP_FAILED) {
+            _data = (const unsigned char*)data;
+            _size = size_t(info.st_size);
+        }
+    }
+    close(file);
+#endif
+}
+
+MappedFile::~MappedFile() {
+#ifdef _WIN32
+    if (_data != nullptr) {
+        UnmapViewOfFile(_data);
+    }
+    if (_mapping != nullptr) {
+        CloseHandle(_mapping);
+    }
+#else
+    if (_data != nullptr) {
+        munmap((void*)_data, _size);
+    }
+#endif
+}
+
+void MappedFile::adviseSequential() const {
+#ifndef _WIN32
+    if (_data != nullptr) {
+        madvise((void*)_data, _size, MADV_SEQUENTIAL);
+    }
+#endif
+}
+
+void MappedFile::prefetch(size_t offset, size_t size) const {
+#ifndef _WIN32
+    // madvise wants a page aligned start
+    size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    size_t start = offset / pageSize * pageSize;
+    if (_data != nullptr && offset + size <= _size) {
+        madvise((void*)(_data + start), offset + size - start, MADV_WILLNEED);
+    }
+#endif
+}
+
+bool statFile(const std::string& path, uint64_t& size, int64_t& time) {
+    struct stat info;
+    if (stat(path.c_str(), &info) != 0) {
+        return false;
+    }
+    size = uint64_t(info.st_size);
+    time = int64_t(info.st_mtime);
+    return true;
+}
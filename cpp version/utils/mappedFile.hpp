@@ -0,0 +1,46 @@
+/*
+ * @brief a whole file mapped read only, the pages are only read from disk when touched.
+ *
+ * @author alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef MAPPED_FILE_HPP
+#define MAPPED_FILE_HPP
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+// the system headers stay in mappedFile.cpp, windows.h would bring its min and max macros to every includer
+class MappedFile {
+public:
+    // an empty or missing file gives a closed mapping, see isOpen
+    explicit MappedFile(const std::string& path);
+
+    ~MappedFile();
+
+    bool isOpen() const { return _data != nullptr; }
+
+    const unsigned char* getData() const { return _data; }
+
+    size_t getSize() const { return _size; }
+
+    // hint that the range is read front to back
+    void adviseSequential() const;
+
+    // start reading a range from disk in the background, so touching it later does not block
+    void prefetch(size_t offset, size_t size) const;
+
+private:
+    const unsigned char* _data;
+    size_t _size;
+    // the file mapping handle on Windows
+    void* _mapping;
+
+    MappedFile(const MappedFile&);
+    MappedFile& operator=(const MappedFile&);
+};
+
+// size and modification time of a file, e.g. the source a cache was built from. false if it is missing
+bool statFile(const std::string& path, uint64_t& size, int64_t& time);
+
+#endif
@@ -0,0 +1,26 @@
+/*
+ * @brief CPU side mesh data, ready to upload as one interleaved vertex buffer.
+ *
+ * @author alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef MESH_HPP
+#define MESH_HPP
+
+#include <stdint.h>
+#include <vector>
+#include <glm/glm.hpp>
+
+// interleaved vertex, attribute 0 is the position, 1 the uv and 2 the normal as in the shaders
+struct Vertex {
+    glm::vec3 position;
+    glm::vec2 uv;
+    glm::vec3 normal;
+};
+
+struct MeshData {
+    std::vector<Vertex> vertices;
+    // 32 bits, so a mesh is not limited to 65536 vertices
+    std::vector<uint32_t> indices;
+};
+
+#endif
@@ -0,0 +1,239 @@
+/*
+ * @brief index and vertex reordering for faster drawing, the mesh itself is unchanged.
+ *
+ * @author alei  mailto:rayingecho@hotmail.com
+ */
+#include "meshOptimizer.hpp"
+#include <math.h>
+#include <algorithm>
+
+// the score parameters of Forsyth's paper
+static const float CACHE_DECAY_POWER = 1.5f;
+static const float LAST_TRIANGLE_SCORE = 0.75f;
+static const float VALENCE_BOOST_SCALE = 2.0f;
+static const float VALENCE_BOOST_POWER = 0.5f;
+
+static float vertexScore(int cachePosition, int remainingTriangles) {
+    if (remainingTriangles == 0) {
+        // no triangle left to use it
+        return -1.0f;
+    }
+    float score = 0.0f;
+    if (cachePosition >= 0) {
+        if (cachePosition < 3) {
+            // the vertices of the last triangle, fixed score so the next one does not simply reuse the same edge
+            score = LAST_TRIANGLE_SCORE;
+        } else {
+            float scaler = 1.0f / (MeshOptimizer::CACHE_SIZE - 3);
+            score = powf(1.0f - (cachePosition - 3) * scaler, CACHE_DECAY_POWER);
+        }
+    }
+    // boost the vertices with few triangles left, so they are finished and leave no hole behind
+    return score + VALENCE_BOOST_SCALE * powf(float(remainingTriangles), -VALENCE_BOOST_POWER);
+}
+
+void MeshOptimizer::optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexNum) {
+    size_t triangleNum = indices.size() / 3;
+    if (triangleNum == 0) {
+        return;
+    }
+
+    // triangles of each vertex, compressed adjacency
+    std::vector<uint32_t> remaining(vertexNum, 0);
+    for (uint32_t index : indices) {
+        remaining[index]++;
+    }
+    std::vector<uint32_t> offsets(vertexNum + 1, 0);
+    for (size_t i = 0; i < vertexNum; i++) {
+        offsets[i + 1] = offsets[i] + remaining[i];
+    }
+    std::vector<uint32_t> adjacency(indices.size());
+    std::vector<uint32_t> filled(offsets.begin(), offsets.end() - 1);
+    for (size_t i = 0; i < indices.size(); i++) {
+        adjacency[filled[indices[i]]++] = uint32_t(i / 3);
+    }
+
+    std::vector<float> vertexScores(vertexNum);
+    for (size_t i = 0; i < vertexNum; i++) {
+        vertexScores[i] = vertexScore(-1, remaining[i]);
+    }
+    std::vector<float> triangleScores(triangleNum);
+    std::vector<bool> emitted(triangleNum, false);
+    for (size_t t = 0; t < triangleNum; t++) {
+        triangleScores[t] = vertexScores[indices[3 * t]] + vertexScores[indices[3 * t + 1]] +
+                            vertexScores[indices[3 * t + 2]];
+    }
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    // one more slot than the cache, for the vertices about to be evicted
+    std::vector<uint32_t> cache, nextCache;
+    cache.reserve(CACHE_SIZE + 3);
+    nextCache.reserve(CACHE_SIZE + 3);
+    size_t scanPosition = 0;
+    int64_t best = 0;
+    while (best >= 0) {
+        emitted[best] = true;
+        const uint32_t* triangle = &indices[3 * best];
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // the triangle's vertices move to the front of the cache
+        nextCache.assign(triangle, triangle + 3);
+        for (uint32_t vertex : cache) {
+            if (vertex != triangle[0] && vertex != triangle[1] && vertex != triangle[2]) {
+                nextCache.push_back(vertex);
+            }
+        }
+        for (auto k = 0; k < 3; k++) {
+            uint32_t vertex = triangle[k];
+            // drop the emitted triangle from the vertex's list
+            uint32_t* begin = &adjacency[offsets[vertex]];
+            uint32_t* end = begin + remaining[vertex];
+            std::iter_swap(std::find(begin, end, uint32_t(best)), end - 1);
+            remaining[vertex]--;
+        }
+        cache.swap(nextCache);
+
+        // rescore the cached vertices and their triangles, the best of them is the next candidate
+        best = -1;
+        float bestScore = -1.0f;
+        for (size_t i = 0; i < cache.size(); i++) {
+            uint32_t vertex = cache[i];
+            int position = i < size_t(CACHE_SIZE) ? int(i) : -1;
+            float score = vertexScore(position, remaining[vertex]);
+            float delta = score - vertexScores[vertex];
+            vertexScores[vertex] = score;
+            for (uint32_t j = offsets[vertex]; j < offsets[vertex] + remaining[vertex]; j++) {
+                uint32_t t = adjacency[j];
+                triangleScores[t] += delta;
+                if (triangleScores[t] > bestScore) {
+                    bestScore = triangleScores[t];
+                    best = t;
+                }
+            }
+        }
+        if (cache.size() > size_t(CACHE_SIZE)) {
+            cache.resize(CACHE_SIZE);
+        }
+
+        // nothing adjacent to the cache is left, start again from the next triangle not emitted
+        if (best < 0) {
+            while (scanPosition < triangleNum && emitted[scanPosition]) {
+                scanPosition++;
+            }
+            best = scanPosition < triangleNum ? int64_t(scanPosition) : -1;
+        }
+    }
+    indices.swap(output);
+}
+
+float MeshOptimizer::averageCacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexNum, int cacheSize) {
+    if (indices.empty()) {
+        return 0.0f;
+    }
+    // the time each vertex entered the FIFO, it is still cached while less than cacheSize misses happened since
+    std::vector<int64_t> entered(vertexNum, -int64_t(cacheSize) - 1);
+    int64_t misses = 0;
+    for (uint32_t index : indices) {
+        if (misses - entered[index] > cacheSize) {
+            entered[index] = misses;
+            misses++;
+        }
+    }
+    return float(misses) / (indices.size() / 3);
+}
+
+void MeshOptimizer::optimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    size_t triangleNum = indices.size() / 3;
+    if (triangleNum == 0) {
+        return;
+    }
+
+    // cluster boundaries: the triangles whose vertices all miss the cache, starting there costs nothing extra
+    std::vector<size_t> clusterStarts;
+    std::vector<int64_t> entered(vertices.size(), -int64_t(CACHE_SIZE) - 1);
+    int64_t misses = 0;
+    for (size_t t = 0; t < triangleNum; t++) {
+        int triangleMisses = 0;
+        for (auto k = 0; k < 3; k++) {
+            uint32_t index = indices[3 * t + k];
+            if (misses - entered[index] > CACHE_SIZE) {
+                entered[index] = misses;
+                misses++;
+                triangleMisses++;
+            }
+        }
+        if (t == 0 || triangleMisses == 3) {
+            clusterStarts.push_back(t);
+        }
+    }
+    clusterStarts.push_back(triangleNum);
+
+    glm::vec3 meshCenter(0.0f);
+    for (const Vertex& vertex : vertices) {
+        meshCenter += vertex.position;
+    }
+    meshCenter /= float(std::max<size_t>(vertices.size(), 1));
+
+    // the more a cluster faces away from the center, the more likely it occludes the others
+    size_t clusterNum = clusterStarts.size() - 1;
+    std::vector<float> sortKeys(clusterNum);
+    for (size_t c = 0; c < clusterNum; c++) {
+        glm::vec3 center(0.0f), normal(0.0f);
+        float clusterArea = 0.0f;
+        for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+            const glm::vec3& a = vertices[indices[3 * t]].position;
+            const glm::vec3& b = vertices[indices[3 * t + 1]].position;
+            const glm::vec3& d = vertices[indices[3 * t + 2]].position;
+            // both weighted by the triangle area
+            glm::vec3 areaNormal = glm::cross(b - a, d - a);
+            float area = glm::length(areaNormal);
+            center += (a + b + d) * (area / 3.0f);
+            normal += areaNormal;
+            clusterArea += area;
+        }
+        float normalLength = glm::length(normal);
+        if (clusterArea > 0.0f && normalLength > 0.0f) {
+            center /= clusterArea;
+            normal /= normalLength;
+        }
+        sortKeys[c] = glm::dot(center - meshCenter, normal);
+    }
+
+    std::vector<size_t> order(clusterNum);
+    for (size_t c = 0; c < clusterNum; c++) {
+        order[c] = c;
+    }
+    std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) {
+        return sortKeys[a] > sortKeys[b];
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(indices.size());
+    for (size_t c : order) {
+        output.insert(output.end(), indices.begin() + 3 * clusterStarts[c], indices.begin() + 3 * clusterStarts[c + 1]);
+    }
+    indices.swap(output);
+}
+
+void MeshOptimizer::optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices) {
+    const uint32_t unused = 0xFFFFFFFFu;
+    std::vector<uint32_t> remap(vertices.size(), unused);
+    std::vector<Vertex> output;
+    output.reserve(vertices.size());
+    for (uint32_t& index : indices) {
+        if (remap[index] == unused) {
+            remap[index] = uint32_t(output.size());
+            output.push_back(vertices[index]);
+        }
+        index = remap[index];
+    }
+    // vertices no triangle uses are dropped
+    vertices.swap(output);
+}
+
+void MeshOptimizer::optimize(MeshData& mesh) {
+    optimizeVertexCache(mesh.indices, mesh.vertices.size());
+    optimizeOverdraw(mesh.vertices, mesh.indices);
+    optimizeVertexFetch(mesh.vertices, mesh.indices);
+}
@@ -0,0 +1,46 @@
+/*
+ * @brief index and vertex reordering for faster drawing, the mesh itself is unchanged.
+ *
+ * @author alei  mailto:rayingecho@hotmail.com
+ */
+#ifndef MESH_OPTIMIZER_HPP
+#define MESH_OPTIMIZER_HPP
+
+#include "mesh.hpp"
+
+class MeshOptimizer {
+public:
+    // cache size the reorders are tuned for, about the post transform cache of current GPUs
+    static const int CACHE_SIZE = 32;
+
+    /**
+     * @brief reorder the triangles so the post transform cache hits as often as possible.
+     *
+     * Forsyth's linear speed greedy algorithm: emit the triangle with the best score next, the score favours
+     * vertices recently used and vertices with few triangles left.
+     */
+    static void optimizeVertexCache(std::vector<uint32_t>& indices, size_t vertexNum);
+
+    /**
+     * @brief reorder clusters of triangles so the ones facing outwards are drawn first, reducing overdraw.
+     *
+     * the clusters are the runs between cache misses of a cache optimized index buffer, so the vertex cache
+     * efficiency is kept. clusters are sorted by how much they face away from the center of the mesh.
+     */
+    static void optimizeOverdraw(const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+    // renumber the vertices in the order the triangles first use them, so the vertex fetch is sequential
+    static void optimizeVertexFetch(std::vector<Vertex>& vertices, std::vector<uint32_t>& indices);
+
+    // all of the above, in the order they have to run
+    static void optimize(MeshData& mesh);
+
+    // average cache misses per triangle of a FIFO cache, 0.5 is about the best possible, 3 the worst
+    static float averageCacheMissRatio(const std::vector<uint32_t>& indices, size_t vertexNum,
+                                       int cacheSize = CACHE_SIZE);
+private:
+    // util class, forbid instantiating.
+    MeshOptimizer() {}
+};
+
+#endif
@@ -4,81 +4,151 @@
  * @author alei  mailto:rayingecho@hotmail.com
  */
 #include "objectLoader.hpp"
+#include "meshOptimizer.hpp"
+#include "mappedFile.hpp"
 #include <vector>
 #include <stdio.h>
+#include <string.h>
 #include <string>
+#include <stdexcept>
 #include <glm/glm.hpp>
 
 #include <assimp/Importer.hpp>
 #include <assimp/scene.h> 
 #include <assimp/postprocess.h> 
 
+// the cache header, the source size and time tell whether the model changed since
+struct MeshCacheHeader {
+    char magic[8];
+    uint32_t version;
+    uint32_t flipUvs;
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    uint64_t vertexNum;
+    uint64_t indexNum;
+};
 
+static const char MESH_CACHE_MAGIC[8] = {'O', 'C', 'M', 'E', 'S', 'H', '\0', '\0'};
+// bump when the layout of Vertex or the optimization changes
+static const uint32_t MESH_CACHE_VERSION = 1;
 
-ObjectLoader& ObjectLoader::loadObj(std::string objPath) {
-    ObjectLoader* loader = new ObjectLoader();
+MeshData ObjectLoader::loadObj(std::string objPath, bool flipUvs) {
+    std::string cachePath = objPath + ".mesh";
+    MeshData mesh;
+    if (readCache(cachePath, objPath, flipUvs, mesh)) {
+        return mesh;
+    }
+    mesh = importObj(objPath, flipUvs);
+    MeshOptimizer::optimize(mesh);
+    writeCache(cachePath, objPath, flipUvs, mesh);
+    return mesh;
+}
+
+MeshData ObjectLoader::importObj(std::string objPath, bool flipUvs) {
     Assimp::Importer importer;
 
-    const aiScene* scene = importer.ReadFile(objPath, 0);
+    const aiScene* scene = importer.ReadFile(objPath, aiProcess_Triangulate | aiProcess_JoinIdenticalVertices);
     if (!scene) {
         throw std::runtime_error("ObjectLoader - loadObj, cannot load object" + objPath);
     }
-    const aiMesh* mesh = scene->mMeshes[0]; 
 
-    loader->_vertices = std::vector<glm::vec3>();
-    loader->_vertices.reserve(mesh->mNumVertices);
-    for (unsigned int i = 0; i<mesh->mNumVertices; i++) {
-        aiVector3D pos = mesh->mVertices[i];
-        loader->_vertices.push_back(glm::vec3(pos.x, pos.y, pos.z));
-    }
+    MeshData mesh;
+    for (unsigned int m = 0; m < scene->mNumMeshes; m++) {
+        const aiMesh* part = scene->mMeshes[m];
+        // the indices of every mesh are relative to its own vertices
+        uint32_t base = uint32_t(mesh.vertices.size());
+        mesh.vertices.reserve(mesh.vertices.size() + part->mNumVertices);
+        for (unsigned int i = 0; i < part->mNumVertices; i++) {
+            Vertex vertex;
+            aiVector3D pos = part->mVertices[i];
+            vertex.position = glm::vec3(pos.x, pos.y, pos.z);
+            vertex.uv = glm::vec2(0.0f);
+            if (part->HasTextureCoords(0)) {
+                aiVector3D UVW = part->mTextureCoords[0][i];
+                vertex.uv = glm::vec2(UVW.x, flipUvs ? 1.0f - UVW.y : UVW.y);
+            }
+            vertex.normal = glm::vec3(0.0f);
+            if (part->HasNormals()) {
+                aiVector3D n = part->mNormals[i];
+                vertex.normal = glm::vec3(n.x, n.y, n.z);
+            }
+            mesh.vertices.push_back(vertex);
+        }
 
-    loader->_uvs = std::vector<glm::vec2>();
-    loader->_uvs.reserve(mesh->mNumVertices);
-    for (unsigned int i = 0; i<mesh->mNumVertices; i++) {
-        aiVector3D UVW = mesh->mTextureCoords[0][i];
-        loader->_uvs.push_back(glm::vec2(UVW.x, UVW.y));
+        mesh.indices.reserve(mesh.indices.size() + 3 * part->mNumFaces);
+        for (unsigned int i = 0; i < part->mNumFaces; i++) {
+            // points and lines are left after triangulation, skip them
+            if (part->mFaces[i].mNumIndices != 3) {
+                continue;
+            }
+            mesh.indices.push_back(base + part->mFaces[i].mIndices[0]);
+            mesh.indices.push_back(base + part->mFaces[i].mIndices[1]);
+            mesh.indices.push_back(base + part->mFaces[i].mIndices[2]);
+        }
     }
+    return mesh;
+}
 
-    loader->_normals = std::vector<glm::vec3>();
-    loader->_normals.reserve(mesh->mNumVertices);
-    for (unsigned int i = 0; i<mesh->mNumVertices; i++) {
-        aiVector3D n = mesh->mNormals[i];
-        loader->_normals.push_back(glm::vec3(n.x, n.y, n.z));
+bool ObjectLoader::readCache(const std::string& cachePath, const std::string& objPath, bool flipUvs, MeshData& mesh) {
+    uint64_t sourceSize;
+    int64_t sourceTime;
+    if (!statFile(objPath, sourceSize, sourceTime)) {
+        return false;
     }
-
-
-    loader->_indices = std::vector<unsigned short>();
-    loader->_indices.reserve(3 * mesh->mNumFaces);
-    for (unsigned int i = 0; i<mesh->mNumFaces; i++) {
-        // Assume the model has only triangles.
-        loader->_indices.push_back(mesh->mFaces[i].mIndices[0]);
-        loader->_indices.push_back(mesh->mFaces[i].mIndices[1]);
-        loader->_indices.push_back(mesh->mFaces[i].mIndices[2]);
+    MappedFile file(cachePath);
+    if (!file.isOpen() || file.getSize() < sizeof(MeshCacheHeader)) {
+        return false;
     }
-    return *loader;
-}
-
-std::vector<unsigned short>& ObjectLoader::getIndices() {
-    return this->_indices;
-}
-
-std::vector<glm::vec3>& ObjectLoader::getVertices() {
-    return this->_vertices;
-}
-
-std::vector<glm::vec2>& ObjectLoader::getUvs() {
-    return this->_uvs;
-}
-
-std::vector<glm::vec2>& ObjectLoader::getReversedUvs() {
-    std::vector<glm::vec2> ret = std::vector<glm::vec2>();
-    ret.reserve(_uvs.size());
-    for (glm::vec2 uv : _uvs) {
-        ret.push_back(glm::vec2(uv.x, 1.0 - uv.y));
+    MeshCacheHeader header;
+    memcpy(&header, file.getData(), sizeof(header));
+    // the counts are checked against the file length before anything is sized from them
+    uint64_t payload = file.getSize() - sizeof(header);
+    bool valid = memcmp(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC)) == 0 &&
+                 header.version == MESH_CACHE_VERSION && header.flipUvs == uint32_t(flipUvs) &&
+                 header.sourceSize == sourceSize && header.sourceTime == sourceTime &&
+                 header.vertexNum <= payload / sizeof(Vertex) && header.indexNum <= payload / sizeof(uint32_t) &&
+                 header.vertexNum * sizeof(Vertex) + header.indexNum * sizeof(uint32_t) == payload;
+    if (!valid) {
+        return false;
     }
-    return ret;
+    const unsigned char* data = file.getData() + sizeof(header);
+    size_t vertexBytes = size_t(header.vertexNum) * sizeof(Vertex);
+    mesh.vertices.resize(size_t(header.vertexNum));
+    memcpy(mesh.vertices.data(), data, vertexBytes);
+    mesh.indices.resize(size_t(header.indexNum));
+    memcpy(mesh.indices.data(), data + vertexBytes, mesh.indices.size() * sizeof(uint32_t));
+    // a damaged cache must not send indices past the vertices to the GPU
+    for (auto index : mesh.indices) {
+        if (index >= header.vertexNum) {
+            mesh = MeshData();
+            return false;
+        }
+    }
+    return true;
 }
 
-std::vector<glm::vec3>& ObjectLoader::getNormals() {
-    return this->_normals;
+void ObjectLoader::writeCache(const std::string& cachePath, const std::string& objPath, bool flipUvs,
+                              const MeshData& mesh) {
+    MeshCacheHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, MESH_CACHE_MAGIC, sizeof(MESH_CACHE_MAGIC));
+    header.version = MESH_CACHE_VERSION;
+    header.flipUvs = flipUvs;
+    header.vertexNum = mesh.vertices.size();
+    header.indexNum = mesh.indices.size();
+    if (!statFile(objPath, header.sourceSize, header.sourceTime)) {
+        return;
+    }
+    // the cache is only an optimization, a read only model directory just means no cache
+    FILE* file = fopen(cachePath.c_str(), "wb");
+    if (!file) {
+        return;
+    }
+    bool written = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(mesh.vertices.data(), sizeof(Vertex), mesh.vertices.size(), file) == mesh.vertices.size() &&
+                   fwrite(mesh.indices.data(), sizeof(uint32_t), mesh.indices.size(), file) == mesh.indices.size();
+    fclose(file);
+    if (!written) {
+        remove(cachePath.c_str());
+    }
 }
@@ -5,25 +5,32 @@
  */
 #ifndef OBJECT_LOADER_HPP
 #define OBJECT_LOADER_HPP
-#include <GL/glew.h>
 #include <string>
-#include <vector>
-#include <glm/detail/type_vec3.hpp>
+#include "mesh.hpp"
 
 class ObjectLoader {
 public:
-    // factory method
-    static ObjectLoader& loadObj(std::string objPath);
-    std::vector<unsigned short>& getIndices();
-    std::vector<glm::vec3>& getVertices();
-    std::vector<glm::vec2>& getUvs();
-    std::vector<glm::vec3>& getNormals();
-    std::vector<glm::vec2>& getReversedUvs();
+    /**
+     * @brief load all the meshes of a model file as one interleaved, draw order optimized mesh.
+     *
+     * the import and the optimization are slow, so the result is cached next to the model as '<objPath>.mesh'
+     * and later loads read it back directly, as long as the model file has not changed.
+     *
+     * @param flipUvs v = 1 - v, for textures stored top row first (e.g. DDS)
+     */
+    static MeshData loadObj(std::string objPath, bool flipUvs = false);
+
+    // import the model without any cache, triangulated and with identical vertices merged
+    static MeshData importObj(std::string objPath, bool flipUvs = false);
+
 private:
-    std::vector<unsigned short> _indices;
-    std::vector<glm::vec3> _vertices;
-    std::vector<glm::vec2> _uvs;
-    std::vector<glm::vec3> _normals;
+    // read the cache, false if it is missing, stale, from another version or damaged
+    static bool readCache(const std::string& cachePath, const std::string& objPath, bool flipUvs, MeshData& mesh);
+
+    static void writeCache(const std::string& cachePath, const std::string& objPath, bool flipUvs,
+                           const MeshData& mesh);
+
+    // util class, forbid instantiating.
     ObjectLoader() {}
 };
 
@@ -1,5 +1,5 @@
 /*
- * @brief shaderProgram that manage shaders, sington.
+ * @brief shader programs and the registry that builds and owns them.
  *
  * @author alei  mailto:rayingecho@hotmail.com
  */
@@ -8,117 +8,261 @@
 #include <vector>
 #include <iostream>
 #include <fstream>
+#include <sstream>
+#include <stdexcept>
 #include <stdlib.h>
 #include <string.h>
 #include <GL/glew.h>
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
 
 #include "shaderProgram.hpp"
 using namespace std;
 
-ShaderProgram* ShaderProgram::_instance = nullptr;
+// the header of a cached program binary
+struct ProgramBinaryHeader {
+    char magic[8];
+    GLenum format;
+    GLint length;
+};
 
-ShaderProgram& ShaderProgram::init(string vertexShaderPath, string fragmentShaderPath) {
-    // if you want to compile other shaders, delete current program fisrt
-    if (ShaderProgram::_instance != nullptr) {
-        return *ShaderProgram::_instance;
+static const char PROGRAM_BINARY_MAGIC[8] = {'O', 'C', 'P', 'R', 'O', 'G', '\0', '1'};
+
+ShaderRegistry* ShaderRegistry::_instance = nullptr;
+
+static void printShaderLog(GLuint shaderId) {
+    int infoLogLength;
+    glGetShaderiv(shaderId, GL_INFO_LOG_LENGTH, &infoLogLength);
+    if (infoLogLength > 0) {
+        std::vector<char> errorMessage(infoLogLength + 1);
+        glGetShaderInfoLog(shaderId, infoLogLength, nullptr, &errorMessage[0]);
+        printf("%s\n", &errorMessage[0]);
     }
-    auto program = new ShaderProgram();
-    // Create the shaders
-    GLuint VertexShaderID = glCreateShader(GL_VERTEX_SHADER);
-    GLuint FragmentShaderID = glCreateShader(GL_FRAGMENT_SHADER);
-
-    // Read the Vertex Shader code from the file
-    std::string VertexShaderCode;
-    std::ifstream VertexShaderStream(vertexShaderPath, std::ios::in);
-    if (VertexShaderStream.is_open()) {
-        std::string Line = "";
-        while (getline(VertexShaderStream, Line)) {
-            VertexShaderCode += "\n" + Line;
+}
+
+static GLuint compileShader(GLenum type, const string& source) {
+    GLuint shaderId = glCreateShader(type);
+    char const* sourcePointer = source.c_str();
+    glShaderSource(shaderId, 1, &sourcePointer, nullptr);
+    glCompileShader(shaderId);
+    return shaderId;
+}
+
+ShaderProgram::ShaderProgram()
+    : _programId(0), _vertexShaderId(0), _fragmentShaderId(0), _finished(false), _fromCache(false) {}
+
+bool ShaderProgram::isReady() {
+    if (_finished) {
+        return true;
+    }
+    if (GLEW_ARB_parallel_shader_compile) {
+        GLint completed = GL_FALSE;
+        glGetProgramiv(_programId, GL_COMPLETION_STATUS_ARB, &completed);
+        if (!completed) {
+            return false;
         }
-        VertexShaderStream.close();
-    } else {
-        throw std::runtime_error("cannot open vertexShader file:" + vertexShaderPath);
-    }
-
-    // Read the Fragment Shader code from the file
-    std::string FragmentShaderCode;
-    std::ifstream FragmentShaderStream(fragmentShaderPath, std::ios::in);
-    if (FragmentShaderStream.is_open()) {
-        std::string Line = "";
-        while (getline(FragmentShaderStream, Line)) {
-            FragmentShaderCode += "\n" + Line;
+    }
+    finish();
+    return true;
+}
+
+GLuint ShaderProgram::getProgramId() {
+    if (!_finished) {
+        finish();
+    }
+    return _programId;
+}
+
+GLuint ShaderProgram::getUniform(string uniformName) {
+    auto found = _uniforms.find(uniformName);
+    if (found != _uniforms.end()) {
+        return found->second;
+    }
+    GLint location = glGetUniformLocation(getProgramId(), uniformName.c_str());
+    _uniforms[uniformName] = location;
+    return location;
+}
+
+void ShaderProgram::finish() {
+    _finished = true;
+    GLint result = GL_FALSE;
+    if (_vertexShaderId != 0) {
+        // the compile logs are only worth reading now, the query waits for the compiler
+        glGetShaderiv(_vertexShaderId, GL_COMPILE_STATUS, &result);
+        if (!result) {
+            printShaderLog(_vertexShaderId);
+        }
+        glGetShaderiv(_fragmentShaderId, GL_COMPILE_STATUS, &result);
+        if (!result) {
+            printShaderLog(_fragmentShaderId);
         }
-        FragmentShaderStream.close();
-    } else {
-        throw std::runtime_error("cannot open fragmentShader file:" + fragmentShaderPath);
     }
 
-    GLint Result = GL_FALSE;
-    int InfoLogLength;
+    // Check the program
+    glGetProgramiv(_programId, GL_LINK_STATUS, &result);
+    int infoLogLength;
+    glGetProgramiv(_programId, GL_INFO_LOG_LENGTH, &infoLogLength);
+    if (infoLogLength > 1) {
+        std::vector<char> programErrorMessage(infoLogLength + 1);
+        glGetProgramInfoLog(_programId, infoLogLength, NULL, &programErrorMessage[0]);
+        printf("%s\n", &programErrorMessage[0]);
+    }
+    if (_vertexShaderId != 0) {
+        glDetachShader(_programId, _vertexShaderId);
+        glDetachShader(_programId, _fragmentShaderId);
+        glDeleteShader(_vertexShaderId);
+        glDeleteShader(_fragmentShaderId);
+        _vertexShaderId = 0;
+        _fragmentShaderId = 0;
+    }
+    if (!result || _fromCache || _cachePath.empty()) {
+        return;
+    }
 
-    // compile shaders
-    char const* VertexSourcePointer = VertexShaderCode.c_str();
-    glShaderSource(VertexShaderID, 1, &VertexSourcePointer, nullptr);
-    glCompileShader(VertexShaderID);
+    // store the binary for the next start, a failure only costs a compile next time
+    ProgramBinaryHeader header;
+    memcpy(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic));
+    glGetProgramiv(_programId, GL_PROGRAM_BINARY_LENGTH, &header.length);
+    if (header.length <= 0) {
+        return;
+    }
+    std::vector<char> binary(header.length);
+    glGetProgramBinary(_programId, header.length, nullptr, &header.format, binary.data());
+    FILE* file = fopen(_cachePath.c_str(), "wb");
+    if (file) {
+        fwrite(&header, sizeof(header), 1, file);
+        fwrite(binary.data(), 1, binary.size(), file);
+        fclose(file);
+    }
+}
 
-    // Check Vertex Shader
-    glGetShaderiv(VertexShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(VertexShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0) {
-        std::vector<char> VertexShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(VertexShaderID, InfoLogLength, nullptr, &VertexShaderErrorMessage[0]);
-        printf("%s\n", &VertexShaderErrorMessage[0]);
+void ShaderProgram::finalize() {
+    if (_vertexShaderId != 0) {
+        glDeleteShader(_vertexShaderId);
+        glDeleteShader(_fragmentShaderId);
     }
+    glDeleteProgram(this->_programId);
+    delete this;
+}
 
-    // Compile Fragment Shader
-    char const * FragmentSourcePointer = FragmentShaderCode.c_str();
-    glShaderSource(FragmentShaderID, 1, &FragmentSourcePointer, nullptr);
-    glCompileShader(FragmentShaderID);
+ShaderRegistry& ShaderRegistry::init(string cacheDirectory) {
+    if (ShaderRegistry::_instance != nullptr) {
+        return *ShaderRegistry::_instance;
+    }
+    auto registry = new ShaderRegistry();
+    registry->_driver = string((const char*)glGetString(GL_VENDOR)) + "|" + (const char*)glGetString(GL_RENDERER) +
+                        "|" + (const char*)glGetString(GL_VERSION);
+    // without program binaries there is nothing to cache
+    registry->_cacheDirectory = GLEW_ARB_get_program_binary ? cacheDirectory : "";
+    if (!registry->_cacheDirectory.empty()) {
+#ifdef _WIN32
+        _mkdir(registry->_cacheDirectory.c_str());
+#else
+        mkdir(registry->_cacheDirectory.c_str(), 0755);
+#endif
+    }
+    if (GLEW_ARB_parallel_shader_compile) {
+        // let the driver pick the number of compiler threads
+        glMaxShaderCompilerThreadsARB(0xFFFFFFFF);
+    }
+    ShaderRegistry::_instance = registry;
+    return *registry;
+}
 
-    // Check Fragment Shader
-    glGetShaderiv(FragmentShaderID, GL_COMPILE_STATUS, &Result);
-    glGetShaderiv(FragmentShaderID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0) {
-        std::vector<char> FragmentShaderErrorMessage(InfoLogLength + 1);
-        glGetShaderInfoLog(FragmentShaderID, InfoLogLength, nullptr, &FragmentShaderErrorMessage[0]);
-        printf("%s\n", &FragmentShaderErrorMessage[0]);
+string ShaderRegistry::readFile(const string& path) {
+    std::ifstream stream(path, std::ios::in | std::ios::binary);
+    if (!stream.is_open()) {
+        throw std::runtime_error("ShaderRegistry - readFile, cannot open shader file:" + path);
     }
+    std::ostringstream content;
+    content << stream.rdbuf();
+    return content.str();
+}
 
-    // Link the program
-    printf("Linking program\n");
-    GLuint ProgramID = glCreateProgram();
-    glAttachShader(ProgramID, VertexShaderID);
-    glAttachShader(ProgramID, FragmentShaderID);
-    glLinkProgram(ProgramID);
+// FNV-1a
+uint64_t ShaderRegistry::hash(const string& text, uint64_t seed) {
+    uint64_t value = seed;
+    for (unsigned char c : text) {
+        value ^= c;
+        value *= 1099511628211ULL;
+    }
+    return value;
+}
 
-    // Check the program
-    glGetProgramiv(ProgramID, GL_LINK_STATUS, &Result);
-    glGetProgramiv(ProgramID, GL_INFO_LOG_LENGTH, &InfoLogLength);
-    if (InfoLogLength > 0) {
-        std::vector<char> ProgramErrorMessage(InfoLogLength + 1);
-        glGetProgramInfoLog(ProgramID, InfoLogLength, NULL, &ProgramErrorMessage[0]);
-        printf("%s\n", &ProgramErrorMessage[0]);
-    }
-    glDetachShader(ProgramID, VertexShaderID);
-    glDetachShader(ProgramID, FragmentShaderID);
-    glDeleteShader(VertexShaderID);
-    glDeleteShader(FragmentShaderID);
-
-    // use this program
-    glUseProgram(ProgramID);
-
-    // hold programId and shaderProgram instance
-    program->_programId = ProgramID;
-    ShaderProgram::_instance = program;
-    
-    return *program;
+bool ShaderRegistry::loadBinary(ShaderProgram* program, const string& cachePath) {
+    FILE* file = fopen(cachePath.c_str(), "rb");
+    if (!file) {
+        return false;
+    }
+    ProgramBinaryHeader header;
+    std::vector<char> binary;
+    bool valid = fread(&header, sizeof(header), 1, file) == 1 &&
+                 memcmp(header.magic, PROGRAM_BINARY_MAGIC, sizeof(header.magic)) == 0 && header.length > 0;
+    if (valid) {
+        binary.resize(header.length);
+        valid = fread(binary.data(), 1, binary.size(), file) == binary.size();
+    }
+    fclose(file);
+    if (!valid) {
+        return false;
+    }
+    glProgramBinary(program->_programId, header.format, binary.data(), header.length);
+    GLint result = GL_FALSE;
+    glGetProgramiv(program->_programId, GL_LINK_STATUS, &result);
+    return result == GL_TRUE;
 }
 
-GLuint ShaderProgram::getUniform(string uniformName) const {
-    return glGetUniformLocation(this->_programId, uniformName.c_str());
+ShaderProgram* ShaderRegistry::load(string name, string vertexShaderPath, string fragmentShaderPath) {
+    ShaderProgram* existing = get(name);
+    if (existing != nullptr) {
+        return existing;
+    }
+    string vertexShaderCode = readFile(vertexShaderPath);
+    string fragmentShaderCode = readFile(fragmentShaderPath);
+
+    auto program = new ShaderProgram();
+    program->_programId = glCreateProgram();
+    if (!_cacheDirectory.empty()) {
+        uint64_t key = hash(_driver, hash(fragmentShaderCode, hash(vertexShaderCode)));
+        char fileName[32];
+        sprintf(fileName, "/%016llx.bin", (unsigned long long)key);
+        program->_cachePath = _cacheDirectory + fileName;
+        if (loadBinary(program, program->_cachePath)) {
+            program->_fromCache = true;
+            program->_finished = true;
+            _programs[name] = program;
+            return program;
+        }
+        // the driver rejected the binary (e.g. it was updated), start over with a clean program
+        glDeleteProgram(program->_programId);
+        program->_programId = glCreateProgram();
+        glProgramParameteri(program->_programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    }
+
+    // issue compile and link without querying anything, so the driver can work in the background
+    program->_vertexShaderId = compileShader(GL_VERTEX_SHADER, vertexShaderCode);
+    program->_fragmentShaderId = compileShader(GL_FRAGMENT_SHADER, fragmentShaderCode);
+    glAttachShader(program->_programId, program->_vertexShaderId);
+    glAttachShader(program->_programId, program->_fragmentShaderId);
+    glLinkProgram(program->_programId);
+
+    _programs[name] = program;
+    return program;
 }
 
-void ShaderProgram::finalize() {
-    glDeleteProgram(this->_programId);
+ShaderProgram* ShaderRegistry::get(string name) const {
+    auto found = _programs.find(name);
+    return found != _programs.end() ? found->second : nullptr;
+}
+
+void ShaderRegistry::finalize() {
+    for (auto& entry : _programs) {
+        entry.second->finalize();
+    }
+    _programs.clear();
+    _instance = nullptr;
     delete this;
 }
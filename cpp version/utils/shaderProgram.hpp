@@ -1,5 +1,5 @@
 /*
- * @brief shader program, singleton
+ * @brief shader programs and the registry that builds and owns them.
  *
  * @author alei  mailto:rayingecho@hotmail.com
  */
@@ -7,25 +7,100 @@
 #define SHADER_PROGRAM_HPP
 
 #include <stdlib.h>
+#include <stdint.h>
 #include <string>
+#include <map>
+#include <GL/glew.h>
 using namespace std;
 
+/**
+ * @brief a linked program, maybe still compiling.
+ *
+ * the compile and link commands return before the driver is done. a program is only waited for the first time
+ * its id or a uniform is needed, so the CPU can do other work (e.g. load data) while the driver compiles.
+ */
 class ShaderProgram {
 public:
-    static ShaderProgram& init(string vertexShaderPath, string fragmentShaderPath);
-    
-    GLuint getUniform(string uniformName) const;
+    // true once the driver has finished, never blocks when ARB_parallel_shader_compile is available
+    bool isReady();
+
+    GLuint getUniform(string uniformName);
+
+    // wait for the compilation if needed
+    GLuint getProgramId();
 
-    GLuint getProgramId() const { return _programId; }
+    // loaded from the binary cache instead of compiled from the sources
+    bool isFromCache() const { return _fromCache; }
 
     void finalize();
 private:
-    static ShaderProgram* _instance;
+    friend class ShaderRegistry;
 
     GLuint _programId;
 
+    // shaders of a program still compiling, 0 otherwise
+    GLuint _vertexShaderId;
+
+    GLuint _fragmentShaderId;
+
+    // the link result has been checked and the binary stored
+    bool _finished;
+
+    bool _fromCache;
+
+    // where to store the binary once linked, empty for no cache
+    string _cachePath;
+
+    map<string, GLint> _uniforms;
+
+    // check the link status, print the logs and store the binary
+    void finish();
+
+    ShaderProgram();
+};
+
+/**
+ * @brief creates, caches and owns all the shader programs, singleton.
+ *
+ * linked programs are stored as binaries (ARB_get_program_binary) keyed by a hash of the sources and the driver
+ * strings, so the next start loads them without compiling. a stale or rejected binary falls back to compiling.
+ */
+class ShaderRegistry {
+public:
+    // factory methods for singleton, the cache directory is created if needed, empty for no cache
+    static ShaderRegistry& init(string cacheDirectory = "shaderCache");
+
+    /**
+     * @brief the program of the given name, created from the shader files the first time.
+     *
+     * uncached programs are compiled asynchronously, see ShaderProgram.
+     */
+    ShaderProgram* load(string name, string vertexShaderPath, string fragmentShaderPath);
+
+    // nullptr if no program of that name was loaded
+    ShaderProgram* get(string name) const;
+
+    // delete all the programs
+    void finalize();
+private:
+    static ShaderRegistry* _instance;
+
+    string _cacheDirectory;
+
+    // vendor, renderer and version, part of the cache key since binaries only work on the same driver
+    string _driver;
+
+    map<string, ShaderProgram*> _programs;
+
+    static string readFile(const string& path);
+
+    static uint64_t hash(const string& text, uint64_t seed = 14695981039346656037ULL);
+
+    // false if the cached binary is missing or rejected by the driver
+    static bool loadBinary(ShaderProgram* program, const string& cachePath);
+
     // singleton, forbid instantiate from client.
-    ShaderProgram() {}
+    ShaderRegistry() {}
 };
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,127 @@
+/*
+ * @brief procedural geodesic sphere, for the globe.
+ *
+ * @author alei  mailto:rayingecho@hotmail.com
+ */
+#include "sphereGenerator.hpp"
+#include "meshOptimizer.hpp"
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+
+// unit points and the triangles over them, before the uv seam is cut
+struct GeodesicBuilder {
+    std::vector<glm::vec3> points;
+    std::vector<uint32_t> triangles;
+    // the point in the middle of each edge, keyed by its two end points
+    std::unordered_map<uint64_t, uint32_t> midpoints;
+
+    uint32_t midpoint(uint32_t a, uint32_t b) {
+        uint64_t key = (uint64_t(std::min(a, b)) << 32) | std::max(a, b);
+        auto found = midpoints.find(key);
+        if (found != midpoints.end()) {
+            return found->second;
+        }
+        uint32_t index = uint32_t(points.size());
+        points.push_back(glm::normalize(points[a] + points[b]));
+        midpoints[key] = index;
+        return index;
+    }
+
+    // depth first, the four children of a triangle are emitted next to each other
+    void subdivide(uint32_t a, uint32_t b, uint32_t c, int depth) {
+        if (depth == 0) {
+            triangles.push_back(a);
+            triangles.push_back(b);
+            triangles.push_back(c);
+            return;
+        }
+        uint32_t ab = midpoint(a, b);
+        uint32_t bc = midpoint(b, c);
+        uint32_t ca = midpoint(c, a);
+        subdivide(a, ab, ca, depth - 1);
+        subdivide(ab, bc, ca, depth - 1);
+        subdivide(ab, b, bc, depth - 1);
+        subdivide(ca, bc, c, depth - 1);
+    }
+};
+
+static bool isPole(const glm::vec3& point) {
+    return fabs(point.x) < 1e-6f && fabs(point.z) < 1e-6f;
+}
+
+MeshData SphereGenerator::icosphere(int subdivisions, float radius) {
+    const float t = (1.0f + sqrtf(5.0f)) / 2.0f;
+    static const int faces[20][3] = {
+        {0, 11, 5}, {0, 5, 1}, {0, 1, 7}, {0, 7, 10}, {0, 10, 11},
+        {1, 5, 9}, {5, 11, 4}, {11, 10, 2}, {10, 7, 6}, {7, 1, 8},
+        {3, 9, 4}, {3, 4, 2}, {3, 2, 6}, {3, 6, 8}, {3, 8, 9},
+        {4, 9, 5}, {2, 4, 11}, {6, 2, 10}, {8, 6, 7}, {9, 8, 1}
+    };
+    GeodesicBuilder builder;
+    const glm::vec3 corners[12] = {
+        {-1, t, 0}, {1, t, 0}, {-1, -t, 0}, {1, -t, 0},
+        {0, -1, t}, {0, 1, t}, {0, -1, -t}, {0, 1, -t},
+        {t, 0, -1}, {t, 0, 1}, {-t, 0, -1}, {-t, 0, 1}
+    };
+    for (const glm::vec3& corner : corners) {
+        builder.points.push_back(glm::normalize(corner));
+    }
+    builder.triangles.reserve(size_t(20) * 3 << (2 * subdivisions));
+    for (auto i = 0; i < 20; i++) {
+        builder.subdivide(faces[i][0], faces[i][1], faces[i][2], subdivisions);
+    }
+
+    // cut the seam, vertices are numbered by first use
+    MeshData mesh;
+    mesh.indices.reserve(builder.triangles.size());
+    std::unordered_map<uint64_t, uint32_t> vertexIds;
+    for (size_t i = 0; i < builder.triangles.size(); i += 3) {
+        float u[3];
+        for (auto k = 0; k < 3; k++) {
+            const glm::vec3& point = builder.points[builder.triangles[i + k]];
+            u[k] = 0.5f + atan2f(point.x, point.z) / (2.0f * float(M_PI));
+        }
+        float uMin = 1.0f, uMax = 0.0f, uSum = 0.0f;
+        int poleNum = 0;
+        for (auto k = 0; k < 3; k++) {
+            if (!isPole(builder.points[builder.triangles[i + k]])) {
+                uMin = std::min(uMin, u[k]);
+                uMax = std::max(uMax, u[k]);
+            }
+        }
+        // the triangle crosses +-180 degrees, continue past u = 1 instead, the textures repeat horizontally
+        for (auto k = 0; k < 3; k++) {
+            if (uMax - uMin > 0.5f && u[k] < 0.5f) {
+                u[k] += 1.0f;
+            }
+            if (isPole(builder.points[builder.triangles[i + k]])) {
+                poleNum++;
+            } else {
+                uSum += u[k];
+            }
+        }
+        for (auto k = 0; k < 3; k++) {
+            uint32_t pointIndex = builder.triangles[i + k];
+            const glm::vec3& point = builder.points[pointIndex];
+            // the pole has every longitude, use the one of the triangle
+            float vertexU = isPole(point) ? uSum / (3 - poleNum) : u[k];
+            uint32_t uBits;
+            memcpy(&uBits, &vertexU, sizeof(uBits));
+            uint64_t key = (uint64_t(pointIndex) << 32) | uBits;
+            auto found = vertexIds.find(key);
+            if (found == vertexIds.end()) {
+                Vertex vertex;
+                vertex.position = point * radius;
+                vertex.uv = glm::vec2(vertexU, 0.5f + asinf(std::max(-1.0f, std::min(point.y, 1.0f))) / float(M_PI));
+                vertex.normal = point;
+                found = vertexIds.insert(std::make_pair(key, uint32_t(mesh.vertices.size()))).first;
+                mesh.vertices.push_back(vertex);
+            }
+            mesh.indices.push_back(found->second);
+        }
+    }
+    MeshOptimizer::optimize(mesh);
+    return mesh;
+}